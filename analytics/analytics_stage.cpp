@@ -0,0 +1,242 @@
+#include "analytics/analytics_stage.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+AnalyticsStage::AnalyticsStage()
+    : user_data_(NULL), pipeline_depth_(1), queue_(NULL), result_head_(0), result_count_(0), generation_(0), dropped_(0), next_seq_(0),
+      running_(false)
+{
+    memset(&ops_, 0, sizeof(ops_));
+    memset(results_, 0, sizeof(results_));
+}
+
+AnalyticsStage::~AnalyticsStage() { stop(); }
+
+int AnalyticsStage::start(size_t input_size, int queue_depth, int n_workers, int pipeline_depth,
+                          const AnalyticsOps *ops, void *user_data)
+{
+    if (running_ || ops == NULL || ops->run == NULL || ops->collect == NULL || queue_depth <= 0 || n_workers <= 0 ||
+        n_workers > ANALYTICS_MAX_WORKERS || pipeline_depth <= 0)
+    {
+        return -1;
+    }
+    ops_ = *ops;
+    user_data_ = user_data;
+    pipeline_depth_ = pipeline_depth;
+
+    // queued frames + frames in flight in the workers + the one being filled by the probe
+    int n_slots = queue_depth + n_workers * pipeline_depth + 1;
+    slots_.resize(n_slots);
+    free_.clear();
+    free_.reserve(n_slots);
+    for (int i = 0; i < n_slots; i++)
+    {
+        AnalyticsFrame *frame = &slots_[i];
+        memset(frame, 0, sizeof(*frame));
+        frame->input_fd = -1;
+        if (ops_.alloc_input != NULL)
+        {
+            if (ops_.alloc_input(frame, input_size, user_data_) < 0)
+            {
+                stop();
+                return -1;
+            }
+        }
+        else
+        {
+            frame->input = malloc(input_size);
+            if (frame->input == NULL)
+            {
+                stop();
+                return -1;
+            }
+        }
+        frame->input_size = input_size;
+        free_.push_back(frame);
+    }
+
+    queue_ = new FrameQueue<AnalyticsFrame>(queue_depth);
+    running_ = true;
+    for (int i = 0; i < n_workers; i++)
+    {
+        workers_.push_back(std::thread(&AnalyticsStage::worker_loop, this, i));
+    }
+    return 0;
+}
+
+void AnalyticsStage::stop()
+{
+    if (queue_ != NULL)
+    {
+        queue_->close();
+    }
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+        workers_[i].join();
+    }
+    workers_.clear();
+    running_ = false;
+    delete queue_;
+    queue_ = NULL;
+
+    for (size_t i = 0; i < slots_.size(); i++)
+    {
+        if (slots_[i].input == NULL)
+        {
+            continue;
+        }
+        if (ops_.free_input != NULL)
+        {
+            ops_.free_input(&slots_[i], user_data_);
+        }
+        else
+        {
+            free(slots_[i].input);
+        }
+    }
+    slots_.clear();
+    free_.clear();
+}
+
+AnalyticsFrame *AnalyticsStage::acquire()
+{
+    if (!running_)
+    {
+        return NULL;
+    }
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        if (!free_.empty())
+        {
+            AnalyticsFrame *frame = free_.back();
+            free_.pop_back();
+            return frame;
+        }
+    }
+    // Every slot is queued or in flight: reuse the oldest queued frame.
+    AnalyticsFrame *frame = queue_->try_pop();
+    if (frame != NULL)
+    {
+        dropped_++;
+    }
+    return frame;
+}
+
+void AnalyticsStage::submit(AnalyticsFrame *frame)
+{
+    frame->seq = next_seq_++;
+    frame->generation = generation_.load();
+    AnalyticsFrame *evicted = queue_->push(frame);
+    if (evicted != NULL)
+    {
+        dropped_++;
+        release(evicted);
+    }
+}
+
+void AnalyticsStage::discard(AnalyticsFrame *frame) { release(frame); }
+
+void AnalyticsStage::release(AnalyticsFrame *frame)
+{
+    std::lock_guard<std::mutex> lock(free_mutex_);
+    free_.push_back(frame);
+}
+
+bool AnalyticsStage::latest(GstClockTime pts, AnalyticsResult *result)
+{
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    for (int i = 0; i < result_count_; i++)
+    {
+        const AnalyticsResult *candidate =
+            &results_[(result_head_ - i + ANALYTICS_RESULT_HISTORY) % ANALYTICS_RESULT_HISTORY];
+        // Never draw a result computed from a frame after the current one
+        if (!GST_CLOCK_TIME_IS_VALID(pts) || !GST_CLOCK_TIME_IS_VALID(candidate->pts) || candidate->pts <= pts)
+        {
+            *result = *candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void AnalyticsStage::flush()
+{
+    generation_++;
+    if (queue_ != NULL)
+    {
+        AnalyticsFrame *frame;
+        while ((frame = queue_->try_pop()) != NULL)
+        {
+            release(frame);
+        }
+    }
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    result_count_ = 0;
+}
+
+void AnalyticsStage::publish(const AnalyticsFrame *frame, const detect_result_group_t *group)
+{
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    if (frame->generation != generation_.load())
+    {
+        return;
+    }
+    if (result_count_ > 0 && results_[result_head_].seq > frame->seq)
+    {
+        return;
+    }
+    result_head_ = (result_head_ + 1) % ANALYTICS_RESULT_HISTORY;
+    if (result_count_ < ANALYTICS_RESULT_HISTORY)
+    {
+        result_count_++;
+    }
+    AnalyticsResult *result = &results_[result_head_];
+    result->seq = frame->seq;
+    result->pts = frame->pts;
+    result->src_width = frame->src_width;
+    result->src_height = frame->src_height;
+    result->group = *group;
+}
+
+void AnalyticsStage::worker_loop(int worker)
+{
+    detect_result_group_t group;
+    int in_flight = 0;
+    for (;;)
+    {
+        // With frames in flight only wait a little for the next one: if the
+        // stream stalls (pause, EOS) the pending results are drained instead.
+        AnalyticsFrame *frame = in_flight > 0 ? queue_->pop_for(ANALYTICS_DRAIN_TIMEOUT_MS) : queue_->pop();
+        if (frame != NULL)
+        {
+            if (ops_.run(worker, frame, user_data_) == 0)
+            {
+                in_flight++;
+            }
+            else
+            {
+                release(frame);
+            }
+        }
+        else if (in_flight == 0)
+        {
+            break; // closed
+        }
+
+        if (in_flight > 0 && (in_flight >= pipeline_depth_ || frame == NULL))
+        {
+            AnalyticsFrame *done = NULL;
+            int ret = ops_.collect(worker, &done, &group, user_data_);
+            in_flight--;
+            if (done != NULL)
+            {
+                if (ret == 0)
+                {
+                    publish(done, &group);
+                }
+                release(done);
+            }
+        }
+    }
+}
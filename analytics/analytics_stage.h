@@ -0,0 +1,127 @@
+#ifndef _ANALYTICS_STAGE_H_
+#define _ANALYTICS_STAGE_H_
+
+#include <gst/gst.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "analytics/frame_queue.h"
+#include "yolov5/postprocess.h"
+
+#define ANALYTICS_QUEUE_DEPTH 2
+#define ANALYTICS_MAX_WORKERS 8
+#define ANALYTICS_DRAIN_TIMEOUT_MS 100
+#define ANALYTICS_RESULT_HISTORY 8
+
+// One model input waiting for (or going through) inference. The streaming
+// thread fills `input` and hands the frame to the stage; a worker owns it
+// until the result is published and the slot goes back to the free list.
+typedef struct _AnalyticsFrame
+{
+    uint64_t seq;        // submission order, used to discard stale results
+    uint32_t generation; // bumped on flush so in-flight frames can be ignored
+    GstClockTime pts;    // PTS of the buffer the input was taken from
+    int src_width;       // size of the frame the input was resized from,
+    int src_height;      // detections are reported in these coordinates
+    void *input;         // model input tensor data
+    size_t input_size;
+    int input_fd;        // dma-buf fd of `input`, -1 for plain system memory
+    void *input_priv;    // owned by AnalyticsOps::alloc_input
+    bool input_dirty;    // written by the CPU, caches not yet synced to the device
+} AnalyticsFrame;
+
+typedef struct _AnalyticsResult
+{
+    uint64_t seq;
+    GstClockTime pts;
+    int src_width;
+    int src_height;
+    detect_result_group_t group;
+} AnalyticsResult;
+
+// Inference callbacks, called on worker thread `worker` (0..n_workers-1),
+// so per-worker state such as an NPU context needs no locking. run() starts
+// the model on a frame; collect() finishes the oldest frame that worker
+// started, always hands that frame back in *frame, and fills `group` on
+// success. With a pipeline depth of 1 they alternate; with depth N up to N
+// frames are started before the oldest is collected, so run() must not wait
+// for the NPU.
+//
+// alloc_input()/free_input() are optional and let the backend place the
+// input slots in device memory (e.g. rknn_create_mem) so preprocessing can
+// write straight into the tensor; by default the slots are malloc'd.
+typedef struct _AnalyticsOps
+{
+    int (*run)(int worker, AnalyticsFrame *frame, void *user_data);
+    int (*collect)(int worker, AnalyticsFrame **frame, detect_result_group_t *group, void *user_data);
+    int (*alloc_input)(AnalyticsFrame *frame, size_t size, void *user_data);
+    void (*free_input)(AnalyticsFrame *frame, void *user_data);
+} AnalyticsOps;
+
+// Asynchronous analytics stage: a bounded, drop-oldest queue of preprocessed
+// frames feeding one or more inference threads, each of which may keep
+// several frames in flight on the NPU. Workers share the queue, so whichever
+// is idle takes the next frame. The pad probe only prepares the input and
+// picks up whatever result is ready, so the display path runs at decoder
+// rate regardless of model latency.
+class AnalyticsStage
+{
+public:
+    AnalyticsStage();
+    ~AnalyticsStage();
+
+    int start(size_t input_size, int queue_depth, int n_workers, int pipeline_depth, const AnalyticsOps *ops,
+              void *user_data);
+    void stop();
+
+    // Streaming-thread side. acquire() returns a free slot, evicting the oldest
+    // queued frame when none is left; it returns NULL only when every slot is
+    // busy in the worker. A slot from acquire() must go to submit() or discard().
+    AnalyticsFrame *acquire();
+    void submit(AnalyticsFrame *frame);
+    void discard(AnalyticsFrame *frame);
+
+    // Copies the newest published result whose PTS is not ahead of `pts`.
+    // The last few results are kept so a display branch running slightly
+    // behind the analytics branch still finds the one matching its frame.
+    // Workers may finish out of order; an older frame is never published
+    // after a newer one.
+    bool latest(GstClockTime pts, AnalyticsResult *result);
+
+    // Drops queued frames and published results, e.g. after a flushing seek.
+    void flush();
+
+    uint64_t dropped() const { return dropped_.load(); }
+
+private:
+    void worker_loop(int worker);
+    void release(AnalyticsFrame *frame);
+    void publish(const AnalyticsFrame *frame, const detect_result_group_t *group);
+
+    AnalyticsOps ops_;
+    void *user_data_;
+    int pipeline_depth_;
+
+    std::vector<AnalyticsFrame> slots_;
+    std::vector<AnalyticsFrame *> free_;
+    std::mutex free_mutex_;
+    FrameQueue<AnalyticsFrame> *queue_;
+
+    std::mutex result_mutex_;
+    AnalyticsResult results_[ANALYTICS_RESULT_HISTORY];
+    int result_head_; // index of the newest result
+    int result_count_;
+
+    std::atomic<uint32_t> generation_;
+    std::atomic<uint64_t> dropped_;
+    uint64_t next_seq_;
+    std::vector<std::thread> workers_;
+    bool running_;
+};
+
+#endif //_ANALYTICS_STAGE_H_
@@ -0,0 +1,100 @@
+#ifndef _ANALYTICS_FRAME_QUEUE_H_
+#define _ANALYTICS_FRAME_QUEUE_H_
+
+#include <stddef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Bounded FIFO of frame pointers between the streaming thread and the
+// inference workers. push() never blocks: when the queue is full the oldest
+// entry is evicted and handed back so the caller can recycle its storage.
+// The ring is sized once, so steady-state use does not allocate.
+template <typename T>
+class FrameQueue
+{
+public:
+    explicit FrameQueue(size_t capacity = 2) : ring_(capacity ? capacity : 1), head_(0), count_(0), closed_(false) {}
+
+    // Returns the evicted (oldest) item when the queue was full, NULL otherwise.
+    T *push(T *item)
+    {
+        T *evicted = NULL;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (count_ == ring_.size())
+            {
+                evicted = ring_[head_];
+                head_ = (head_ + 1) % ring_.size();
+                count_--;
+            }
+            ring_[(head_ + count_) % ring_.size()] = item;
+            count_++;
+        }
+        cond_.notify_one();
+        return evicted;
+    }
+
+    // Blocks until an item is available. Returns NULL once the queue is closed.
+    T *pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return count_ > 0 || closed_; });
+        return take_locked();
+    }
+
+    // Like pop(), but gives up after `timeout_ms` and returns NULL.
+    T *pop_for(int timeout_ms)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return count_ > 0 || closed_; });
+        return take_locked();
+    }
+
+    // Removes the oldest item without blocking, NULL when empty.
+    T *try_pop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return take_locked();
+    }
+
+    // Wakes every waiter; pop() returns NULL from now on.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_;
+    }
+
+private:
+    T *take_locked()
+    {
+        if (count_ == 0 || closed_)
+        {
+            return NULL;
+        }
+        T *item = ring_[head_];
+        head_ = (head_ + 1) % ring_.size();
+        count_--;
+        return item;
+    }
+
+    std::vector<T *> ring_;
+    size_t head_;
+    size_t count_;
+    bool closed_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+#endif //_ANALYTICS_FRAME_QUEUE_H_
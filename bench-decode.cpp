@@ -0,0 +1,665 @@
+// Benchmark of the two-pass YOLOv5 head decoder against the per-cell one.
+//
+//   ./bench-decode [iterations] [out0.bin out1.bin out2.bin [zp scale]]
+//
+// With file arguments the three int8 output tensors of a 640x640 model are
+// read from raw dumps (e.g. written by gst-test with RKNN_DUMP_OUTPUTS set);
+// all heads share one zero point and scale, -128 and 1/255 by default.
+// Without them synthetic outputs are used. The two-pass decoder runs once
+// per instruction set the CPU supports; its candidates are compared with the
+// per-cell decoder's, both through the 80-class instantiation and through
+// the runtime-sized decoder. The threshold and argmax kernels are then timed
+// on their own against the scalar ones, on the same data, and a few other
+// model geometries and output types are decoded through both decoders.
+// Last, a vehicle and person allow-list with per-class thresholds is decoded
+// and compared with a per-cell decoder restricted to the same classes, and
+// the outputs are repacked in the NPU's NC1HWC2 layout and decoded in place,
+// against the NCHW decode. The run fails on any difference.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "yolov5/postprocess.h"
+
+#define BENCH_MODEL_SIZE 640
+
+static const int anchors[POST_PROCESS_OUTPUTS][6] = {
+    {10, 13, 16, 30, 33, 23}, {30, 61, 62, 45, 59, 119}, {116, 90, 156, 198, 373, 326}};
+
+static const CpuIsa isas[] = {CPU_ISA_SCALAR, CPU_ISA_SSE41, CPU_ISA_AVX2, CPU_ISA_NEON};
+
+static double __get_us(struct timeval t) { return (t.tv_sec * 1000000 + t.tv_usec); }
+
+static float deqnt(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+
+// The previous decoder: walks the grid and reads all 85 channels of every
+// cell that passes the objectness threshold
+static int legacy_process(int8_t *input, const int *anchor, int grid_h, int grid_w, int stride,
+                          std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId,
+                          int8_t thres_i8, int32_t zp, float scale)
+{
+    int validCount = 0;
+    int grid_len = grid_h * grid_w;
+    for (int a = 0; a < 3; a++)
+    {
+        for (int i = 0; i < grid_h; i++)
+        {
+            for (int j = 0; j < grid_w; j++)
+            {
+                int8_t box_confidence = input[(PROP_BOX_SIZE * a + 4) * grid_len + i * grid_w + j];
+                if (box_confidence >= thres_i8)
+                {
+                    int offset = (PROP_BOX_SIZE * a) * grid_len + i * grid_w + j;
+                    int8_t *in_ptr = input + offset;
+                    float box_x = (deqnt(*in_ptr, zp, scale)) * 2.0 - 0.5;
+                    float box_y = (deqnt(in_ptr[grid_len], zp, scale)) * 2.0 - 0.5;
+                    float box_w = (deqnt(in_ptr[2 * grid_len], zp, scale)) * 2.0;
+                    float box_h = (deqnt(in_ptr[3 * grid_len], zp, scale)) * 2.0;
+                    box_x = (box_x + j) * (float)stride;
+                    box_y = (box_y + i) * (float)stride;
+                    box_w = box_w * box_w * (float)anchor[a * 2];
+                    box_h = box_h * box_h * (float)anchor[a * 2 + 1];
+                    box_x -= (box_w / 2.0);
+                    box_y -= (box_h / 2.0);
+
+                    int8_t maxClassProbs = in_ptr[5 * grid_len];
+                    int maxClassId = 0;
+                    for (int k = 1; k < OBJ_CLASS_NUM; ++k)
+                    {
+                        int8_t prob = in_ptr[(5 + k) * grid_len];
+                        if (prob > maxClassProbs)
+                        {
+                            maxClassId = k;
+                            maxClassProbs = prob;
+                        }
+                    }
+                    if (maxClassProbs > thres_i8)
+                    {
+                        objProbs.push_back((deqnt(maxClassProbs, zp, scale)) * (deqnt(box_confidence, zp, scale)));
+                        classId.push_back(maxClassId);
+                        validCount++;
+                        boxes.push_back(box_x);
+                        boxes.push_back(box_y);
+                        boxes.push_back(box_w);
+                        boxes.push_back(box_h);
+                    }
+                }
+            }
+        }
+    }
+    return validCount;
+}
+
+// Per-cell reference of the allow-list: the best of the `allowed` classes
+// (ascending) of every cell passing obj_thres, against its own threshold
+static int subset_process(const int8_t *input, const int *anchor, int grid, int stride, const int *allowed,
+                          const int8_t *class_thres, int n_allowed, int8_t obj_thres, int32_t zp, float scale,
+                          std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId)
+{
+    int grid_len = grid * grid;
+    for (int a = 0; a < 3; a++)
+    {
+        for (int cell = 0; cell < grid_len; cell++)
+        {
+            const int8_t *in_ptr = input + (PROP_BOX_SIZE * a) * grid_len + cell;
+            if (in_ptr[4 * grid_len] < obj_thres)
+            {
+                continue;
+            }
+            int best = 0;
+            for (int k = 1; k < n_allowed; k++)
+            {
+                if (in_ptr[(5 + allowed[k]) * grid_len] > in_ptr[(5 + allowed[best]) * grid_len])
+                {
+                    best = k;
+                }
+            }
+            int8_t prob = in_ptr[(5 + allowed[best]) * grid_len];
+            if (prob <= class_thres[best])
+            {
+                continue;
+            }
+            float box_w = deqnt(in_ptr[2 * grid_len], zp, scale) * 2.0;
+            float box_h = deqnt(in_ptr[3 * grid_len], zp, scale) * 2.0;
+            box_w = box_w * box_w * (float)anchor[a * 2];
+            box_h = box_h * box_h * (float)anchor[a * 2 + 1];
+            float box_x = deqnt(in_ptr[0], zp, scale) * 2.0 - 0.5;
+            float box_y = deqnt(in_ptr[grid_len], zp, scale) * 2.0 - 0.5;
+            box_x = (box_x + cell % grid) * (float)stride;
+            box_y = (box_y + cell / grid) * (float)stride;
+            box_x -= (box_w / 2.0);
+            box_y -= (box_h / 2.0);
+            boxes.push_back(box_x);
+            boxes.push_back(box_y);
+            boxes.push_back(box_w);
+            boxes.push_back(box_h);
+            objProbs.push_back(deqnt(prob, zp, scale) * deqnt(in_ptr[4 * grid_len], zp, scale));
+            classId.push_back(allowed[best]);
+        }
+    }
+    return (int)classId.size();
+}
+
+static bool load_tensor(const char *path, std::vector<int8_t> &tensor)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    size_t n = fread(tensor.data(), 1, tensor.size(), fp);
+    fclose(fp);
+    if (n != tensor.size())
+    {
+        fprintf(stderr, "%s: expected %zu bytes, got %zu\n", path, tensor.size(), n);
+        return false;
+    }
+    return true;
+}
+
+// Background noise plus a few hundred objects, each firing on a few cells
+static void synthesize(std::vector<int8_t> &tensor, int grid, unsigned seed, int num_classes = OBJ_CLASS_NUM)
+{
+    int grid_len = grid * grid;
+    for (size_t i = 0; i < tensor.size(); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        tensor[i] = (int8_t)(-128 + (int)((seed >> 16) % 48));
+    }
+    for (int n = 0; n < grid_len / 40; n++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int8_t *base = tensor.data() + ((5 + num_classes) * ((seed >> 8) % 3)) * grid_len + (seed >> 12) % grid_len;
+        for (int c = 0; c < 5; c++)
+        {
+            base[c * grid_len] = (int8_t)(-128 + 120 + (int)((seed >> (c + 2)) % 100));
+        }
+        base[(5 + (seed >> 4) % num_classes) * grid_len] = 90;
+    }
+}
+
+// Truncating float -> half, enough for test data in [0, 1]
+static uint16_t f32_to_fp16(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = (int)((bits >> 23) & 0xff) - 112;
+    return exponent <= 0 ? 0 : (uint16_t)((exponent << 10) | ((bits >> 13) & 0x3ff));
+}
+
+// Decodes every head of `model` through its compile-time instantiation and
+// through the runtime-sized decoder; both must add the same candidates
+static int bench_model(const char *name, const YoloModel &model, void *const *outputs, int iterations)
+{
+    PostProcessWorkspace workspaces[2];
+    double ms[2];
+    for (int w = 0; w < 2; w++)
+    {
+        workspaces[w].specialized = w == 0;
+        workspaces[w].configure(model);
+        struct timeval start_time, stop_time;
+        gettimeofday(&start_time, NULL);
+        for (int it = 0; it < iterations; it++)
+        {
+            workspaces[w].candidates.clear();
+            for (int h = 0; h < model.num_heads; h++)
+            {
+                decode_head(outputs[h], h, BOX_THRESH, &workspaces[w]);
+            }
+        }
+        gettimeofday(&stop_time, NULL);
+        ms[w] = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+    }
+    const NmsEngine &a = workspaces[0].candidates;
+    const NmsEngine &b = workspaces[1].candidates;
+    bool same = a.size() == b.size();
+    for (size_t i = 0; same && i < a.size(); i++)
+    {
+        same = a.x1(i) == b.x1(i) && a.y1(i) == b.y1(i) && a.x2(i) == b.x2(i) && a.y2(i) == b.y2(i) &&
+               a.score(i) == b.score(i) && a.class_id(i) == b.class_id(i);
+    }
+    printf("  %-24s instantiated %7.3f ms  runtime %7.3f ms  x%.2f  %zu candidates  %s\n", name, ms[0], ms[1],
+           ms[1] / ms[0], a.size(), same ? "match" : "MISMATCH");
+    return same ? 0 : 1;
+}
+
+// Models other than the int8 COCO one: a 2-class int8 model at 320x320 and
+// the COCO model with fp16 and fp32 outputs
+static int bench_models(int iterations)
+{
+    int failures = 0;
+    printf("decoder instantiations:\n");
+
+    YoloModel model;
+    int channels[3], grids[3];
+    YoloTensorType types[3];
+    std::vector<int8_t> small[3];
+    void *outputs[3];
+    for (int i = 0; i < 3; i++)
+    {
+        grids[i] = 320 / (8 << i);
+        channels[i] = 3 * (5 + 2);
+        types[i] = YOLO_TENSOR_INT8;
+        small[i].resize((size_t)channels[i] * grids[i] * grids[i]);
+        synthesize(small[i], grids[i], 10 + i, 2);
+        outputs[i] = small[i].data();
+    }
+    yolo_model_from_shapes(&model, 320, 320, 3, channels, grids, grids, types, 3);
+    for (int i = 0; i < 3; i++)
+    {
+        model.heads[i].zp = -128;
+        model.heads[i].scale = 1.0f / 255.0f;
+    }
+    failures += bench_model("int8 2 classes 320x320", model, outputs, iterations);
+
+    std::vector<uint16_t> fp16[3];
+    std::vector<float> fp32[3];
+    for (int i = 0; i < 3; i++)
+    {
+        grids[i] = BENCH_MODEL_SIZE / (8 << i);
+        channels[i] = 3 * PROP_BOX_SIZE;
+        std::vector<int8_t> q((size_t)channels[i] * grids[i] * grids[i]);
+        synthesize(q, grids[i], 20 + i);
+        fp16[i].resize(q.size());
+        fp32[i].resize(q.size());
+        for (size_t k = 0; k < q.size(); k++)
+        {
+            fp32[i][k] = (q[k] + 128) / 255.0f;
+            fp16[i][k] = f32_to_fp16(fp32[i][k]);
+        }
+    }
+    for (int t = 0; t < 2; t++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            types[i] = t == 0 ? YOLO_TENSOR_FP16 : YOLO_TENSOR_FP32;
+            outputs[i] = t == 0 ? (void *)fp16[i].data() : (void *)fp32[i].data();
+        }
+        yolo_model_from_shapes(&model, BENCH_MODEL_SIZE, BENCH_MODEL_SIZE, 3, channels, grids, grids, types, 3);
+        failures += bench_model(t == 0 ? "fp16 80 classes 640x640" : "fp32 80 classes 640x640", model, outputs,
+                                iterations);
+    }
+    return failures;
+}
+
+// Person, bicycle, car, motorbike, bus and truck, given out of order, with
+// their own thresholds: decoded through every kernel table, timed against
+// decoding all 80 classes, and compared with subset_process()
+static int bench_classes(std::vector<int8_t> *heads, int32_t zp, float scale, int iterations)
+{
+    static const int allowed[] = {7, 0, 1, 2, 3, 5};
+    static const float thresholds[] = {0.3f, 0.4f, 0.25f, 0.2f, 0.25f, 0.35f};
+    const int n_allowed = sizeof(allowed) / sizeof(allowed[0]);
+    // the same list sorted, as the decoder keeps it
+    int sorted[n_allowed];
+    int8_t class_thres[n_allowed];
+    float obj_threshold = thresholds[0];
+    for (int i = 0; i < n_allowed; i++)
+    {
+        int pos = 0;
+        for (int j = 0; j < n_allowed; j++)
+        {
+            pos += allowed[j] < allowed[i];
+        }
+        sorted[pos] = allowed[i];
+        class_thres[pos] = (int8_t)std::max(-128.0f, std::min(127.0f, thresholds[i] / scale + zp));
+        obj_threshold = std::min(obj_threshold, thresholds[i]);
+    }
+    int8_t obj_thres = (int8_t)std::max(-128.0f, std::min(127.0f, obj_threshold / scale + zp));
+
+    std::vector<float> boxes, probs;
+    std::vector<int> classes;
+    for (int h = 0; h < POST_PROCESS_OUTPUTS; h++)
+    {
+        int grid = BENCH_MODEL_SIZE / (8 << h);
+        subset_process(heads[h].data(), anchors[h], grid, 8 << h, sorted, class_thres, n_allowed, obj_thres, zp,
+                       scale, boxes, probs, classes);
+    }
+
+    int failures = 0;
+    printf("allow-list of %d classes:\n", n_allowed);
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    {
+        PostProcessWorkspace workspace;
+        workspace.kernels = decode_kernels_get(isas[k]);
+        if (workspace.kernels == NULL)
+        {
+            continue;
+        }
+        workspace.reserve(BENCH_MODEL_SIZE, BENCH_MODEL_SIZE);
+        for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+        {
+            workspace.set_quant(i, zp, scale);
+        }
+        void *outputs[POST_PROCESS_OUTPUTS] = {heads[0].data(), heads[1].data(), heads[2].data()};
+        double ms[2];
+        int count = 0;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            if (pass == 1)
+            {
+                workspace.set_classes(allowed, thresholds, n_allowed);
+            }
+            struct timeval start_time, stop_time;
+            gettimeofday(&start_time, NULL);
+            for (int it = 0; it < iterations; it++)
+            {
+                count = workspace.decode(outputs, obj_threshold);
+            }
+            gettimeofday(&stop_time, NULL);
+            ms[pass] = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+        }
+
+        const NmsEngine &c = workspace.candidates;
+        bool same = count == (int)classes.size();
+        for (int i = 0; same && i < count; i++)
+        {
+            same = c.x1(i) == boxes[i * 4] && c.y1(i) == boxes[i * 4 + 1] && c.score(i) == probs[i] &&
+                   c.class_id(i) == classes[i] && c.x2(i) == boxes[i * 4] + boxes[i * 4 + 2] &&
+                   c.y2(i) == boxes[i * 4 + 1] + boxes[i * 4 + 3];
+        }
+        printf("  %-7s all classes %7.3f ms  allow-list %7.3f ms  x%.2f  %d candidates  %s\n",
+               workspace.kernels->name, ms[0], ms[1], ms[0] / ms[1], count, same ? "match" : "MISMATCH");
+        if (!same)
+        {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// Repacks the int8 heads in NC1HWC2 with blocks of c2 channels, decodes them
+// in place and compares with the NCHW decode; the native -> NCHW conversion
+// the runtime does in rknn_outputs_get is timed too, as the pass saved
+static int bench_native(std::vector<int8_t> *heads, int32_t zp, float scale, int c2, int iterations)
+{
+    YoloModel nchw, native;
+    yolo_model_default(&nchw, BENCH_MODEL_SIZE, BENCH_MODEL_SIZE);
+    std::vector<int8_t> packed[POST_PROCESS_OUTPUTS], unpacked[POST_PROCESS_OUTPUTS];
+    void *nchw_outputs[POST_PROCESS_OUTPUTS], *native_outputs[POST_PROCESS_OUTPUTS];
+    for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+    {
+        nchw.heads[i].zp = zp;
+        nchw.heads[i].scale = scale;
+    }
+    native = nchw;
+    for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+    {
+        YoloHead *head = &native.heads[i];
+        head->layout = YOLO_LAYOUT_NC1HWC2;
+        head->c2 = c2;
+        int channels = head->num_anchors * PROP_BOX_SIZE;
+        int grid_len = head->grid_h * head->grid_w;
+        packed[i].assign((size_t)(channels + c2 - 1) / c2 * c2 * grid_len, 0);
+        unpacked[i].resize(heads[i].size());
+        for (int c = 0; c < channels; c++)
+        {
+            for (int cell = 0; cell < grid_len; cell++)
+            {
+                packed[i][yolo_head_index(head, c, cell)] = heads[i][(size_t)c * grid_len + cell];
+            }
+        }
+        nchw_outputs[i] = heads[i].data();
+        native_outputs[i] = packed[i].data();
+    }
+
+    struct timeval start_time, stop_time;
+    gettimeofday(&start_time, NULL);
+    for (int it = 0; it < iterations; it++)
+    {
+        for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+        {
+            const YoloHead *head = &native.heads[i];
+            int grid_len = head->grid_h * head->grid_w;
+            for (int c = 0; c < head->num_anchors * PROP_BOX_SIZE; c++)
+            {
+                for (int cell = 0; cell < grid_len; cell++)
+                {
+                    unpacked[i][(size_t)c * grid_len + cell] = packed[i][yolo_head_index(head, c, cell)];
+                }
+            }
+        }
+    }
+    gettimeofday(&stop_time, NULL);
+    double convert_ms = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+    int failures = unpacked[0] == heads[0] ? 0 : 1;
+    printf("NC1HWC2 (c2 %d): conversion to NCHW %7.3f ms  %s\n", c2, convert_ms, failures == 0 ? "match" : "MISMATCH");
+
+    static const int allowed[] = {0, 1, 2, 3, 5, 7};
+    for (int pass = 0; pass < 3; pass++)
+    {
+        PostProcessWorkspace workspaces[2];
+        double ms[2];
+        for (int w = 0; w < 2; w++)
+        {
+            workspaces[w].specialized = pass == 0;
+            workspaces[w].configure(w == 0 ? nchw : native);
+            if (pass == 2)
+            {
+                workspaces[w].set_classes(allowed, NULL, sizeof(allowed) / sizeof(allowed[0]));
+            }
+            gettimeofday(&start_time, NULL);
+            for (int it = 0; it < iterations; it++)
+            {
+                workspaces[w].decode(w == 0 ? nchw_outputs : native_outputs, BOX_THRESH);
+            }
+            gettimeofday(&stop_time, NULL);
+            ms[w] = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+        }
+        const NmsEngine &a = workspaces[0].candidates;
+        const NmsEngine &b = workspaces[1].candidates;
+        bool same = a.size() == b.size();
+        for (size_t i = 0; same && i < a.size(); i++)
+        {
+            same = a.x1(i) == b.x1(i) && a.y1(i) == b.y1(i) && a.x2(i) == b.x2(i) && a.y2(i) == b.y2(i) &&
+                   a.score(i) == b.score(i) && a.class_id(i) == b.class_id(i);
+        }
+        static const char *passes[] = {"80c", "runtime", "allow-list"};
+        printf("  %-10s NCHW %7.3f ms  NC1HWC2 %7.3f ms  %zu candidates  %s\n", passes[pass], ms[0], ms[1], a.size(),
+               same ? "match" : "MISMATCH");
+        failures += same ? 0 : 1;
+    }
+    return failures;
+}
+
+// Times each kernel table against the scalar one on the stride 8 head: the
+// threshold scan over its objectness planes and the argmax over the class
+// rows of every cell
+static int bench_kernels(const std::vector<int8_t> &head, int grid, int8_t thres_i8, int iterations)
+{
+    int grid_len = grid * grid;
+    std::vector<int8_t> rows((size_t)grid_len * OBJ_CLASS_NUM);
+    for (int cell = 0; cell < grid_len; cell++)
+    {
+        for (int k = 0; k < OBJ_CLASS_NUM; k++)
+        {
+            rows[(size_t)cell * OBJ_CLASS_NUM + k] = head[(size_t)(5 + k) * grid_len + cell];
+        }
+    }
+    std::vector<int> expected_cells(grid_len), cells(grid_len);
+    std::vector<int> expected_args(grid_len), args(grid_len);
+    std::vector<int8_t> expected_max(grid_len), max(grid_len);
+    const DecodeKernels *scalar = decode_kernels_get(CPU_ISA_SCALAR);
+    int failures = 0;
+    double scalar_ms[2] = {0, 0};
+
+    printf("kernels (%d cells, %d classes):\n", grid_len, OBJ_CLASS_NUM);
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    {
+        const DecodeKernels *kernels = decode_kernels_get(isas[k]);
+        if (kernels == NULL)
+        {
+            continue;
+        }
+        struct timeval start_time, stop_time;
+        int count = 0;
+        gettimeofday(&start_time, NULL);
+        for (int it = 0; it < iterations; it++)
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                count = kernels->threshold_compress(head.data() + (PROP_BOX_SIZE * a + 4) * grid_len, grid_len,
+                                                    thres_i8, cells.data());
+            }
+        }
+        gettimeofday(&stop_time, NULL);
+        double compress_ms = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+
+        gettimeofday(&start_time, NULL);
+        for (int it = 0; it < iterations; it++)
+        {
+            for (int cell = 0; cell < grid_len; cell++)
+            {
+                args[cell] = kernels->argmax(&rows[(size_t)cell * OBJ_CLASS_NUM], OBJ_CLASS_NUM, &max[cell]);
+            }
+        }
+        gettimeofday(&stop_time, NULL);
+        double argmax_ms = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+
+        if (kernels == scalar)
+        {
+            scalar_ms[0] = compress_ms;
+            scalar_ms[1] = argmax_ms;
+        }
+        // the last anchor's cells were left in `cells`
+        int expected_count = scalar->threshold_compress(head.data() + (PROP_BOX_SIZE * 2 + 4) * grid_len, grid_len,
+                                                        thres_i8, expected_cells.data());
+        for (int cell = 0; cell < grid_len; cell++)
+        {
+            expected_args[cell] = scalar->argmax(&rows[(size_t)cell * OBJ_CLASS_NUM], OBJ_CLASS_NUM,
+                                                 &expected_max[cell]);
+        }
+        // odd lengths and every position of the maximum exercise the tails
+        bool same = count == expected_count && memcmp(cells.data(), expected_cells.data(), count * sizeof(int)) == 0 &&
+                    args == expected_args && max == expected_max;
+        int8_t probe[OBJ_CLASS_NUM + 17];
+        for (int n = 1; same && n <= OBJ_CLASS_NUM + 17; n++)
+        {
+            for (int pos = 0; same && pos < n; pos++)
+            {
+                for (int i = 0; i < n; i++)
+                {
+                    probe[i] = (int8_t)(-100 + (i * 7) % 50);
+                }
+                probe[pos] = 120;
+                probe[(pos + n / 2) % n] = 120; // a tie: the first one wins
+                int8_t m0, m1;
+                int c0[OBJ_CLASS_NUM + 17], c1[OBJ_CLASS_NUM + 17];
+                int n0 = scalar->threshold_compress(probe, n, -80, c0);
+                int n1 = kernels->threshold_compress(probe, n, -80, c1);
+                same = scalar->argmax(probe, n, &m0) == kernels->argmax(probe, n, &m1) && m0 == m1 && n0 == n1 &&
+                       memcmp(c0, c1, n0 * sizeof(int)) == 0;
+            }
+        }
+        printf("  %-7s threshold %7.3f ms  x%.2f   argmax %7.3f ms  x%.2f  %s\n", kernels->name, compress_ms,
+               scalar_ms[0] / compress_ms, argmax_ms, scalar_ms[1] / argmax_ms, same ? "match" : "MISMATCH");
+        if (!same)
+        {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    if (iterations <= 0 || (argc > 2 && argc != 5 && argc != 7))
+    {
+        fprintf(stderr, "usage: %s [iterations] [out0.bin out1.bin out2.bin [zp scale]]\n", argv[0]);
+        return 1;
+    }
+    int32_t zp = argc == 7 ? atoi(argv[5]) : -128;
+    float scale = argc == 7 ? atof(argv[6]) : 1.0f / 255.0f;
+
+    std::vector<int8_t> heads[POST_PROCESS_OUTPUTS];
+    for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+    {
+        int grid = BENCH_MODEL_SIZE / (8 << i);
+        heads[i].resize((size_t)3 * PROP_BOX_SIZE * grid * grid);
+        if (argc > 2 ? !load_tensor(argv[2 + i], heads[i]) : (synthesize(heads[i], grid, i + 1), false))
+        {
+            return 1;
+        }
+    }
+
+    PostProcessWorkspace workspace;
+    workspace.reserve(BENCH_MODEL_SIZE, BENCH_MODEL_SIZE);
+    for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+    {
+        workspace.set_quant(i, zp, scale);
+    }
+    std::vector<float> boxes, probs;
+    std::vector<int> classes;
+    int8_t thres_i8 = (int8_t)std::max(-128.0f, std::min(127.0f, (float)BOX_THRESH / scale + zp));
+    int failures = 0;
+
+    for (int h = 0; h < POST_PROCESS_OUTPUTS; h++)
+    {
+        int grid = BENCH_MODEL_SIZE / (8 << h);
+        int stride = 8 << h;
+        struct timeval start_time, stop_time;
+
+        gettimeofday(&start_time, NULL);
+        for (int it = 0; it < iterations; it++)
+        {
+            boxes.clear();
+            probs.clear();
+            classes.clear();
+            legacy_process(heads[h].data(), anchors[h], grid, grid, stride, boxes, probs, classes, thres_i8, zp, scale);
+        }
+        gettimeofday(&stop_time, NULL);
+        double legacy_ms = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+        printf("stride %2d (%dx%d): per-cell %7.3f ms  %d candidates\n", stride, grid, grid, legacy_ms,
+               (int)classes.size());
+
+        for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]) * 2; k++)
+        {
+            // every ISA through the 80-class instantiation, then through the runtime-sized decoder
+            workspace.kernels = decode_kernels_get(isas[k % (sizeof(isas) / sizeof(isas[0]))]);
+            if (workspace.kernels == NULL)
+            {
+                continue;
+            }
+            workspace.specialized = k < sizeof(isas) / sizeof(isas[0]);
+            workspace.configure(workspace.model());
+            int count = 0;
+            gettimeofday(&start_time, NULL);
+            for (int it = 0; it < iterations; it++)
+            {
+                workspace.candidates.clear();
+                count = decode_head(heads[h].data(), h, BOX_THRESH, &workspace);
+            }
+            gettimeofday(&stop_time, NULL);
+            double two_pass_ms = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+
+            const NmsEngine &c = workspace.candidates;
+            bool same = count == (int)classes.size();
+            for (int i = 0; same && i < count; i++)
+            {
+                same = c.x1(i) == boxes[i * 4] && c.y1(i) == boxes[i * 4 + 1] && c.score(i) == probs[i] &&
+                       c.class_id(i) == classes[i] && c.x2(i) == boxes[i * 4] + boxes[i * 4 + 2] &&
+                       c.y2(i) == boxes[i * 4 + 1] + boxes[i * 4 + 3];
+            }
+            printf("  two-pass %-7s %-8s %7.3f ms  x%.2f  %s\n", workspace.kernels->name,
+                   workspace.specialized ? "80c" : "runtime", two_pass_ms, legacy_ms / two_pass_ms,
+                   same ? "match" : "MISMATCH");
+            if (!same)
+            {
+                failures++;
+            }
+        }
+    }
+
+    failures += bench_kernels(heads[0], BENCH_MODEL_SIZE / 8, thres_i8, iterations);
+    failures += bench_models(iterations);
+    failures += bench_classes(heads, zp, scale, iterations);
+    failures += bench_native(heads, zp, scale, 16, iterations);
+    failures += bench_native(heads, zp, scale, 32, iterations);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,451 @@
+// Golden-tensor regression and timing of post_process() on recorded outputs.
+//
+//   ./bench-golden [dir] [iterations] [threads]
+//   ./bench-golden --update <dir>
+//   ./bench-golden --synthesize <dir> [frames] [objects] [size]
+//
+// <dir> holds what gst-test writes with RKNN_DUMP_OUTPUTS set: model.txt
+// (geometry, output types and layout, zp/scale of every head) and the raw
+// outputs frameNNN_outK.bin. --update decodes every frame with the scalar
+// kernels and the runtime-sized decoder on one thread and writes the kept
+// detections to frameNNN.golden, one "class score left top right bottom"
+// line each, in model input pixels. --synthesize creates <dir> with a
+// model.txt and frames of the default model at size x size (640) with random
+// objects, for a host with no recordings. <dir> defaults to testdata/golden,
+// 320x320 frames made that way and committed with their golden detections.
+//
+// Without an option each decoder configuration (every kernel instruction
+// set the CPU supports through the compile-time instantiations, the
+// runtime-sized decoder, and the parallel decoder on `threads` threads,
+// forced on whatever the model size) must
+// reproduce the golden detections of every frame, then is timed over all
+// frames. Reported per frame: time, NMS candidates and heap allocations
+// once the workspace is sized. The run fails on any difference and on any
+// steady-state allocation.
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include "yolov5/postprocess.h"
+
+#define GOLDEN_MAX_FRAMES 1000
+// the decoders must give the same boxes; scores may move in the last digits
+#define GOLDEN_SCORE_TOLERANCE 1e-5f
+#ifndef GOLDEN_DEFAULT_DIR
+#define GOLDEN_DEFAULT_DIR "testdata/golden"
+#endif
+
+static std::atomic<long> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations++;
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+static double __get_us(struct timeval t) { return (t.tv_sec * 1000000 + t.tv_usec); }
+
+typedef struct _GoldenDetection
+{
+    int class_id;
+    float score;
+    BOX_RECT box;
+} GoldenDetection;
+
+// One recorded frame: an output buffer per head and the expected detections
+typedef struct _GoldenFrame
+{
+    std::vector<int8_t> outputs[YOLO_MAX_HEADS];
+    std::vector<GoldenDetection> golden;
+    bool has_golden;
+} GoldenFrame;
+
+static const char *frame_path(char *path, size_t size, const char *dir, int frame, const char *suffix)
+{
+    snprintf(path, size, "%s/frame%03d%s", dir, frame, suffix);
+    return path;
+}
+
+static bool read_file(const char *path, std::vector<int8_t> &data)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    size_t n = fread(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    if (n != data.size())
+    {
+        fprintf(stderr, "%s: expected %zu bytes, got %zu\n", path, data.size(), n);
+        return false;
+    }
+    return true;
+}
+
+// Loads frames until frameNNN_out0.bin is missing
+static int load_frames(const char *dir, const YoloModel &model, std::vector<GoldenFrame> &frames)
+{
+    char path[512];
+    for (int f = 0; f < GOLDEN_MAX_FRAMES; f++)
+    {
+        GoldenFrame frame;
+        for (int h = 0; h < model.num_heads; h++)
+        {
+            char suffix[32]; // "_out%d.bin" of any int
+            snprintf(suffix, sizeof(suffix), "_out%d.bin", h);
+            frame.outputs[h].resize(yolo_head_size(&model, h));
+            if (!read_file(frame_path(path, sizeof(path), dir, f, suffix), frame.outputs[h]))
+            {
+                if (h == 0)
+                {
+                    return (int)frames.size();
+                }
+                fprintf(stderr, "%s: missing\n", path);
+                return -1;
+            }
+        }
+
+        FILE *fp = fopen(frame_path(path, sizeof(path), dir, f, ".golden"), "r");
+        frame.has_golden = fp != NULL;
+        GoldenDetection d;
+        while (fp != NULL && fscanf(fp, "%d %f %d %d %d %d", &d.class_id, &d.score, &d.box.left, &d.box.top,
+                                    &d.box.right, &d.box.bottom) == 6)
+        {
+            frame.golden.push_back(d);
+        }
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        frames.push_back(frame);
+    }
+    return (int)frames.size();
+}
+
+// post_process() at model scale; the class ids come from the NMS survivors,
+// which are the group's results in order
+static int detect(GoldenFrame &frame, PostProcessWorkspace *workspace, detect_result_group_t *group,
+                  GoldenDetection *detections)
+{
+    void *outputs[YOLO_MAX_HEADS];
+    for (int h = 0; h < YOLO_MAX_HEADS; h++)
+    {
+        outputs[h] = frame.outputs[h].data();
+    }
+    post_process(outputs, BOX_THRESH, NMS_THRESH, 1.0f, 1.0f, workspace, group);
+    for (int i = 0; i < group->count; i++)
+    {
+        detections[i].class_id = workspace->candidates.class_id(workspace->keep[i]);
+        detections[i].score = group->results[i].prop;
+        detections[i].box = group->results[i].box;
+    }
+    return group->count;
+}
+
+static bool same_detections(const GoldenDetection *detections, int count, const std::vector<GoldenDetection> &golden)
+{
+    if (count != (int)golden.size())
+    {
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        const GoldenDetection &a = detections[i];
+        const GoldenDetection &b = golden[i];
+        if (a.class_id != b.class_id || fabsf(a.score - b.score) > GOLDEN_SCORE_TOLERANCE ||
+            a.box.left != b.box.left || a.box.top != b.box.top || a.box.right != b.box.right ||
+            a.box.bottom != b.box.bottom)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int update(const char *dir, const YoloModel &model, std::vector<GoldenFrame> &frames)
+{
+    PostProcessWorkspace workspace;
+    workspace.kernels = decode_kernels_get(CPU_ISA_SCALAR);
+    workspace.specialized = false;
+    workspace.configure(model);
+    detect_result_group_t group;
+    GoldenDetection detections[OBJ_NUMB_MAX_SIZE];
+    char path[512];
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        int count = detect(frames[f], &workspace, &group, detections);
+        FILE *fp = fopen(frame_path(path, sizeof(path), dir, (int)f, ".golden"), "w");
+        if (fp == NULL)
+        {
+            fprintf(stderr, "cannot write %s\n", path);
+            return 1;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            fprintf(fp, "%d %.6f %d %d %d %d\n", detections[i].class_id, detections[i].score, detections[i].box.left,
+                    detections[i].box.top, detections[i].box.right, detections[i].box.bottom);
+        }
+        fclose(fp);
+        printf("%s: %d detections\n", path, count);
+    }
+    return 0;
+}
+
+static int8_t quantize(float value, const YoloHead *head)
+{
+    int q = (int)(value / head->scale + 0.5f) + head->zp;
+    return (int8_t)(q < -128 ? -128 : (q > 127 ? 127 : q));
+}
+
+// mkdir -p
+static int make_dirs(const char *dir)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char *p = path + 1;; p++)
+    {
+        if (*p == '/' || *p == '\0')
+        {
+            char c = *p;
+            *p = '\0';
+            if (mkdir(path, 0755) < 0 && errno != EEXIST)
+            {
+                return -1;
+            }
+            *p = c;
+        }
+        if (*p == '\0')
+        {
+            return 0;
+        }
+    }
+}
+
+// Background noise plus `objects` objects per frame, each on a few cells
+static int synthesize(const char *dir, int n_frames, int objects, int size)
+{
+    if (make_dirs(dir) < 0)
+    {
+        fprintf(stderr, "cannot create %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    YoloModel model;
+    yolo_model_default(&model, size, size);
+    for (int h = 0; h < model.num_heads; h++)
+    {
+        model.heads[h].zp = -128;
+        model.heads[h].scale = 1.0f / 255.0f;
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/model.txt", dir);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL || yolo_model_write(fp, &model) < 0)
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+    fclose(fp);
+
+    unsigned seed = 1;
+    for (int f = 0; f < n_frames; f++)
+    {
+        for (int h = 0; h < model.num_heads; h++)
+        {
+            const YoloHead *head = &model.heads[h];
+            int grid_len = head->grid_h * head->grid_w;
+            std::vector<int8_t> out(yolo_head_size(&model, h));
+            for (size_t i = 0; i < out.size(); i++)
+            {
+                seed = seed * 1103515245 + 12345;
+                out[i] = quantize(((seed >> 16) % 40) / 255.0f, head);
+            }
+            for (int n = 0; n < objects / model.num_heads; n++)
+            {
+                seed = seed * 1103515245 + 12345;
+                int a = (seed >> 8) % head->num_anchors;
+                int cell = (seed >> 12) % grid_len;
+                int cls = (seed >> 4) % model.num_classes;
+                int8_t *base = out.data() + (5 + model.num_classes) * a * grid_len;
+                for (int d = 0; d < 3 && cell + d < grid_len; d++)
+                {
+                    base[0 * grid_len + cell + d] = quantize(0.5f, head);
+                    base[1 * grid_len + cell + d] = quantize(0.5f, head);
+                    base[2 * grid_len + cell + d] = quantize(0.6f + 0.05f * d, head);
+                    base[3 * grid_len + cell + d] = quantize(0.6f, head);
+                    base[4 * grid_len + cell + d] = quantize(0.9f - 0.1f * d, head);
+                    base[(5 + cls) * grid_len + cell + d] = quantize(0.8f - 0.05f * (seed % 3), head);
+                }
+            }
+            char suffix[32]; // "_out%d.bin" of any int
+            snprintf(suffix, sizeof(suffix), "_out%d.bin", h);
+            fp = fopen(frame_path(path, sizeof(path), dir, f, suffix), "wb");
+            if (fp == NULL || fwrite(out.data(), 1, out.size(), fp) != out.size())
+            {
+                fprintf(stderr, "cannot write %s\n", path);
+                return 1;
+            }
+            fclose(fp);
+        }
+    }
+    printf("%s: %d synthetic frames\n", dir, n_frames);
+    return 0;
+}
+
+// Checks one configuration against the golden detections, then times it
+static int run_config(const char *name, PostProcessWorkspace *workspace, std::vector<GoldenFrame> &frames,
+                      int iterations)
+{
+    detect_result_group_t group;
+    GoldenDetection detections[OBJ_NUMB_MAX_SIZE];
+    int mismatches = 0;
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        int count = detect(frames[f], workspace, &group, detections);
+        if (!same_detections(detections, count, frames[f].golden))
+        {
+            if (mismatches++ == 0)
+            {
+                printf("  %s: frame %zu: %d detections, golden %zu\n", name, f, count, frames[f].golden.size());
+            }
+        }
+    }
+
+    long candidates = 0;
+    long allocations_before = g_allocations.load();
+    struct timeval start_time, stop_time;
+    gettimeofday(&start_time, NULL);
+    for (int it = 0; it < iterations; it++)
+    {
+        for (size_t f = 0; f < frames.size(); f++)
+        {
+            detect(frames[f], workspace, &group, detections);
+            candidates += (long)workspace->candidates.size();
+        }
+    }
+    gettimeofday(&stop_time, NULL);
+    long allocations = g_allocations.load() - allocations_before;
+    double n = (double)iterations * frames.size();
+    printf("  %-16s %10.0f ns/frame  %8.1f candidates/frame  %6.2f allocations/frame  %s\n", name,
+           (__get_us(stop_time) - __get_us(start_time)) * 1000.0 / n, candidates / n, allocations / n,
+           mismatches == 0 ? "match" : "MISMATCH");
+    return mismatches != 0 || allocations != 0 ? 1 : 0;
+}
+
+static int usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [dir] [iterations] [threads]\n"
+            "       %s --update <dir>\n"
+            "       %s --synthesize <dir> [frames] [objects] [size]\n",
+            argv0, argv0, argv0);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--synthesize") == 0)
+    {
+        int n_frames = argc > 3 ? atoi(argv[3]) : 8;
+        int objects = argc > 4 ? atoi(argv[4]) : 50;
+        int size = argc > 5 ? atoi(argv[5]) : 640;
+        // whole grid cells on the coarsest (stride 32) head
+        bool valid = argc >= 3 && n_frames > 0 && objects >= 0 && size > 0 && size % 32 == 0;
+        return valid ? synthesize(argv[2], n_frames, objects, size) : usage(argv[0]);
+    }
+    bool updating = argc > 1 && strcmp(argv[1], "--update") == 0;
+    const char *dir = updating ? (argc > 2 ? argv[2] : NULL) : (argc > 1 ? argv[1] : GOLDEN_DEFAULT_DIR);
+    int iterations = !updating && argc > 2 ? atoi(argv[2]) : 100;
+    int threads = !updating && argc > 3 ? atoi(argv[3]) : 4;
+    if (dir == NULL || iterations <= 0 || threads < 1)
+    {
+        return usage(argv[0]);
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/model.txt", dir);
+    FILE *fp = fopen(path, "r");
+    YoloModel model;
+    if (fp == NULL || yolo_model_read(fp, &model) < 0)
+    {
+        fprintf(stderr, "%s: missing or not a model description\n", path);
+        return 1;
+    }
+    fclose(fp);
+    std::vector<GoldenFrame> frames;
+    if (load_frames(dir, model, frames) <= 0)
+    {
+        fprintf(stderr, "%s: no frameNNN_outK.bin outputs\n", dir);
+        return 1;
+    }
+    printf("%s: %zu frames, %dx%d, %d classes, %d heads\n", dir, frames.size(), model.input_w, model.input_h,
+           model.num_classes, model.num_heads);
+    if (updating)
+    {
+        return update(dir, model, frames);
+    }
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        if (!frames[f].has_golden)
+        {
+            fprintf(stderr, "%s: no golden detections, run %s --update %s first\n",
+                    frame_path(path, sizeof(path), dir, (int)f, ".golden"), argv[0], dir);
+            return 1;
+        }
+    }
+
+    static const CpuIsa isas[] = {CPU_ISA_SCALAR, CPU_ISA_SSE41, CPU_ISA_AVX2, CPU_ISA_NEON};
+    int failures = 0;
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    {
+        PostProcessWorkspace workspace;
+        workspace.kernels = decode_kernels_get(isas[k]);
+        if (workspace.kernels != NULL)
+        {
+            workspace.configure(model);
+            failures += run_config(workspace.kernels->name, &workspace, frames, iterations);
+        }
+    }
+    {
+        PostProcessWorkspace workspace;
+        workspace.specialized = false;
+        workspace.configure(model);
+        failures += run_config("runtime-sized", &workspace, frames, iterations);
+    }
+    {
+        // small fixtures included, so the band merge order is checked too
+        PostProcessWorkspace workspace;
+        workspace.set_decode_threads(threads);
+        workspace.parallel_min_cells = 0;
+        workspace.configure(model);
+        char name[32];
+        snprintf(name, sizeof(name), "%d threads%s", threads, workspace.parallel() ? "" : " (serial)");
+        failures += run_config(name, &workspace, frames, iterations);
+        if (threads > 1 && !workspace.parallel())
+        {
+            printf("  %s: the pool was not used\n", name);
+            failures++;
+        }
+    }
+    deinitPostProcess();
+    return failures == 0 ? 0 : 1;
+}
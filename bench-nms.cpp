@@ -0,0 +1,249 @@
+// Benchmark of NmsEngine on synthetic crowded scenes.
+//
+//   ./bench-nms [iterations] [candidates]
+//
+// Candidates are clustered around a few hundred objects with jittered boxes
+// and coarsely quantized scores, so there are many overlaps and many equal
+// scores (the worst case for the old recursive quicksort). Each mode is
+// compared with a textbook O(n^2) greedy NMS over a fully sorted list, and
+// the previous quicksort + per-class NMS is timed for reference.
+// Exits non-zero if the engine keeps different boxes than the reference.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "yolov5/nms.h"
+#include "yolov5/postprocess.h"
+
+static double __get_us(struct timeval t) { return (t.tv_sec * 1000000 + t.tv_usec); }
+
+typedef struct _Candidates
+{
+    std::vector<float> boxes; // x, y, w, h
+    std::vector<float> scores;
+    std::vector<int> classes;
+} Candidates;
+
+static float frand(unsigned *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return ((*seed >> 8) & 0xffff) / 65535.0f;
+}
+
+static void make_crowd(Candidates *c, int n, unsigned seed)
+{
+    int objects = std::max(1, n / 20);
+    c->boxes.resize(n * 4);
+    c->scores.resize(n);
+    c->classes.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        unsigned object_seed = 1000 + (i % objects);
+        float cx = frand(&object_seed) * 600.0f, cy = frand(&object_seed) * 600.0f;
+        float w = 20.0f + frand(&object_seed) * 100.0f, h = 20.0f + frand(&object_seed) * 100.0f;
+        int cls = (int)(frand(&object_seed) * 8); // a crowd of few classes
+        c->boxes[i * 4 + 0] = cx + (frand(&seed) - 0.5f) * 12.0f;
+        c->boxes[i * 4 + 1] = cy + (frand(&seed) - 0.5f) * 12.0f;
+        c->boxes[i * 4 + 2] = w * (0.9f + frand(&seed) * 0.2f);
+        c->boxes[i * 4 + 3] = h * (0.9f + frand(&seed) * 0.2f);
+        c->scores[i] = (int)(frand(&seed) * 16) / 16.0f + 0.05f; // int8 outputs give few distinct scores
+        c->classes[i] = frand(&seed) < 0.9f ? cls : (int)(frand(&seed) * OBJ_CLASS_NUM);
+    }
+}
+
+static float overlap(const float *a, const float *b)
+{
+    float w = std::max(0.f, std::min(a[0] + a[2], b[0] + b[2]) - std::max(a[0], b[0]) + 1.0f);
+    float h = std::max(0.f, std::min(a[1] + a[3], b[1] + b[3]) - std::max(a[1], b[1]) + 1.0f);
+    float i = w * h;
+    float u = (a[2] + 1.0f) * (a[3] + 1.0f) + (b[2] + 1.0f) * (b[3] + 1.0f) - i;
+    return u <= 0.f ? 0.f : i / u;
+}
+
+// Textbook greedy NMS: full stable sort, then every kept box suppresses the
+// lower-scored boxes it overlaps
+static int reference_nms(const Candidates *c, NmsMode mode, int max_keep, int *keep)
+{
+    int n = c->scores.size();
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [c](int a, int b) { return c->scores[a] > c->scores[b]; });
+    std::vector<bool> removed(n, false);
+    int kept = 0;
+    for (int i = 0; i < n && kept < max_keep; i++)
+    {
+        if (removed[i])
+        {
+            continue;
+        }
+        int a = order[i];
+        keep[kept++] = a;
+        for (int j = i + 1; j < n; j++)
+        {
+            int b = order[j];
+            if (!removed[j] && (mode == NMS_CLASS_AGNOSTIC || c->classes[a] == c->classes[b]) &&
+                overlap(&c->boxes[a * 4], &c->boxes[b * 4]) > NMS_THRESH)
+            {
+                removed[j] = true;
+            }
+        }
+    }
+    return kept;
+}
+
+// The previous implementation, kept verbatim (including the class id indexing)
+static int legacy_quick_sort(std::vector<float> &input, int left, int right, std::vector<int> &indices)
+{
+    float key;
+    int key_index;
+    int low = left;
+    int high = right;
+    if (left < right)
+    {
+        key_index = indices[left];
+        key = input[left];
+        while (low < high)
+        {
+            while (low < high && input[high] <= key)
+            {
+                high--;
+            }
+            input[low] = input[high];
+            indices[low] = indices[high];
+            while (low < high && input[low] >= key)
+            {
+                low++;
+            }
+            input[high] = input[low];
+            indices[high] = indices[low];
+        }
+        input[low] = key;
+        indices[low] = key_index;
+        legacy_quick_sort(input, left, low - 1, indices);
+        legacy_quick_sort(input, low + 1, right, indices);
+    }
+    return low;
+}
+
+static void legacy_nms(const Candidates *c)
+{
+    int n = c->scores.size();
+    std::vector<float> scores = c->scores;
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+    legacy_quick_sort(scores, 0, n - 1, order);
+    bool present[OBJ_CLASS_NUM] = {false};
+    for (int i = 0; i < n; i++)
+    {
+        present[c->classes[i]] = true;
+    }
+    for (int filter = 0; filter < OBJ_CLASS_NUM; filter++)
+    {
+        if (!present[filter])
+        {
+            continue;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            if (order[i] == -1 || c->classes[i] != filter)
+            {
+                continue;
+            }
+            for (int j = i + 1; j < n; ++j)
+            {
+                if (order[j] == -1 || c->classes[i] != filter)
+                {
+                    continue;
+                }
+                if (overlap(&c->boxes[order[i] * 4], &c->boxes[order[j] * 4]) > NMS_THRESH)
+                {
+                    order[j] = -1;
+                }
+            }
+        }
+    }
+}
+
+static int bench(int n, int iterations)
+{
+    Candidates c;
+    make_crowd(&c, n, n);
+    NmsEngine engine;
+    engine.reserve(n, OBJ_CLASS_NUM, OBJ_NUMB_MAX_SIZE);
+    int keep[OBJ_NUMB_MAX_SIZE];
+    int expected[OBJ_NUMB_MAX_SIZE];
+    int failures = 0;
+    struct timeval start_time, stop_time;
+
+    printf("%d candidates\n", n);
+    static const NmsMode modes[] = {NMS_CLASS_AWARE, NMS_CLASS_AGNOSTIC};
+    static const char *names[] = {"class-aware", "class-agnostic"};
+    for (int m = 0; m < 2; m++)
+    {
+        int kept = 0;
+        gettimeofday(&start_time, NULL);
+        for (int it = 0; it < iterations; it++)
+        {
+            engine.clear();
+            for (int i = 0; i < n; i++)
+            {
+                engine.add(c.boxes[i * 4], c.boxes[i * 4 + 1], c.boxes[i * 4 + 2], c.boxes[i * 4 + 3], c.scores[i],
+                           c.classes[i]);
+            }
+            kept = engine.run(NMS_THRESH, modes[m], OBJ_NUMB_MAX_SIZE, keep);
+        }
+        gettimeofday(&stop_time, NULL);
+        double engine_ms = (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+
+        gettimeofday(&start_time, NULL);
+        int expected_count = reference_nms(&c, modes[m], OBJ_NUMB_MAX_SIZE, expected);
+        gettimeofday(&stop_time, NULL);
+        double reference_ms = (__get_us(stop_time) - __get_us(start_time)) / 1000.0;
+
+        bool same = kept == expected_count && memcmp(keep, expected, kept * sizeof(int)) == 0;
+        printf("  %-15s engine %8.3f ms  reference %9.3f ms  kept %d  %s\n", names[m], engine_ms, reference_ms, kept,
+               same ? "match" : "MISMATCH");
+        if (!same)
+        {
+            failures++;
+        }
+    }
+
+    gettimeofday(&start_time, NULL);
+    legacy_nms(&c);
+    gettimeofday(&stop_time, NULL);
+    printf("  %-15s %9.3f ms\n", "previous nms", (__get_us(stop_time) - __get_us(start_time)) / 1000.0);
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    int candidates = argc > 2 ? atoi(argv[2]) : 0;
+    if (iterations <= 0 || candidates < 0)
+    {
+        fprintf(stderr, "usage: %s [iterations] [candidates]\n", argv[0]);
+        return 1;
+    }
+    int failures = 0;
+    if (candidates > 0)
+    {
+        failures += bench(candidates, iterations);
+    }
+    else
+    {
+        failures += bench(5000, iterations);
+        failures += bench(20000, iterations);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,339 @@
+// Benchmark of the overlay kernels on frames with many detections.
+//
+//   ./bench-overlay [iterations] [boxes] [width] [height]
+//
+// Draws `boxes` outlined boxes with label bars and blended text (synthetic
+// glyph masks, no font needed), some of them past the frame edges, on every
+// pixel format. Each instruction set is timed and compared byte for byte with
+// the scalar kernels, next to a per-pixel loop like the one the overlay
+// used to have on packed frames, and next to the NV12 to RGB conversion that
+// drawing on NV12/NV16 saves. Rows are padded and guarded, so a write outside
+// the frame is caught. Exits non-zero on any mismatch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include "overlay/overlay.h"
+#include "preprocess/cpu_kernels.h"
+
+#define BENCH_LABEL_WIDTH 96
+#define BENCH_LABEL_HEIGHT 28
+#define BENCH_LABEL_ASCENT 22
+#define BENCH_THICKNESS 2
+#define BENCH_GUARD 64
+#define BENCH_GUARD_VALUE 0xa5
+
+typedef struct _BenchBox
+{
+    int left;
+    int top;
+    int right;
+    int bottom;
+    int class_id;
+} BenchBox;
+
+static double __get_us(struct timeval t) { return (t.tv_sec * 1000000 + t.tv_usec); }
+
+static unsigned next_random(unsigned *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+// Boxes of 2% to 30% of the frame, a few crossing each edge
+static std::vector<BenchBox> make_boxes(int count, int width, int height)
+{
+    unsigned seed = 7;
+    std::vector<BenchBox> boxes(count);
+    for (int i = 0; i < count; i++)
+    {
+        int w = width / 50 + next_random(&seed) % (width * 3 / 10);
+        int h = height / 50 + next_random(&seed) % (height * 3 / 10);
+        boxes[i].left = (int)(next_random(&seed) % (width + w)) - w / 2;
+        boxes[i].top = (int)(next_random(&seed) % (height + h)) - h / 2;
+        boxes[i].right = boxes[i].left + w;
+        boxes[i].bottom = boxes[i].top + h;
+        boxes[i].class_id = next_random(&seed) % 80;
+    }
+    return boxes;
+}
+
+// Glyph-like coverage: mostly empty, solid strokes with anti-aliased edges
+static std::vector<uint8_t> make_label()
+{
+    std::vector<uint8_t> mask(BENCH_LABEL_WIDTH * BENCH_LABEL_HEIGHT, 0);
+    for (int y = 4; y < BENCH_LABEL_ASCENT; y++)
+    {
+        for (int x = 2; x < BENCH_LABEL_WIDTH - 2; x++)
+        {
+            int phase = x % 12;
+            mask[y * BENCH_LABEL_WIDTH + x] = phase < 2 ? 255 : (phase == 2 ? 128 : (phase == 3 ? 40 : 0));
+        }
+    }
+    return mask;
+}
+
+static bool semi_planar(OverlayPixelFormat format)
+{
+    return format == OVERLAY_PIXEL_NV12 || format == OVERLAY_PIXEL_NV16;
+}
+
+// Bytes per pixel of a packed format, of the Y plane for NV12/NV16
+static int bytes_per_pixel(OverlayPixelFormat format)
+{
+    return format == OVERLAY_PIXEL_RGB ? 3 : (semi_planar(format) ? 1 : 4);
+}
+
+static int chroma_rows(OverlayPixelFormat format, int height)
+{
+    return format == OVERLAY_PIXEL_NV12 ? (height + 1) / 2 : (format == OVERLAY_PIXEL_NV16 ? height : 0);
+}
+
+static void put_pixel(const OverlayFrame *frame, int x, int y, OverlayColor color)
+{
+    if (x >= 0 && y >= 0 && x < frame->width && y < frame->height)
+    {
+        uint8_t *p = frame->data + (size_t)y * frame->stride + x * bytes_per_pixel(frame->format);
+        p[0] = color.b;
+        p[1] = color.g;
+        p[2] = color.r;
+    }
+}
+
+// What the overlay did before: a pixel at a time, text overwriting the frame
+static void draw_per_pixel(const OverlayFrame *frame, const BenchBox *box, const LabelMask *label)
+{
+    int bpp = bytes_per_pixel(frame->format);
+    OverlayColor color = overlay_class_color(box->class_id);
+    for (int t = 0; t < BENCH_THICKNESS; t++)
+    {
+        for (int x = box->left; x < box->right; x++)
+        {
+            put_pixel(frame, x, box->top + t, color);
+            put_pixel(frame, x, box->bottom - 1 - t, color);
+        }
+        for (int y = box->top; y < box->bottom; y++)
+        {
+            put_pixel(frame, box->left + t, y, color);
+            put_pixel(frame, box->right - 1 - t, y, color);
+        }
+    }
+    int top = box->top - label->ascent;
+    for (int row = 0; row < label->height; row++)
+    {
+        for (int col = 0; col < label->width; col++)
+        {
+            int x = box->left + col;
+            int y = top + row;
+            if (x >= 0 && y >= 0 && x < frame->width && y < frame->height)
+            {
+                uint8_t *p = frame->data + (size_t)y * frame->stride + x * bpp;
+                p[0] = p[1] = p[2] = label->alpha[row * label->width + col];
+            }
+        }
+    }
+}
+
+static void draw_frame(const OverlayFrame *frame, const std::vector<BenchBox> &boxes, const LabelMask *label,
+                       const OverlayKernels *kernels)
+{
+    const OverlayColor white = {255, 255, 255};
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        const BenchBox &b = boxes[i];
+        if (kernels == NULL)
+        {
+            draw_per_pixel(frame, &b, label);
+            continue;
+        }
+        OverlayColor color = overlay_class_color(b.class_id);
+        overlay_draw_box(frame, b.left, b.top, b.right, b.bottom, BENCH_THICKNESS, color, kernels);
+        overlay_draw_label(frame, label, b.left, b.top, color, white, kernels);
+    }
+}
+
+// A frame padded by BENCH_GUARD bytes per row and around the buffer, the
+// UV plane right after the Y plane
+typedef struct _BenchFrame
+{
+    std::vector<uint8_t> buffer;
+    OverlayFrame frame;
+} BenchFrame;
+
+static void fill_plane(uint8_t *plane, int stride, int row_bytes, int rows)
+{
+    for (int y = 0; y < rows; y++)
+    {
+        for (int x = 0; x < row_bytes; x++)
+        {
+            plane[(size_t)y * stride + x] = (uint8_t)(x * 7 + y * 3);
+        }
+    }
+}
+
+static bool pads_intact(const uint8_t *plane, int stride, int row_bytes, int rows)
+{
+    for (int y = 0; y < rows; y++)
+    {
+        for (int i = row_bytes; i < stride; i++)
+        {
+            if (plane[(size_t)y * stride + i] != BENCH_GUARD_VALUE)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void reset_frame(BenchFrame *f, OverlayPixelFormat format, int width, int height)
+{
+    int row_bytes = width * bytes_per_pixel(format);
+    int uv_row_bytes = (width + 1) / 2 * 2;
+    int stride = row_bytes + BENCH_GUARD;
+    int uv_stride = uv_row_bytes + BENCH_GUARD;
+    int uv_rows = chroma_rows(format, height);
+    f->buffer.assign((size_t)stride * height + (size_t)uv_stride * uv_rows + 2 * BENCH_GUARD, BENCH_GUARD_VALUE);
+    memset(&f->frame, 0, sizeof(f->frame));
+    f->frame.format = format;
+    f->frame.width = width;
+    f->frame.height = height;
+    f->frame.stride = stride;
+    f->frame.data = f->buffer.data() + BENCH_GUARD;
+    fill_plane(f->frame.data, stride, row_bytes, height);
+    if (uv_rows > 0)
+    {
+        f->frame.uv_stride = uv_stride;
+        f->frame.uv = f->frame.data + (size_t)stride * height;
+        fill_plane(f->frame.uv, uv_stride, uv_row_bytes, uv_rows);
+    }
+}
+
+static bool guards_intact(const BenchFrame *f)
+{
+    const uint8_t *base = f->buffer.data();
+    for (int i = 0; i < BENCH_GUARD; i++)
+    {
+        if (base[i] != BENCH_GUARD_VALUE || base[f->buffer.size() - 1 - i] != BENCH_GUARD_VALUE)
+        {
+            return false;
+        }
+    }
+    const OverlayFrame *frame = &f->frame;
+    return pads_intact(frame->data, frame->stride, frame->width * bytes_per_pixel(frame->format), frame->height) &&
+           (frame->uv == NULL || pads_intact(frame->uv, frame->uv_stride, (frame->width + 1) / 2 * 2,
+                                             chroma_rows(frame->format, frame->height)));
+}
+
+// What the display path did before drawing: a full-frame conversion to RGB.
+// The SIMD preprocessor kernels stand in for videoconvert, which is slower.
+static double time_conversion(int width, int height, int iterations)
+{
+    BenchFrame nv12;
+    reset_frame(&nv12, OVERLAY_PIXEL_NV12, width, height);
+    std::vector<uint8_t> rgb((size_t)width * 3);
+    const CpuKernels *kernels = cpu_kernels_best();
+    struct timeval start_time, stop_time;
+    gettimeofday(&start_time, NULL);
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            kernels->nv12_row_to_rgb(nv12.frame.data + (size_t)y * nv12.frame.stride,
+                                     nv12.frame.uv + (size_t)(y / 2) * nv12.frame.uv_stride, rgb.data(), width);
+        }
+    }
+    gettimeofday(&stop_time, NULL);
+    return (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+}
+
+static double time_frame(BenchFrame *f, const std::vector<BenchBox> &boxes, const LabelMask *label,
+                         const OverlayKernels *kernels, int iterations)
+{
+    struct timeval start_time, stop_time;
+    gettimeofday(&start_time, NULL);
+    for (int i = 0; i < iterations; i++)
+    {
+        draw_frame(&f->frame, boxes, label, kernels);
+    }
+    gettimeofday(&stop_time, NULL);
+    return (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+}
+
+static int bench_format(const char *name, OverlayPixelFormat format, int width, int height,
+                        const std::vector<BenchBox> &boxes, const LabelMask *label, int iterations)
+{
+    static const CpuIsa isas[] = {CPU_ISA_SCALAR, CPU_ISA_SSE41, CPU_ISA_AVX2, CPU_ISA_NEON};
+    int failures = 0;
+    printf("%s %dx%d, %zu boxes\n", name, width, height, boxes.size());
+
+    double legacy_ms;
+    if (semi_planar(format))
+    {
+        legacy_ms = time_conversion(width, height, iterations);
+        printf("  %-10s %8.3f ms  (%s, saved by drawing on the YUV frame)\n", "nv12->rgb", legacy_ms,
+               cpu_kernels_best()->name);
+    }
+    else
+    {
+        BenchFrame legacy;
+        reset_frame(&legacy, format, width, height);
+        legacy_ms = time_frame(&legacy, boxes, label, NULL, iterations);
+        printf("  %-10s %8.3f ms\n", "per-pixel", legacy_ms);
+    }
+
+    // one pass from the same start for the comparison, then the timing
+    BenchFrame reference;
+    reset_frame(&reference, format, width, height);
+    draw_frame(&reference.frame, boxes, label, overlay_kernels_get(CPU_ISA_SCALAR));
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+    {
+        const OverlayKernels *kernels = overlay_kernels_get(isas[i]);
+        if (kernels == NULL)
+        {
+            continue;
+        }
+        BenchFrame output;
+        reset_frame(&output, format, width, height);
+        draw_frame(&output.frame, boxes, label, kernels);
+        bool exact = output.buffer == reference.buffer;
+        bool guarded = guards_intact(&output);
+        double ms = time_frame(&output, boxes, label, kernels, iterations);
+        printf("  %-10s %8.3f ms  x%.2f  %s%s\n", kernels->name, ms, legacy_ms / ms, exact ? "exact" : "MISMATCH",
+               guarded ? "" : "  OUT OF BOUNDS");
+        if (!exact || !guarded)
+        {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    int count = argc > 2 ? atoi(argv[2]) : 64;
+    int width = argc > 3 ? atoi(argv[3]) : 720;
+    int height = argc > 4 ? atoi(argv[4]) : 1280;
+    if (iterations <= 0 || count <= 0 || width <= 0 || height <= 0)
+    {
+        fprintf(stderr, "usage: %s [iterations] [boxes] [width] [height]\n", argv[0]);
+        return 1;
+    }
+    printf("best kernels: %s\n", overlay_kernels_best()->name);
+
+    std::vector<BenchBox> boxes = make_boxes(count, width, height);
+    std::vector<uint8_t> alpha = make_label();
+    LabelMask label = {BENCH_LABEL_WIDTH, BENCH_LABEL_HEIGHT, BENCH_LABEL_ASCENT, alpha.data()};
+
+    int failures = bench_format("BGRA", OVERLAY_PIXEL_BGRA, width, height, boxes, &label, iterations);
+    failures += bench_format("BGRx", OVERLAY_PIXEL_BGRX, width, height, boxes, &label, iterations);
+    failures += bench_format("RGBA", OVERLAY_PIXEL_RGBA, width, height, boxes, &label, iterations);
+    failures += bench_format("RGB", OVERLAY_PIXEL_RGB, width, height, boxes, &label, iterations);
+    failures += bench_format("NV12", OVERLAY_PIXEL_NV12, width, height, boxes, &label, iterations);
+    failures += bench_format("NV16", OVERLAY_PIXEL_NV16, width, height, boxes, &label, iterations);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+// Benchmark of the YOLOv5 post-processing on synthetic int8 outputs.
+//
+//   ./bench-postprocess [iterations] [objects] [threads]
+//
+// The three output heads of a 640x640 model are filled with `objects`
+// random detections (each spread over a few neighbouring cells, like real
+// outputs) on top of background noise. Post-processing is timed serially and
+// then with the parallel decoder on `threads` threads (4 by default); both
+// must report the same detections. Besides timing, every heap allocation
+// made while decoding in steady state is counted; the run fails if any
+// happens, since post_process() is meant to reuse its workspace.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include "yolov5/postprocess.h"
+
+#define BENCH_MODEL_SIZE 640
+#define BENCH_ZP -128
+#define BENCH_SCALE (1.0f / 255.0f)
+
+static std::atomic<long> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations++;
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+static double __get_us(struct timeval t) { return (t.tv_sec * 1000000 + t.tv_usec); }
+
+static int8_t quantize(float value)
+{
+    int q = (int)(value / BENCH_SCALE + 0.5f) + BENCH_ZP;
+    return (int8_t)(q < -128 ? -128 : (q > 127 ? 127 : q));
+}
+
+// One head laid out as the model emits it: [3 * (5 + classes)][grid_h][grid_w]
+static void fill_head(std::vector<int8_t> &head, int grid, int objects, unsigned *seed)
+{
+    int grid_len = grid * grid;
+    for (size_t i = 0; i < head.size(); i++)
+    {
+        *seed = *seed * 1103515245 + 12345;
+        head[i] = quantize(((*seed >> 16) % 40) / 255.0f); // low scores everywhere
+    }
+    for (int n = 0; n < objects; n++)
+    {
+        *seed = *seed * 1103515245 + 12345;
+        int a = (*seed >> 8) % 3;
+        int cell = (*seed >> 12) % grid_len;
+        int cls = (*seed >> 4) % OBJ_CLASS_NUM;
+        // the same object usually fires on a small cluster of cells
+        for (int d = 0; d < 3 && cell + d < grid_len; d++)
+        {
+            int8_t *base = head.data() + (PROP_BOX_SIZE * a) * grid_len + cell + d;
+            base[0 * grid_len] = quantize(0.5f);
+            base[1 * grid_len] = quantize(0.5f);
+            base[2 * grid_len] = quantize(0.6f + 0.05f * d);
+            base[3 * grid_len] = quantize(0.6f);
+            base[4 * grid_len] = quantize(0.9f - 0.1f * d);
+            base[(5 + cls) * grid_len] = quantize(0.8f);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    int objects = argc > 2 ? atoi(argv[2]) : 50;
+    int threads = argc > 3 ? atoi(argv[3]) : 4;
+    if (iterations <= 0 || objects < 0 || threads < 1)
+    {
+        fprintf(stderr, "usage: %s [iterations] [objects] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<int8_t> heads[POST_PROCESS_OUTPUTS];
+    unsigned seed = 1;
+    for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+    {
+        int grid = BENCH_MODEL_SIZE / (8 << i);
+        heads[i].resize((size_t)3 * PROP_BOX_SIZE * grid * grid);
+        fill_head(heads[i], grid, objects / POST_PROCESS_OUTPUTS + (i < objects % POST_PROCESS_OUTPUTS), &seed);
+    }
+
+    PostProcessWorkspace workspace;
+    for (int i = 0; i < POST_PROCESS_OUTPUTS; i++)
+    {
+        workspace.set_quant(i, BENCH_ZP, BENCH_SCALE);
+    }
+    detect_result_group_t group, serial_group;
+    int failures = 0;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int n_threads = pass == 0 ? 1 : threads;
+        workspace.set_decode_threads(n_threads);
+
+        // The first frame loads the labels and sizes the workspace
+        post_process(heads[0].data(), heads[1].data(), heads[2].data(), BENCH_MODEL_SIZE, BENCH_MODEL_SIZE,
+                     BOX_THRESH, NMS_THRESH, 1.0f, 1.0f, &workspace, &group);
+
+        long allocations_before = g_allocations.load();
+        struct timeval start_time, stop_time;
+        gettimeofday(&start_time, NULL);
+        for (int i = 0; i < iterations; i++)
+        {
+            post_process(heads[0].data(), heads[1].data(), heads[2].data(), BENCH_MODEL_SIZE, BENCH_MODEL_SIZE,
+                         BOX_THRESH, NMS_THRESH, 1.0f, 1.0f, &workspace, &group);
+        }
+        gettimeofday(&stop_time, NULL);
+        long allocations = g_allocations.load() - allocations_before;
+
+        if (pass == 0)
+        {
+            serial_group = group;
+        }
+        bool same = memcmp(&group, &serial_group, sizeof(group)) == 0;
+        printf("post_process (%d thread%s%s): %d objects, %d detections kept, %.3f ms/frame, %ld allocations in %d "
+               "frames%s\n",
+               n_threads, n_threads > 1 ? "s" : "", workspace.parallel() ? ", parallel" : "", objects, group.count,
+               (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations, allocations, iterations,
+               same ? "" : "  MISMATCH");
+        if (allocations != 0 || !same)
+        {
+            failures++;
+        }
+    }
+    deinitPostProcess();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+// Benchmark of the CPU preprocessing kernels against the scalar reference.
+//
+//   ./bench-preprocess [iterations] [src_width] [src_height]
+//
+// Every available instruction set is timed on synthetic NV12 and BGRA frames
+// resized to the model input, and its output is compared byte for byte with
+// the scalar kernels. Exits non-zero on any mismatch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include "preprocess/cpu_kernels.h"
+
+#define BENCH_DST_WIDTH 640
+#define BENCH_DST_HEIGHT 640
+
+static double __get_us(struct timeval t) { return (t.tv_sec * 1000000 + t.tv_usec); }
+
+static void fill_pattern(std::vector<uint8_t> &buf, unsigned seed)
+{
+    // Smooth gradient plus noise, so both flat areas and edges are exercised
+    for (size_t i = 0; i < buf.size(); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t)((i * 7 / 5) + ((seed >> 16) & 0x3f));
+    }
+}
+
+static double time_resize(const CpuImage *image, uint8_t *dst, const CpuKernels *kernels, int iterations)
+{
+    struct timeval start_time, stop_time;
+    cpu_resize_to_rgb(image, dst, BENCH_DST_WIDTH, BENCH_DST_HEIGHT, BENCH_DST_WIDTH, kernels); // warm up scratch
+    gettimeofday(&start_time, NULL);
+    for (int i = 0; i < iterations; i++)
+    {
+        cpu_resize_to_rgb(image, dst, BENCH_DST_WIDTH, BENCH_DST_HEIGHT, BENCH_DST_WIDTH, kernels);
+    }
+    gettimeofday(&stop_time, NULL);
+    return (__get_us(stop_time) - __get_us(start_time)) / 1000.0 / iterations;
+}
+
+static int bench_image(const char *label, const CpuImage *image, int iterations)
+{
+    static const CpuIsa isas[] = {CPU_ISA_SCALAR, CPU_ISA_SSE41, CPU_ISA_AVX2, CPU_ISA_NEON};
+    size_t dst_size = (size_t)BENCH_DST_WIDTH * BENCH_DST_HEIGHT * 3;
+    std::vector<uint8_t> reference(dst_size);
+    std::vector<uint8_t> output(dst_size);
+    int failures = 0;
+
+    double reference_ms = time_resize(image, reference.data(), cpu_kernels_get(CPU_ISA_SCALAR), iterations);
+    printf("%s %dx%d -> %dx%d\n", label, image->width, image->height, BENCH_DST_WIDTH, BENCH_DST_HEIGHT);
+    printf("  %-8s %8.3f ms\n", "scalar", reference_ms);
+    for (size_t i = 1; i < sizeof(isas) / sizeof(isas[0]); i++)
+    {
+        const CpuKernels *kernels = cpu_kernels_get(isas[i]);
+        if (kernels == NULL)
+        {
+            continue;
+        }
+        memset(output.data(), 0, dst_size);
+        double ms = time_resize(image, output.data(), kernels, iterations);
+        bool exact = memcmp(output.data(), reference.data(), dst_size) == 0;
+        printf("  %-8s %8.3f ms  x%.2f  %s\n", kernels->name, ms, reference_ms / ms, exact ? "exact" : "MISMATCH");
+        if (!exact)
+        {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 50;
+    int width = argc > 2 ? atoi(argv[2]) : 1920;
+    int height = argc > 3 ? atoi(argv[3]) : 1080;
+    if (iterations <= 0 || width <= 0 || height <= 0)
+    {
+        fprintf(stderr, "usage: %s [iterations] [src_width] [src_height]\n", argv[0]);
+        return 1;
+    }
+    printf("best kernels: %s\n", cpu_kernels_best()->name);
+
+    // Pad rows like the decoder does, so strides are exercised too
+    int luma_stride = (width + 15) & ~15;
+    std::vector<uint8_t> nv12((size_t)luma_stride * height + (size_t)luma_stride * ((height + 1) / 2));
+    fill_pattern(nv12, 1);
+    CpuImage nv12_image;
+    memset(&nv12_image, 0, sizeof(nv12_image));
+    nv12_image.format = CPU_PIXEL_NV12;
+    nv12_image.width = width;
+    nv12_image.height = height;
+    nv12_image.plane[0] = nv12.data();
+    nv12_image.plane[1] = nv12.data() + (size_t)luma_stride * height;
+    nv12_image.stride[0] = luma_stride;
+    nv12_image.stride[1] = luma_stride;
+
+    std::vector<uint8_t> bgra((size_t)width * 4 * height);
+    fill_pattern(bgra, 2);
+    CpuImage bgra_image;
+    memset(&bgra_image, 0, sizeof(bgra_image));
+    bgra_image.format = CPU_PIXEL_BGRA;
+    bgra_image.width = width;
+    bgra_image.height = height;
+    bgra_image.plane[0] = bgra.data();
+    bgra_image.stride[0] = width * 4;
+
+    int failures = bench_image("NV12", &nv12_image, iterations);
+    failures += bench_image("BGRA", &bgra_image, iterations);
+    return failures == 0 ? 0 : 1;
+}
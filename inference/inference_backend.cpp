@@ -0,0 +1,9 @@
+#include "inference/inference_backend.h"
+
+#include <string.h>
+
+InferenceBackend::InferenceBackend() : n_workers_(1), pipeline_depth_(1) { memset(&model_, 0, sizeof(model_)); }
+
+size_t InferenceBackend::input_size() const { return (size_t)model_.input_w * model_.input_h * INFERENCE_CHANNEL; }
+
+int InferenceBackend::input_wstride() const { return model_.input_w; }
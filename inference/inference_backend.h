@@ -0,0 +1,92 @@
+#ifndef _INFERENCE_BACKEND_H_
+#define _INFERENCE_BACKEND_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "analytics/analytics_stage.h"
+#include "yolov5/yolo_model.h"
+
+// Frames kept in flight per worker when pipelined
+#define INFERENCE_PIPELINE_DEPTH 2
+#define INFERENCE_MAX_WORKERS ANALYTICS_MAX_WORKERS
+#define INFERENCE_CHANNEL 3
+// Workers in throughput mode when RKNN_CONTEXTS is not set, one per RK3588 NPU core
+#define INFERENCE_DEFAULT_CONTEXTS 3
+
+// How gst-test wants inference to run, read from the environment
+typedef struct _InferenceOptions
+{
+    const char *model_path;   // .rknn file
+    bool pipelined;           // keep INFERENCE_PIPELINE_DEPTH frames in flight per worker
+    bool zero_copy;           // inputs and outputs in device memory, bound once
+    bool native_outputs;      // zero-copy outputs in the NPU's NC1HWC2 layout
+    const char *core_mode;    // NULL/"auto", "throughput" (a worker per core) or "latency"
+    int contexts;             // workers in throughput mode
+    const char *replay_dir;   // replay backend: recordings from RKNN_DUMP_OUTPUTS
+    int replay_latency_us;    // replay backend: time a frame spends "on the NPU"
+    int replay_jitter_us;     // replay backend: +- uniform noise on that time
+    bool share_internal_mem;  // rknn backend: contexts on a core share one internal buffer, taking turns
+    int profile_interval;     // rknn backend: sample NPU timings of one frame in N, 0 = off
+    const char *profile_path; // rknn backend: where the profiling report goes
+} InferenceOptions;
+
+// Outputs of the oldest frame a worker started, valid until release()
+typedef struct _InferenceResult
+{
+    AnalyticsFrame *frame;
+    struct timeval start_time;     // when run() took the frame
+    void *outputs[YOLO_MAX_HEADS]; // head i of model(), in its type and layout
+} InferenceResult;
+
+// Where the model runs. gst-test drives it from the analytics workers: run()
+// starts a frame, wait() returns the outputs of the oldest frame that worker
+// started, release() hands the output buffers back. Calls for a worker come
+// from that worker's thread only, so per-worker state needs no locking. With
+// a pipeline depth of N, up to N frames are started before the oldest one is
+// waited for, so run() must not block on the result.
+class InferenceBackend
+{
+public:
+    InferenceBackend();
+    virtual ~InferenceBackend() {}
+
+    virtual const char *name() const = 0;
+
+    // Loads the model and fills model(), workers() and pipeline_depth()
+    virtual int init(const InferenceOptions &options) = 0;
+
+    const YoloModel &model() const { return model_; }
+    int workers() const { return n_workers_; }
+    int pipeline_depth() const { return pipeline_depth_; }
+
+    // One RGB888 input slot: its size and its row stride in pixels
+    virtual size_t input_size() const;
+    virtual int input_wstride() const;
+
+    // Input slots in device memory, so preprocessing writes straight into
+    // the tensor; without them AnalyticsStage mallocs the slots
+    virtual bool device_inputs() const { return false; }
+    virtual int alloc_input(AnalyticsFrame *frame, size_t size) { return -1; }
+    virtual void free_input(AnalyticsFrame *frame) {}
+
+    virtual int run(int worker, AnalyticsFrame *frame) = 0;
+    // Always sets result->frame when a frame was in flight, even on failure;
+    // release() is only due after a success
+    virtual int wait(int worker, InferenceResult *result) = 0;
+    virtual void release(int worker) {}
+
+protected:
+    YoloModel model_;
+    int n_workers_;
+    int pipeline_depth_;
+};
+
+// The RK3588 NPU through librknnrt, only in builds with it
+InferenceBackend *rknn_backend_create();
+// Recorded outputs (model.txt + frameNNN_outK.bin) returned in a loop with
+// a simulated NPU latency, for pipeline work without an NPU
+InferenceBackend *replay_backend_create();
+
+#endif //_INFERENCE_BACKEND_H_
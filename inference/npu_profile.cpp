@@ -0,0 +1,323 @@
+#include "inference/npu_profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#define NPU_PROFILE_MAX_COLUMNS 32
+
+static void add_time(NpuTimeStats *stats, int64_t us)
+{
+    if (stats->samples == 0 || us < stats->min_us)
+    {
+        stats->min_us = us;
+    }
+    if (stats->samples == 0 || us > stats->max_us)
+    {
+        stats->max_us = us;
+    }
+    stats->total_us += us;
+    stats->samples++;
+}
+
+static double average(const NpuTimeStats &stats) { return stats.samples > 0 ? (double)stats.total_us / stats.samples : 0; }
+
+// Splits a table line on whitespace, at most `max` tokens
+static int split_line(const char *line, const char *end, std::string *tokens, int max)
+{
+    int count = 0;
+    const char *p = line;
+    while (p < end && count < max)
+    {
+        while (p < end && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        const char *start = p;
+        while (p < end && *p != ' ' && *p != '\t')
+        {
+            p++;
+        }
+        if (p > start)
+        {
+            tokens[count++].assign(start, p - start);
+        }
+    }
+    return count;
+}
+
+NpuProfile::NpuProfile() : interval_(0), n_contexts_(0), memory_stride_(1), detail_samples_(0)
+{
+    memset(frames_, 0, sizeof(frames_));
+    memset(memory_, 0, sizeof(memory_));
+    memset(has_memory_, 0, sizeof(has_memory_));
+    memset(memory_count_, 0, sizeof(memory_count_));
+    memset(run_, 0, sizeof(run_));
+    memset(frame_, 0, sizeof(frame_));
+}
+
+bool NpuProfile::due(int context)
+{
+    if (interval_ == 0 || context < 0 || context >= NPU_PROFILE_MAX_CONTEXTS)
+    {
+        return false;
+    }
+    return frames_[context]++ % interval_ == 0;
+}
+
+void NpuProfile::set_memory(int context, const NpuMemoryUsage &usage)
+{
+    if (context < 0 || context >= NPU_PROFILE_MAX_CONTEXTS)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_[context] = usage;
+    has_memory_[context] = true;
+    n_contexts_ = std::max(n_contexts_, context + 1);
+}
+
+void NpuProfile::add_memory_sample(int context, const NpuMemoryUsage &usage)
+{
+    if (context < 0 || context >= NPU_PROFILE_MAX_CONTEXTS || interval_ == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    n_contexts_ = std::max(n_contexts_, context + 1);
+    // due() samples frames 0, interval, 2 * interval, ... of each context
+    int frame = memory_count_[context]++ * interval_;
+    if (frame / interval_ % memory_stride_ != 0)
+    {
+        return;
+    }
+    if (memory_samples_.size() == NPU_PROFILE_MAX_MEMORY_SAMPLES)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < memory_samples_.size(); i++)
+        {
+            if (memory_samples_[i].frame / interval_ % (2 * memory_stride_) == 0)
+            {
+                memory_samples_[kept++] = memory_samples_[i];
+            }
+        }
+        memory_samples_.resize(kept);
+        memory_stride_ *= 2;
+        if (frame / interval_ % memory_stride_ != 0)
+        {
+            return;
+        }
+    }
+    NpuMemorySample sample;
+    sample.context = context;
+    sample.frame = frame;
+    sample.usage = usage;
+    memory_samples_.push_back(sample);
+}
+
+// The layer table looks like
+//   ID  OpType    DataType Target InputShape  OutputShape  Cycles(DDR/NPU/Total)  Time(us)  MacUsage(%) ...  FullName
+//   1   InputOperator UINT8 CPU   \           (1,3,640,640) 0/0/0                 8                     ...  InputOperator:images
+// Cells are single tokens ("\" when empty) up to Time(us), but trailing
+// ones such as MacUsage can be blank, so the time column is found by its
+// index in the header and the name is the last token of the row.
+void NpuProfile::add_layers(const char *perf_detail, size_t length)
+{
+    std::string tokens[NPU_PROFILE_MAX_COLUMNS];
+    int id_col = -1, op_col = -1, target_col = -1, time_col = -1;
+    const char *end = perf_detail + length;
+    for (const char *line = perf_detail; line < end;)
+    {
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+        if (eol == NULL)
+        {
+            eol = end;
+        }
+        int count = split_line(line, eol, tokens, NPU_PROFILE_MAX_COLUMNS);
+        line = eol + 1;
+        if (count == 0)
+        {
+            continue;
+        }
+        if (time_col < 0)
+        {
+            if (tokens[0] != "ID")
+            {
+                continue;
+            }
+            for (int i = 0; i < count; i++)
+            {
+                if (tokens[i] == "ID")
+                {
+                    id_col = i;
+                }
+                else if (tokens[i] == "OpType")
+                {
+                    op_col = i;
+                }
+                else if (tokens[i] == "Target")
+                {
+                    target_col = i;
+                }
+                else if (tokens[i].compare(0, 8, "Time(us)") == 0)
+                {
+                    time_col = i;
+                }
+            }
+            continue;
+        }
+
+        char *parse_end;
+        long id = strtol(tokens[id_col].c_str(), &parse_end, 10);
+        if (count <= time_col || *parse_end != '\0')
+        {
+            continue; // separators, the "Total ..." lines
+        }
+        int64_t us = strtoll(tokens[time_col].c_str(), &parse_end, 10);
+        if (*parse_end != '\0')
+        {
+            continue;
+        }
+        NpuLayerStats &layer = layers_[(int)id];
+        if (layer.time.samples == 0)
+        {
+            layer.op_type = op_col >= 0 ? tokens[op_col] : "";
+            layer.target = target_col >= 0 ? tokens[target_col] : "";
+            layer.name = tokens[count - 1];
+        }
+        add_time(&layer.time, us);
+    }
+}
+
+void NpuProfile::add_sample(int context, int64_t run_us, int64_t frame_us, const char *perf_detail, size_t length)
+{
+    if (context < 0 || context >= NPU_PROFILE_MAX_CONTEXTS)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    n_contexts_ = std::max(n_contexts_, context + 1);
+    if (run_us > 0)
+    {
+        add_time(&run_[context], run_us);
+    }
+    add_time(&frame_[context], frame_us);
+    if (perf_detail != NULL && length > 0)
+    {
+        add_layers(perf_detail, length);
+        detail_samples_++;
+    }
+}
+
+int NpuProfile::samples()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int samples = 0;
+    for (int c = 0; c < n_contexts_; c++)
+    {
+        samples += frame_[c].samples;
+    }
+    return samples;
+}
+
+static void write_time(FILE *fp, const char *label, const NpuTimeStats &stats)
+{
+    fprintf(fp, "  %-10s samples %6d  avg %9.1f  min %8lld  max %8lld\n", label, stats.samples, average(stats),
+            (long long)stats.min_us, (long long)stats.max_us);
+}
+
+int NpuProfile::write(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    fprintf(fp, "# npu profile: one frame in %d sampled per context, %d with layer times\n", interval_,
+            detail_samples_);
+
+    fprintf(fp, "\n## memory per context (KB)\n");
+    fprintf(fp, "  %-10s %10s %10s %10s %10s %10s\n", "context", "weight", "internal", "dma", "sram", "sram free");
+    uint64_t total_dma = 0;
+    for (int c = 0; c < n_contexts_; c++)
+    {
+        if (!has_memory_[c])
+        {
+            continue;
+        }
+        const NpuMemoryUsage &m = memory_[c];
+        fprintf(fp, "  %-10d %10llu %10llu %10llu %10llu %10llu\n", c, (unsigned long long)m.weight_size / 1024,
+                (unsigned long long)m.internal_size / 1024, (unsigned long long)m.dma_allocated_size / 1024,
+                (unsigned long long)m.sram_size / 1024, (unsigned long long)m.sram_free_size / 1024);
+        total_dma += m.dma_allocated_size;
+    }
+    fprintf(fp, "  %-10s %32llu\n", "total", (unsigned long long)total_dma / 1024);
+
+    fprintf(fp, "\n## memory over time (KB), on sampled frames\n");
+    fprintf(fp, "  %-10s %10s %10s %10s %10s\n", "context", "frame", "internal", "dma", "sram free");
+    for (size_t i = 0; i < memory_samples_.size(); i++)
+    {
+        const NpuMemorySample &s = memory_samples_[i];
+        fprintf(fp, "  %-10d %10d %10llu %10llu %10llu\n", s.context, s.frame,
+                (unsigned long long)s.usage.internal_size / 1024, (unsigned long long)s.usage.dma_allocated_size / 1024,
+                (unsigned long long)s.usage.sram_free_size / 1024);
+    }
+
+    fprintf(fp, "\n## time per frame (us): NPU run, and run() to outputs on the worker\n");
+    for (int c = 0; c < n_contexts_; c++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "run %d", c);
+        write_time(fp, label, run_[c]);
+        snprintf(label, sizeof(label), "frame %d", c);
+        write_time(fp, label, frame_[c]);
+    }
+
+    // layers, slowest first, then the same grouped by operator type
+    std::vector<const std::pair<const int, NpuLayerStats> *> order;
+    int64_t layer_total = 0;
+    for (std::map<int, NpuLayerStats>::const_iterator it = layers_.begin(); it != layers_.end(); ++it)
+    {
+        order.push_back(&*it);
+        layer_total += it->second.time.total_us;
+    }
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<const int, NpuLayerStats> *a, const std::pair<const int, NpuLayerStats> *b) {
+                  return average(a->second.time) > average(b->second.time);
+              });
+    fprintf(fp, "\n## layers by average time (us)\n");
+    fprintf(fp, "  %4s %5s %-20s %-6s %9s %8s %8s %6s  %s\n", "rank", "id", "op", "target", "avg", "min", "max",
+            "share", "name");
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const NpuLayerStats &layer = order[i]->second;
+        double share = layer_total > 0 ? 100.0 * layer.time.total_us / layer_total : 0;
+        fprintf(fp, "  %4zu %5d %-20s %-6s %9.1f %8lld %8lld %5.1f%%  %s\n", i + 1, order[i]->first,
+                layer.op_type.c_str(), layer.target.c_str(), average(layer.time), (long long)layer.time.min_us,
+                (long long)layer.time.max_us, share, layer.name.c_str());
+    }
+
+    std::map<std::string, NpuTimeStats> by_op;
+    for (std::map<int, NpuLayerStats>::const_iterator it = layers_.begin(); it != layers_.end(); ++it)
+    {
+        NpuTimeStats &op = by_op[it->second.op_type];
+        op.total_us += it->second.time.total_us;
+        op.samples++; // layers of this type
+    }
+    fprintf(fp, "\n## operator types\n");
+    fprintf(fp, "  %-20s %6s %12s %6s\n", "op", "layers", "avg us/frame", "share");
+    for (std::map<std::string, NpuTimeStats>::const_iterator it = by_op.begin(); it != by_op.end(); ++it)
+    {
+        double per_frame = detail_samples_ > 0 ? (double)it->second.total_us / detail_samples_ : 0;
+        double share = layer_total > 0 ? 100.0 * it->second.total_us / layer_total : 0;
+        fprintf(fp, "  %-20s %6d %12.1f %5.1f%%\n", it->first.c_str(), it->second.samples, per_frame, share);
+    }
+
+    fclose(fp);
+    return 0;
+}
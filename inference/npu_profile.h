@@ -0,0 +1,101 @@
+#ifndef _INFERENCE_NPU_PROFILE_H_
+#define _INFERENCE_NPU_PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define NPU_PROFILE_MAX_CONTEXTS 8
+// Memory samples kept for the report; past that every other one is dropped,
+// so the series still spans the whole run
+#define NPU_PROFILE_MAX_MEMORY_SAMPLES 512
+
+// Memory the runtime reports for one context (RKNN_QUERY_MEM_SIZE)
+typedef struct _NpuMemoryUsage
+{
+    uint64_t weight_size;
+    uint64_t internal_size;      // activations, without inputs/outputs
+    uint64_t dma_allocated_size; // everything the context allocated
+    uint64_t sram_size;
+    uint64_t sram_free_size;
+} NpuMemoryUsage;
+
+// A memory sample of one context, at its `frame`th frame
+typedef struct _NpuMemorySample
+{
+    int context;
+    int frame;
+    NpuMemoryUsage usage;
+} NpuMemorySample;
+
+typedef struct _NpuTimeStats
+{
+    int samples;
+    int64_t total_us;
+    int64_t min_us;
+    int64_t max_us;
+} NpuTimeStats;
+
+typedef struct _NpuLayerStats
+{
+    std::string op_type;
+    std::string target; // NPU, CPU, ...
+    std::string name;
+    NpuTimeStats time;
+} NpuLayerStats;
+
+// Aggregates NPU profiling samples into a text report: run time per frame
+// (RKNN_QUERY_PERF_RUN), time per layer (the RKNN_QUERY_PERF_DETAIL table)
+// and memory per context, at startup and over time. Only one frame in
+// `interval` is sampled, since
+// querying the layer table is expensive. No rknn dependency, the backend
+// passes the query results in.
+class NpuProfile
+{
+public:
+    NpuProfile();
+
+    // 0 disables sampling
+    void set_interval(int interval) { interval_ = interval > 0 ? interval : 0; }
+    int interval() const { return interval_; }
+    bool enabled() const { return interval_ > 0; }
+
+    // Counts a frame started on `context`, true when it is to be sampled.
+    // Only called from the context's own worker thread.
+    bool due(int context);
+
+    // Memory right after loading the model
+    void set_memory(int context, const NpuMemoryUsage &usage);
+    // Memory of a sampled frame
+    void add_memory_sample(int context, const NpuMemoryUsage &usage);
+    // One sampled frame: the NPU's run time, the time from run() to the
+    // outputs as the worker saw it, and the layer table text (may be NULL)
+    void add_sample(int context, int64_t run_us, int64_t frame_us, const char *perf_detail, size_t length);
+
+    int samples();
+    // Rewrites the report at `path`
+    int write(const char *path);
+
+private:
+    void add_layers(const char *perf_detail, size_t length);
+
+    int interval_;
+    int frames_[NPU_PROFILE_MAX_CONTEXTS];
+    std::mutex mutex_;
+    int n_contexts_;
+    NpuMemoryUsage memory_[NPU_PROFILE_MAX_CONTEXTS];
+    bool has_memory_[NPU_PROFILE_MAX_CONTEXTS];
+    std::vector<NpuMemorySample> memory_samples_;
+    int memory_count_[NPU_PROFILE_MAX_CONTEXTS];
+    int memory_stride_; // frames between kept samples grow as the series is halved
+    NpuTimeStats run_[NPU_PROFILE_MAX_CONTEXTS];
+    NpuTimeStats frame_[NPU_PROFILE_MAX_CONTEXTS];
+    std::map<int, NpuLayerStats> layers_; // by layer ID
+    int detail_samples_;
+};
+
+#endif //_INFERENCE_NPU_PROFILE_H_
@@ -0,0 +1,222 @@
+#include "inference/inference_backend.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+// Frames loaded from a recording; they are all kept in memory
+#define REPLAY_MAX_FRAMES 256
+
+typedef struct _ReplayFrame
+{
+    std::vector<int8_t> outputs[YOLO_MAX_HEADS];
+} ReplayFrame;
+
+typedef struct _ReplayInflight
+{
+    AnalyticsFrame *frame;
+    struct timeval start_time;
+    double done_us; // when the simulated NPU finishes it
+    int recorded;   // index into frames_
+} ReplayInflight;
+
+// Per-worker state; only touched by that worker's thread
+typedef struct _ReplayWorker
+{
+    ReplayInflight inflight[INFERENCE_PIPELINE_DEPTH];
+    int inflight_head;
+    int inflight_count;
+    double busy_until_us; // the worker's "NPU core" runs one frame at a time
+    uint32_t seed;
+} ReplayWorker;
+
+static double now_us()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (double)t.tv_sec * 1000000 + t.tv_usec;
+}
+
+// Hands out recorded outputs instead of running the model: every run() takes
+// the next recorded frame (looping), and wait() returns it once the
+// configured latency has passed. A pipelined worker behaves like an NPU core
+// that queues frames, so the second frame in flight finishes one latency
+// after the first. Inputs are accepted and ignored.
+class ReplayBackend : public InferenceBackend
+{
+public:
+    ReplayBackend();
+
+    const char *name() const { return "replay"; }
+    int init(const InferenceOptions &options);
+
+    int run(int worker, AnalyticsFrame *frame);
+    int wait(int worker, InferenceResult *result);
+
+private:
+    int load(const char *dir);
+    double latency_us(ReplayWorker *replay);
+
+    std::vector<ReplayFrame> frames_;
+    std::atomic<unsigned> next_frame_;
+    int latency_us_;
+    int jitter_us_;
+    ReplayWorker workers_[INFERENCE_MAX_WORKERS];
+};
+
+ReplayBackend::ReplayBackend() : next_frame_(0), latency_us_(0), jitter_us_(0) { memset(workers_, 0, sizeof(workers_)); }
+
+// model.txt and frameNNN_outK.bin as written by gst-test with RKNN_DUMP_OUTPUTS
+int ReplayBackend::load(const char *dir)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/model.txt", dir);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL || yolo_model_read(fp, &model_) < 0)
+    {
+        std::cerr << path << ": missing or not a model description" << std::endl;
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        return -1;
+    }
+    fclose(fp);
+
+    for (int f = 0; f < REPLAY_MAX_FRAMES; f++)
+    {
+        ReplayFrame frame;
+        for (int h = 0; h < model_.num_heads; h++)
+        {
+            snprintf(path, sizeof(path), "%s/frame%03d_out%d.bin", dir, f, h);
+            fp = fopen(path, "rb");
+            if (fp == NULL)
+            {
+                if (h == 0)
+                {
+                    return (int)frames_.size();
+                }
+                std::cerr << path << ": missing" << std::endl;
+                return -1;
+            }
+            frame.outputs[h].resize(yolo_head_size(&model_, h));
+            size_t n = fread(frame.outputs[h].data(), 1, frame.outputs[h].size(), fp);
+            fclose(fp);
+            if (n != frame.outputs[h].size())
+            {
+                std::cerr << path << ": expected " << frame.outputs[h].size() << " bytes, got " << n << std::endl;
+                return -1;
+            }
+        }
+        frames_.push_back(frame);
+    }
+    return (int)frames_.size();
+}
+
+int ReplayBackend::init(const InferenceOptions &options)
+{
+    if (options.replay_dir == NULL)
+    {
+        std::cerr << "replay backend: RKNN_REPLAY_DIR is not set" << std::endl;
+        return -1;
+    }
+    if (load(options.replay_dir) <= 0)
+    {
+        std::cerr << "replay backend: no recorded frames in " << options.replay_dir << std::endl;
+        return -1;
+    }
+    latency_us_ = options.replay_latency_us > 0 ? options.replay_latency_us : 0;
+    jitter_us_ = options.replay_jitter_us > 0 ? options.replay_jitter_us : 0;
+    if (jitter_us_ > latency_us_)
+    {
+        jitter_us_ = latency_us_;
+    }
+
+    // the same worker layout the NPU would get, so queueing behaves alike
+    n_workers_ = 1;
+    if (options.core_mode != NULL && strcmp(options.core_mode, "throughput") == 0)
+    {
+        n_workers_ = options.contexts;
+        if (n_workers_ < 1 || n_workers_ > INFERENCE_MAX_WORKERS)
+        {
+            n_workers_ = INFERENCE_DEFAULT_CONTEXTS;
+        }
+    }
+    pipeline_depth_ = options.pipelined ? INFERENCE_PIPELINE_DEPTH : 1;
+    for (int w = 0; w < n_workers_; w++)
+    {
+        workers_[w].seed = 0x9e3779b9u * (w + 1);
+    }
+    std::cout << "replay frames=" << frames_.size() << " latency=" << latency_us_ << "us jitter=" << jitter_us_
+              << "us workers=" << n_workers_ << std::endl;
+    return 0;
+}
+
+// latency +- jitter, uniform; a per-worker LCG keeps workers independent
+double ReplayBackend::latency_us(ReplayWorker *replay)
+{
+    if (jitter_us_ == 0)
+    {
+        return latency_us_;
+    }
+    replay->seed = replay->seed * 1664525u + 1013904223u;
+    int noise = (int)((replay->seed >> 8) % (uint32_t)(2 * jitter_us_ + 1)) - jitter_us_;
+    return latency_us_ + noise;
+}
+
+int ReplayBackend::run(int worker, AnalyticsFrame *frame)
+{
+    ReplayWorker *replay = &workers_[worker];
+    if (replay->inflight_count >= INFERENCE_PIPELINE_DEPTH)
+    {
+        return -1;
+    }
+    ReplayInflight *inflight =
+        &replay->inflight[(replay->inflight_head + replay->inflight_count) % INFERENCE_PIPELINE_DEPTH];
+    gettimeofday(&inflight->start_time, NULL);
+    double start = (double)inflight->start_time.tv_sec * 1000000 + inflight->start_time.tv_usec;
+    if (replay->busy_until_us > start)
+    {
+        start = replay->busy_until_us;
+    }
+    inflight->done_us = start + latency_us(replay);
+    replay->busy_until_us = inflight->done_us;
+    inflight->recorded = next_frame_++ % frames_.size();
+    inflight->frame = frame;
+    replay->inflight_count++;
+    return 0;
+}
+
+int ReplayBackend::wait(int worker, InferenceResult *result)
+{
+    ReplayWorker *replay = &workers_[worker];
+    if (replay->inflight_count == 0)
+    {
+        result->frame = NULL;
+        return -1;
+    }
+    ReplayInflight *inflight = &replay->inflight[replay->inflight_head];
+    replay->inflight_head = (replay->inflight_head + 1) % INFERENCE_PIPELINE_DEPTH;
+    replay->inflight_count--;
+    result->frame = inflight->frame;
+    result->start_time = inflight->start_time;
+
+    double remaining = inflight->done_us - now_us();
+    if (remaining > 0)
+    {
+        usleep((useconds_t)remaining);
+    }
+    // the decoders only read the outputs, the recording stays intact
+    ReplayFrame *recorded = &frames_[inflight->recorded];
+    for (int h = 0; h < model_.num_heads; h++)
+    {
+        result->outputs[h] = recorded->outputs[h].data();
+    }
+    return 0;
+}
+
+InferenceBackend *replay_backend_create() { return new ReplayBackend(); }
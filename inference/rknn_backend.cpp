@@ -0,0 +1,950 @@
+#include "inference/inference_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <mutex>
+
+#include "inference/npu_profile.h"
+#include "rknn/rknn_api.h"
+
+// RK3588 has three NPU cores; throughput mode puts context i on core i % 3
+#define RKNN_NPU_CORES 3
+#define RKNN_MAX_CONTEXTS INFERENCE_MAX_WORKERS
+#define RKNN_MAX_OUTPUTS YOLO_MAX_HEADS
+// The profiling report is rewritten after this many samples, and on exit
+#define RKNN_PROFILE_WRITE_SAMPLES 16
+
+// A frame started on the NPU whose outputs have not been fetched yet. In
+// zero-copy mode each in-flight slot owns its output tensors, so the NPU can
+// write frame N while the CPU still reads frame N-1.
+typedef struct _InflightFrame
+{
+    uint64_t frame_id;
+    bool sampled;  // RKNN_PROFILE: runs alone on the context, see run()
+    bool finished; // waited for (and sampled) already, with `status`
+    int status;
+    AnalyticsFrame *frame;
+    struct timeval start_time;
+    rknn_tensor_mem *output_mems[RKNN_MAX_OUTPUTS];
+} InflightFrame;
+
+// One rknn context per analytics worker; only touched by that worker's thread
+typedef struct _NpuWorker
+{
+    rknn_context ctx;
+    rknn_core_mask core_mask;
+    int core;        // index into the per-core shared memory, 0 unless in throughput mode
+    bool holds_core; // RKNN_SHARE_INTERNAL_MEM: the core's internal memory is ours until wait()
+    InflightFrame inflight[INFERENCE_PIPELINE_DEPTH];
+    int inflight_head;
+    int inflight_count;
+    rknn_output outputs[RKNN_MAX_OUTPUTS]; // from rknn_outputs_get, until release()
+    bool holding_outputs;
+} NpuWorker;
+
+static bool yolo_type_from_rknn(rknn_tensor_type type, YoloTensorType *yolo_type)
+{
+    switch (type)
+    {
+    case RKNN_TENSOR_INT8:
+        *yolo_type = YOLO_TENSOR_INT8;
+        return true;
+    case RKNN_TENSOR_FLOAT16:
+        *yolo_type = YOLO_TENSOR_FP16;
+        return true;
+    case RKNN_TENSOR_FLOAT32:
+        *yolo_type = YOLO_TENSOR_FP32;
+        return true;
+    default:
+        return false;
+    }
+}
+
+class RknnBackend : public InferenceBackend
+{
+public:
+    RknnBackend();
+    ~RknnBackend();
+
+    const char *name() const { return "rknn"; }
+    int init(const InferenceOptions &options);
+
+    size_t input_size() const;
+    int input_wstride() const;
+
+    bool device_inputs() const { return zero_copy_; }
+    int alloc_input(AnalyticsFrame *frame, size_t size);
+    void free_input(AnalyticsFrame *frame);
+
+    int run(int worker, AnalyticsFrame *frame);
+    int wait(int worker, InferenceResult *result);
+    void release(int worker);
+
+private:
+    int load_model(const char *path);
+    int init_context(rknn_context *ctx, uint32_t flag, rknn_context share_from);
+    int share_memory();
+    void release_core(NpuWorker *npu);
+    int finish_run(int worker, InflightFrame *inflight);
+    int fetch_outputs(int worker, InflightFrame *inflight, InferenceResult *result);
+    int configure_model();
+    void configure_native_outputs();
+    int bind_io_mem(NpuWorker *npu, InflightFrame *inflight, AnalyticsFrame *frame);
+    void query_memory();
+    bool query_memory_usage(rknn_context ctx, NpuMemoryUsage *usage);
+    void sample_profile(int worker, const InflightFrame *inflight);
+
+    rknn_context ctx_;
+    // The .rknn file, read through an mmap into one NPU buffer that every
+    // context uses in place (RKNN_FLAG_MODEL_BUFFER_ZERO_COPY); the mapping
+    // itself is only kept when no such buffer could be allocated
+    rknn_tensor_mem *model_mem_;
+    void *model_map_;
+    size_t model_size_;
+    // RKNN_SHARE_INTERNAL_MEM: one weight allocation for all contexts and one
+    // internal (activation) buffer per core, which its contexts take turns on
+    bool share_internal_;
+    rknn_tensor_mem *weight_mem_;
+    rknn_tensor_mem *internal_mems_[RKNN_NPU_CORES];
+    std::mutex core_locks_[RKNN_NPU_CORES];
+    rknn_input_output_num io_num_;
+    rknn_sdk_version sdk_ver_;
+    rknn_tensor_attr *input_attrs_;
+    rknn_tensor_attr *output_attrs_;
+    // Overlap rknn_run of frame N with post-processing of frame N-1: runs are
+    // started with rknn_run_extend.non_block and collected with rknn_wait
+    // (not RKNN_FLAG_ASYNC_MASK, whose rknn_outputs_get returns the previous
+    // run's outputs). Zero-copy only, a context has one set of copied tensors.
+    bool pipelined_;
+    // Bind rknn_create_mem tensors with rknn_set_io_mem instead of copying
+    // through rknn_inputs_set/rknn_outputs_get
+    bool zero_copy_;
+    // Bind the output tensors in the NPU's native NC1HWC2 layout (zero-copy
+    // only: rknn_outputs_get always converts to NCHW) and decode them as is
+    bool native_outputs_;
+    rknn_tensor_attr zero_copy_input_attr_;
+    NpuWorker workers_[RKNN_MAX_CONTEXTS];
+    // RKNN_PROFILE: per-run and per-layer timings of sampled frames
+    NpuProfile profile_;
+    const char *profile_path_;
+    // Frames run() accepted whose outputs never reached wait()'s caller
+    uint64_t dropped_frames_;
+};
+
+RknnBackend::RknnBackend()
+    : ctx_(0), model_mem_(NULL), model_map_(NULL), model_size_(0), share_internal_(false), weight_mem_(NULL),
+      input_attrs_(NULL), output_attrs_(NULL), pipelined_(false), zero_copy_(false), native_outputs_(false),
+      profile_path_(NULL), dropped_frames_(0)
+{
+    memset(internal_mems_, 0, sizeof(internal_mems_));
+    memset(&io_num_, 0, sizeof(io_num_));
+    memset(&sdk_ver_, 0, sizeof(sdk_ver_));
+    memset(&zero_copy_input_attr_, 0, sizeof(zero_copy_input_attr_));
+    memset(workers_, 0, sizeof(workers_));
+}
+
+RknnBackend::~RknnBackend()
+{
+    if (profile_.enabled() && profile_.samples() > 0)
+    {
+        profile_.write(profile_path_);
+    }
+    for (int w = 0; w < n_workers_; w++)
+    {
+        release(w);
+        for (int d = 0; d < INFERENCE_PIPELINE_DEPTH; d++)
+        {
+            for (int i = 0; i < RKNN_MAX_OUTPUTS; i++)
+            {
+                if (workers_[w].inflight[d].output_mems[i] != NULL)
+                {
+                    rknn_destroy_mem(workers_[w].ctx, workers_[w].inflight[d].output_mems[i]);
+                }
+            }
+        }
+    }
+    for (int c = 0; c < RKNN_NPU_CORES; c++)
+    {
+        if (internal_mems_[c] != NULL)
+        {
+            rknn_destroy_mem(ctx_, internal_mems_[c]);
+        }
+    }
+    if (weight_mem_ != NULL)
+    {
+        rknn_destroy_mem(ctx_, weight_mem_);
+    }
+    for (int w = n_workers_ - 1; w >= 0; w--)
+    {
+        if (workers_[w].ctx != 0)
+        {
+            rknn_destroy(workers_[w].ctx);
+        }
+    }
+    // the contexts used the model buffer in place until now
+    if (model_mem_ != NULL)
+    {
+        rknn_destroy_mem(0, model_mem_);
+    }
+    if (model_map_ != NULL)
+    {
+        munmap(model_map_, model_size_);
+    }
+    free(input_attrs_);
+    free(output_attrs_);
+}
+
+// Describes the loaded model from its queried tensor attributes, so other
+// input sizes and class counts work without rebuilding
+int RknnBackend::configure_model()
+{
+    const rknn_tensor_attr *input = &input_attrs_[0];
+    bool nchw = input->fmt == RKNN_TENSOR_NCHW;
+    int height = input->dims[nchw ? 2 : 1];
+    int width = input->dims[nchw ? 3 : 2];
+
+    int channels[YOLO_MAX_HEADS], grid_h[YOLO_MAX_HEADS], grid_w[YOLO_MAX_HEADS];
+    YoloTensorType types[YOLO_MAX_HEADS];
+    for (int i = 0; i < (int)io_num_.n_output; i++)
+    {
+        const rknn_tensor_attr *attr = &output_attrs_[i];
+        if (attr->n_dims != 4 || attr->fmt != RKNN_TENSOR_NCHW || !yolo_type_from_rknn(attr->type, &types[i]))
+        {
+            std::cerr << "output " << i << ": unsupported " << get_format_string(attr->fmt) << " "
+                      << get_type_string(attr->type) << " tensor" << std::endl;
+            return -1;
+        }
+        channels[i] = attr->dims[1];
+        grid_h[i] = attr->dims[2];
+        grid_w[i] = attr->dims[3];
+    }
+    if (yolo_model_from_shapes(&model_, width, height, io_num_.n_output, channels, grid_h, grid_w, types,
+                               YOLO_MAX_ANCHORS) < 0)
+    {
+        std::cerr << "outputs are not YOLO heads with " << YOLO_MAX_ANCHORS << " anchors" << std::endl;
+        return -1;
+    }
+    for (int i = 0; i < (int)io_num_.n_output; i++)
+    {
+        model_.heads[i].zp = output_attrs_[i].zp;
+        model_.heads[i].scale = output_attrs_[i].scale;
+    }
+    std::cout << "outputs=" << get_type_string(output_attrs_[0].type) << std::endl;
+    return 0;
+}
+
+// Swaps output_attrs_ for the native NC1HWC2 attributes when every output
+// is an int8 head in that layout, so that the zero-copy tensors are bound
+// (and sized) as the NPU writes them; otherwise keeps NCHW
+void RknnBackend::configure_native_outputs()
+{
+    rknn_tensor_attr native[RKNN_MAX_OUTPUTS];
+    for (int i = 0; i < (int)io_num_.n_output; i++)
+    {
+        memset(&native[i], 0, sizeof(rknn_tensor_attr));
+        native[i].index = i;
+        const YoloHead *head = &model_.heads[i];
+        int channels = head->num_anchors * (5 + model_.num_classes);
+        if (rknn_query(ctx_, RKNN_QUERY_NATIVE_NC1HWC2_OUTPUT_ATTR, &native[i], sizeof(rknn_tensor_attr)) < 0 ||
+            native[i].fmt != RKNN_TENSOR_NC1HWC2 || native[i].type != RKNN_TENSOR_INT8 || native[i].n_dims != 5 ||
+            (int)(native[i].dims[1] * native[i].dims[4]) < channels || (int)native[i].dims[2] != head->grid_h ||
+            (int)native[i].dims[3] != head->grid_w)
+        {
+            std::cerr << "output " << i << ": no int8 NC1HWC2 native layout, decoding NCHW outputs" << std::endl;
+            native_outputs_ = false;
+            return;
+        }
+    }
+    for (int i = 0; i < (int)io_num_.n_output; i++)
+    {
+        output_attrs_[i] = native[i];
+        model_.heads[i].layout = YOLO_LAYOUT_NC1HWC2;
+        model_.heads[i].c2 = native[i].dims[4];
+    }
+    std::cout << "outputs NC1HWC2 c2=" << model_.heads[0].c2 << std::endl;
+}
+
+// Maps the model file and copies it once into NPU memory the runtime can
+// use as is, instead of rknn_init reading the path into a private buffer and
+// copying the weights out of it again for every context
+int RknnBackend::load_model(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "cannot open " << path << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "cannot map " << path << std::endl;
+        return -1;
+    }
+    model_size_ = st.st_size;
+
+    model_mem_ = rknn_create_mem2(0, model_size_, RKNN_MEM_FLAG_ALLOC_NO_CONTEXT);
+    if (model_mem_ == NULL)
+    {
+        // the runtime then copies what it needs out of the mapping
+        std::cerr << "no NPU memory for the model buffer, loading from the mapped file" << std::endl;
+        model_map_ = map;
+        return 0;
+    }
+    memcpy(model_mem_->virt_addr, map, model_size_);
+    munmap(map, model_size_);
+    return 0;
+}
+
+// A context on the loaded model; `share_from` lends its weights
+// (RKNN_FLAG_SHARE_WEIGHT_MEM) so they are not allocated again
+int RknnBackend::init_context(rknn_context *ctx, uint32_t flag, rknn_context share_from)
+{
+    rknn_init_extend extend;
+    memset(&extend, 0, sizeof(extend));
+    void *model = model_map_;
+    if (model_mem_ != NULL)
+    {
+        model = model_mem_->virt_addr;
+        flag |= RKNN_FLAG_MODEL_BUFFER_ZERO_COPY;
+        extend.model_buffer_fd = model_mem_->fd;
+        extend.model_buffer_flags = model_mem_->flags;
+    }
+    if (share_from != 0)
+    {
+        flag |= RKNN_FLAG_SHARE_WEIGHT_MEM;
+        extend.ctx = share_from;
+    }
+    return rknn_init(ctx, model, model_size_, flag, &extend);
+}
+
+// Contexts created with RKNN_FLAG_MEM_ALLOC_OUTSIDE (and without
+// RKNN_FLAG_SHARE_WEIGHT_MEM) get their memory here: one weight buffer set
+// on all of them, and one internal buffer per core, sized for the largest
+// context on it. Contexts on a core never run at the same time: run() takes
+// the core until wait() has the outputs.
+int RknnBackend::share_memory()
+{
+    rknn_mem_size mem_size;
+    memset(&mem_size, 0, sizeof(mem_size));
+    if (rknn_query(ctx_, RKNN_QUERY_MEM_SIZE, &mem_size, sizeof(mem_size)) != RKNN_SUCC)
+    {
+        std::cerr << "rknn_query RKNN_QUERY_MEM_SIZE fail!" << std::endl;
+        return -1;
+    }
+    weight_mem_ = rknn_create_mem(ctx_, mem_size.total_weight_size);
+    if (weight_mem_ == NULL)
+    {
+        std::cerr << "rknn_create_mem fail!" << std::endl;
+        return -1;
+    }
+
+    uint32_t internal_size[RKNN_NPU_CORES] = {0};
+    for (int w = 0; w < n_workers_; w++)
+    {
+        if (rknn_query(workers_[w].ctx, RKNN_QUERY_MEM_SIZE, &mem_size, sizeof(mem_size)) == RKNN_SUCC &&
+            mem_size.total_internal_size > internal_size[workers_[w].core])
+        {
+            internal_size[workers_[w].core] = mem_size.total_internal_size;
+        }
+    }
+    for (int c = 0; c < RKNN_NPU_CORES; c++)
+    {
+        if (internal_size[c] == 0)
+        {
+            continue;
+        }
+        internal_mems_[c] = rknn_create_mem(ctx_, internal_size[c]);
+        if (internal_mems_[c] == NULL)
+        {
+            std::cerr << "rknn_create_mem fail!" << std::endl;
+            return -1;
+        }
+    }
+
+    for (int w = 0; w < n_workers_; w++)
+    {
+        NpuWorker *npu = &workers_[w];
+        if (rknn_set_weight_mem(npu->ctx, weight_mem_) < 0 ||
+            rknn_set_internal_mem(npu->ctx, internal_mems_[npu->core]) < 0)
+        {
+            std::cerr << "ctx " << w << ": cannot set the shared weight/internal memory" << std::endl;
+            return -1;
+        }
+    }
+    std::cout << "rknn shared weights=" << weight_mem_->size / 1024 << "KB internal per core=";
+    for (int c = 0; c < RKNN_NPU_CORES; c++)
+    {
+        std::cout << (c > 0 ? "/" : "") << internal_size[c] / 1024;
+    }
+    std::cout << "KB" << std::endl;
+    return 0;
+}
+
+void RknnBackend::release_core(NpuWorker *npu)
+{
+    if (npu->holds_core)
+    {
+        npu->holds_core = false;
+        core_locks_[npu->core].unlock();
+    }
+}
+
+int RknnBackend::init(const InferenceOptions &options)
+{
+    pipelined_ = options.pipelined;
+    zero_copy_ = options.zero_copy;
+    native_outputs_ = options.native_outputs;
+    if (native_outputs_ && !zero_copy_)
+    {
+        std::cerr << "RKNN_NATIVE_OUTPUTS needs RKNN_ZERO_COPY, decoding NCHW outputs" << std::endl;
+        native_outputs_ = false;
+    }
+    share_internal_ = options.share_internal_mem;
+    if (share_internal_ && !zero_copy_)
+    {
+        // RKNN_FLAG_MEM_ALLOC_OUTSIDE leaves the input and output tensors to
+        // us too, which rknn_inputs_set/rknn_outputs_get have no way to use
+        std::cerr << "RKNN_SHARE_INTERNAL_MEM needs RKNN_ZERO_COPY, every context keeps its own memory" << std::endl;
+        share_internal_ = false;
+    }
+    if (share_internal_ && pipelined_)
+    {
+        // a context holds its core's internal memory from run() to wait()
+        std::cerr << "RKNN_SHARE_INTERNAL_MEM: contexts on a core take turns, RKNN_PIPELINE ignored" << std::endl;
+        pipelined_ = false;
+    }
+    if (pipelined_ && !zero_copy_)
+    {
+        // rknn_inputs_set of frame N+1 would overwrite the input of frame N
+        std::cerr << "RKNN_PIPELINE needs RKNN_ZERO_COPY, running one frame at a time" << std::endl;
+        pipelined_ = false;
+    }
+    pipeline_depth_ = pipelined_ ? INFERENCE_PIPELINE_DEPTH : 1;
+    profile_.set_interval(options.profile_interval);
+    profile_path_ = options.profile_path;
+    std::cout << "rknn pipelined=" << pipelined_ << " zero_copy=" << zero_copy_ << " profile=" << profile_.interval()
+              << std::endl;
+
+    // Load RKNN Model
+    uint32_t flag = 0;
+    if (zero_copy_)
+    {
+        // Cache maintenance is done explicitly with rknn_mem_sync
+        flag |= RKNN_FLAG_DISABLE_FLUSH_INPUT_MEM_CACHE | RKNN_FLAG_DISABLE_FLUSH_OUTPUT_MEM_CACHE;
+    }
+    if (profile_.enabled())
+    {
+        // slows every run down, not only the sampled ones
+        flag |= RKNN_FLAG_COLLECT_PERF_MASK;
+    }
+    if (share_internal_)
+    {
+        flag |= RKNN_FLAG_MEM_ALLOC_OUTSIDE;
+    }
+    if (load_model(options.model_path) < 0)
+    {
+        return -1;
+    }
+    int ret = init_context(&ctx_, flag, 0);
+    if (ret < 0)
+    {
+        std::cerr << "rknn_init fail! ret=" << ret << std::endl;
+        return -1;
+    }
+
+    // Spread the model over the NPU cores:
+    //   auto       - one context, the runtime picks a core (default)
+    //   throughput - RKNN_CONTEXTS contexts (one per core by default, more
+    //                share the cores round-robin) sharing the first one's
+    //                weights; idle contexts take the next queued frame
+    //   latency    - one context split over all three cores
+    const char *core_mode = options.core_mode;
+    workers_[0].ctx = ctx_;
+    workers_[0].core_mask = RKNN_NPU_CORE_AUTO;
+    n_workers_ = 1;
+    if (core_mode != NULL && strcmp(core_mode, "throughput") == 0)
+    {
+        static const rknn_core_mask core_masks[RKNN_NPU_CORES] = {RKNN_NPU_CORE_0, RKNN_NPU_CORE_1, RKNN_NPU_CORE_2};
+        int n_workers = options.contexts;
+        if (n_workers < 1 || n_workers > RKNN_MAX_CONTEXTS)
+        {
+            n_workers = RKNN_NPU_CORES;
+        }
+        for (int i = 0; i < n_workers; i++)
+        {
+            if (i > 0)
+            {
+                // With RKNN_FLAG_MEM_ALLOC_OUTSIDE the first context has no
+                // weights to lend yet; share_memory() gives every context
+                // the same weight buffer instead
+                ret = init_context(&workers_[i].ctx, flag, share_internal_ ? 0 : ctx_);
+                if (ret < 0 && !share_internal_)
+                {
+                    std::cerr << "rknn_init with shared weights fail! ret=" << ret << ", using rknn_dup_context"
+                              << std::endl;
+                    ret = rknn_dup_context(&ctx_, &workers_[i].ctx);
+                }
+                if (ret < 0)
+                {
+                    std::cerr << "context " << i << " fail! ret=" << ret << std::endl;
+                    return -1;
+                }
+                n_workers_ = i + 1;
+            }
+            workers_[i].core = i % RKNN_NPU_CORES;
+            workers_[i].core_mask = core_masks[workers_[i].core];
+        }
+    }
+    else if (core_mode != NULL && strcmp(core_mode, "latency") == 0)
+    {
+        workers_[0].core_mask = RKNN_NPU_CORE_0_1_2;
+    }
+
+    for (int i = 0; i < n_workers_; i++)
+    {
+        if (workers_[i].core_mask == RKNN_NPU_CORE_AUTO)
+        {
+            continue;
+        }
+        ret = rknn_set_core_mask(workers_[i].ctx, workers_[i].core_mask);
+        if (ret < 0)
+        {
+            std::cerr << "rknn_set_core_mask fail! ret=" << ret << std::endl;
+            return -1;
+        }
+    }
+    std::cout << "rknn contexts=" << n_workers_ << " model buffer=" << (model_mem_ != NULL ? "npu" : "mapped file")
+              << std::endl;
+    if (share_internal_ && share_memory() < 0)
+    {
+        return -1;
+    }
+    query_memory();
+
+    // Get sdk and driver version
+    ret = rknn_query(ctx_, RKNN_QUERY_SDK_VERSION, &sdk_ver_, sizeof(sdk_ver_));
+    if (ret != RKNN_SUCC)
+    {
+        std::cerr << "rknn_query fail! ret=" << ret << std::endl;
+        return -1;
+    }
+    std::cout << "api version: " << sdk_ver_.api_version << std::endl;
+
+    // Get Model Input Output Info
+    ret = rknn_query(ctx_, RKNN_QUERY_IN_OUT_NUM, &io_num_, sizeof(io_num_));
+    if (ret != RKNN_SUCC)
+    {
+        std::cerr << "rknn_query fail! ret=" << ret << std::endl;
+        return -1;
+    }
+    std::cout << "n_input=" << io_num_.n_input << " n_output=" << io_num_.n_output << std::endl;
+
+    input_attrs_ = (rknn_tensor_attr *)malloc(io_num_.n_input * sizeof(rknn_tensor_attr));
+    memset(input_attrs_, 0, io_num_.n_input * sizeof(rknn_tensor_attr));
+    for (uint32_t i = 0; i < io_num_.n_input; i++)
+    {
+        input_attrs_[i].index = i;
+        rknn_query(ctx_, RKNN_QUERY_INPUT_ATTR, &(input_attrs_[i]), sizeof(rknn_tensor_attr));
+    }
+    std::cout << "input[0] fmt=" << get_format_string(input_attrs_[0].fmt) << std::endl; // npu only support NHWC in zero copy mode
+
+    output_attrs_ = (rknn_tensor_attr *)malloc(io_num_.n_output * sizeof(rknn_tensor_attr));
+    memset(output_attrs_, 0, io_num_.n_output * sizeof(rknn_tensor_attr));
+    for (uint32_t i = 0; i < io_num_.n_output; i++)
+    {
+        output_attrs_[i].index = i;
+        rknn_query(ctx_, RKNN_QUERY_OUTPUT_ATTR, &(output_attrs_[i]), sizeof(rknn_tensor_attr));
+    }
+    std::cout << "output[0] fmt=" << get_format_string(output_attrs_[0].fmt) << std::endl;
+
+    if (io_num_.n_output > RKNN_MAX_OUTPUTS)
+    {
+        std::cerr << "model has too many outputs: " << io_num_.n_output << std::endl;
+        return -1;
+    }
+
+    if (configure_model() < 0)
+    {
+        return -1;
+    }
+    if (native_outputs_)
+    {
+        configure_native_outputs();
+    }
+
+    if (zero_copy_)
+    {
+        zero_copy_input_attr_ = input_attrs_[0];
+        zero_copy_input_attr_.type = RKNN_TENSOR_UINT8;
+        zero_copy_input_attr_.fmt = RKNN_TENSOR_NHWC;
+        zero_copy_input_attr_.pass_through = 0;
+
+        // Outputs are decoded in the model's output type straight from the
+        // tensor memory, as NCHW or in the native layout
+        for (uint32_t i = 0; i < io_num_.n_output; i++)
+        {
+            output_attrs_[i].pass_through = 0;
+        }
+        for (int w = 0; w < n_workers_; w++)
+        {
+            for (int d = 0; d < INFERENCE_PIPELINE_DEPTH; d++)
+            {
+                for (uint32_t i = 0; i < io_num_.n_output; i++)
+                {
+                    // native tensors carry the padding of their last channel block
+                    size_t size = output_attrs_[i].n_elems * yolo_tensor_elem_size(model_.heads[i].type);
+                    if (native_outputs_ && output_attrs_[i].size_with_stride > size)
+                    {
+                        size = output_attrs_[i].size_with_stride;
+                    }
+                    rknn_tensor_mem *mem = rknn_create_mem(workers_[w].ctx, size);
+                    if (mem == NULL)
+                    {
+                        std::cerr << "rknn_create_mem fail!" << std::endl;
+                        return -1;
+                    }
+                    workers_[w].inflight[d].output_mems[i] = mem;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// What each context costs in NPU memory, i.e. what one more stream costs
+bool RknnBackend::query_memory_usage(rknn_context ctx, NpuMemoryUsage *usage)
+{
+    rknn_mem_size mem_size;
+    memset(&mem_size, 0, sizeof(mem_size));
+    if (rknn_query(ctx, RKNN_QUERY_MEM_SIZE, &mem_size, sizeof(mem_size)) != RKNN_SUCC)
+    {
+        return false;
+    }
+    usage->weight_size = mem_size.total_weight_size;
+    usage->internal_size = mem_size.total_internal_size;
+    usage->dma_allocated_size = mem_size.total_dma_allocated_size;
+    usage->sram_size = mem_size.total_sram_size;
+    usage->sram_free_size = mem_size.free_sram_size;
+    return true;
+}
+
+void RknnBackend::query_memory()
+{
+    for (int w = 0; w < n_workers_; w++)
+    {
+        NpuMemoryUsage usage;
+        if (!query_memory_usage(workers_[w].ctx, &usage))
+        {
+            continue;
+        }
+        profile_.set_memory(w, usage);
+        std::cout << "rknn ctx " << w << " memory: weight=" << usage.weight_size / 1024
+                  << "KB internal=" << usage.internal_size / 1024 << "KB dma=" << usage.dma_allocated_size / 1024
+                  << "KB" << std::endl;
+    }
+}
+
+// Queries the NPU timings of the frame just waited for, alone on its
+// context, and the context's memory on the same schedule
+void RknnBackend::sample_profile(int worker, const InflightFrame *inflight)
+{
+    NpuWorker *npu = &workers_[worker];
+    rknn_perf_run perf_run;
+    memset(&perf_run, 0, sizeof(perf_run));
+    if (rknn_query(npu->ctx, RKNN_QUERY_PERF_RUN, &perf_run, sizeof(perf_run)) != RKNN_SUCC)
+    {
+        perf_run.run_duration = 0;
+    }
+    rknn_perf_detail perf_detail;
+    memset(&perf_detail, 0, sizeof(perf_detail));
+    if (rknn_query(npu->ctx, RKNN_QUERY_PERF_DETAIL, &perf_detail, sizeof(perf_detail)) != RKNN_SUCC)
+    {
+        perf_detail.perf_data = NULL;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t frame_us = (int64_t)(now.tv_sec - inflight->start_time.tv_sec) * 1000000 +
+                       (now.tv_usec - inflight->start_time.tv_usec);
+    profile_.add_sample(worker, perf_run.run_duration, frame_us, perf_detail.perf_data,
+                        perf_detail.perf_data != NULL ? perf_detail.data_len : 0);
+    NpuMemoryUsage usage;
+    if (query_memory_usage(npu->ctx, &usage))
+    {
+        profile_.add_memory_sample(worker, usage);
+    }
+    if (profile_.samples() % RKNN_PROFILE_WRITE_SAMPLES == 0 && profile_.write(profile_path_) < 0)
+    {
+        fprintf(stderr, "cannot write the profiling report to %s\n", profile_path_);
+    }
+}
+
+// Size of one input slot, including the row padding the NPU expects
+size_t RknnBackend::input_size() const
+{
+    if (zero_copy_)
+    {
+        return zero_copy_input_attr_.size_with_stride;
+    }
+    return InferenceBackend::input_size();
+}
+
+// Row stride in pixels RGA has to use when writing an input slot
+int RknnBackend::input_wstride() const
+{
+    if (zero_copy_ && zero_copy_input_attr_.w_stride > 0)
+    {
+        return zero_copy_input_attr_.w_stride;
+    }
+    return InferenceBackend::input_wstride();
+}
+
+// Zero-copy input slots live in rknn memory so RGA can write the resized
+// frame straight into the input tensor. Like the model buffer they belong
+// to no context, since whichever worker context picks the frame up binds it.
+int RknnBackend::alloc_input(AnalyticsFrame *frame, size_t size)
+{
+    rknn_tensor_mem *mem = rknn_create_mem2(ctx_, size, RKNN_MEM_FLAG_ALLOC_NO_CONTEXT);
+    if (mem == NULL)
+    {
+        std::cerr << "rknn_create_mem2 fail!" << std::endl;
+        return -1;
+    }
+    frame->input = mem->virt_addr;
+    frame->input_fd = mem->fd;
+    frame->input_priv = mem;
+    return 0;
+}
+
+void RknnBackend::free_input(AnalyticsFrame *frame)
+{
+    rknn_destroy_mem(ctx_, (rknn_tensor_mem *)frame->input_priv);
+    frame->input = NULL;
+    frame->input_priv = NULL;
+}
+
+// Binds the frame's input tensor and this in-flight slot's output tensors
+int RknnBackend::bind_io_mem(NpuWorker *npu, InflightFrame *inflight, AnalyticsFrame *frame)
+{
+    rknn_tensor_mem *input_mem = (rknn_tensor_mem *)frame->input_priv;
+    // The NPU is told not to flush input caches; only CPU writers need it
+    if (frame->input_dirty)
+    {
+        rknn_mem_sync(npu->ctx, input_mem, RKNN_MEMORY_SYNC_TO_DEVICE);
+        frame->input_dirty = false;
+    }
+    int ret = rknn_set_io_mem(npu->ctx, input_mem, &zero_copy_input_attr_);
+    if (ret < 0)
+    {
+        fprintf(stderr, "rknn_set_io_mem input fail! ret=%d\n", ret);
+        return -1;
+    }
+    for (uint32_t i = 0; i < io_num_.n_output; i++)
+    {
+        ret = rknn_set_io_mem(npu->ctx, inflight->output_mems[i], &output_attrs_[i]);
+        if (ret < 0)
+        {
+            fprintf(stderr, "rknn_set_io_mem output %u fail! ret=%d\n", i, ret);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// In pipelined mode rknn_run returns as soon as the frame is queued on the
+// NPU, so the worker can post-process the previous frame meanwhile
+int RknnBackend::run(int worker, AnalyticsFrame *frame)
+{
+    NpuWorker *npu = &workers_[worker];
+    if (npu->inflight_count >= INFERENCE_PIPELINE_DEPTH)
+    {
+        return -1;
+    }
+    // A frame sampled for RKNN_PROFILE runs alone: the frames before it are
+    // waited for first, so its time has no queueing in it, and the frame
+    // after it waits for it, so the perf queries still describe it
+    bool sampled = profile_.due(worker);
+    for (int i = 0; i < npu->inflight_count; i++)
+    {
+        InflightFrame *queued = &npu->inflight[(npu->inflight_head + i) % INFERENCE_PIPELINE_DEPTH];
+        if ((sampled || queued->sampled) && !queued->finished)
+        {
+            finish_run(worker, queued);
+        }
+    }
+    InflightFrame *inflight = &npu->inflight[(npu->inflight_head + npu->inflight_count) % INFERENCE_PIPELINE_DEPTH];
+    inflight->sampled = sampled;
+    inflight->finished = false;
+    gettimeofday(&inflight->start_time, NULL);
+
+    int ret;
+    if (zero_copy_)
+    {
+        ret = bind_io_mem(npu, inflight, frame);
+        if (ret < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        rknn_input inputs[1];
+        memset(inputs, 0, sizeof(inputs));
+        inputs[0].index = 0;
+        inputs[0].type = RKNN_TENSOR_UINT8;
+        inputs[0].size = InferenceBackend::input_size();
+        inputs[0].fmt = RKNN_TENSOR_NHWC;
+        inputs[0].pass_through = 0;
+        inputs[0].buf = frame->input;
+
+        ret = rknn_inputs_set(npu->ctx, io_num_.n_input, inputs);
+        if (ret < 0)
+        {
+            fprintf(stderr, "rknn_inputs_set fail! ret=%d\n", ret);
+            return -1;
+        }
+    }
+
+    if (share_internal_)
+    {
+        core_locks_[npu->core].lock();
+        npu->holds_core = true;
+    }
+    rknn_run_extend run_extend;
+    memset(&run_extend, 0, sizeof(run_extend));
+    run_extend.non_block = 1;
+    ret = rknn_run(npu->ctx, pipelined_ ? &run_extend : NULL);
+    if (ret < 0)
+    {
+        fprintf(stderr, "rknn_run fail! ret=%d\n", ret);
+        release_core(npu);
+        return -1;
+    }
+
+    inflight->frame_id = run_extend.frame_id;
+    inflight->frame = frame;
+    npu->inflight_count++;
+    return 0;
+}
+
+// Waits for the oldest frame in flight and fetches its outputs
+int RknnBackend::wait(int worker, InferenceResult *result)
+{
+    NpuWorker *npu = &workers_[worker];
+    if (npu->inflight_count == 0)
+    {
+        result->frame = NULL;
+        return -1;
+    }
+    InflightFrame *inflight = &npu->inflight[npu->inflight_head];
+    npu->inflight_head = (npu->inflight_head + 1) % INFERENCE_PIPELINE_DEPTH;
+    npu->inflight_count--;
+    result->frame = inflight->frame;
+    result->start_time = inflight->start_time;
+
+    int ret = fetch_outputs(worker, inflight, result);
+    // the outputs are out of the internal memory, the next context may run
+    release_core(npu);
+    if (ret < 0)
+    {
+        dropped_frames_++;
+        fprintf(stderr, "rknn frame dropped (%llu so far)\n", (unsigned long long)dropped_frames_);
+    }
+    return ret;
+}
+
+// Waits for a pipelined frame and samples it when due; run() may do so
+// before wait() gets to the frame
+int RknnBackend::finish_run(int worker, InflightFrame *inflight)
+{
+    NpuWorker *npu = &workers_[worker];
+    inflight->finished = true;
+    inflight->status = 0;
+    if (pipelined_)
+    {
+        rknn_run_extend wait_extend;
+        memset(&wait_extend, 0, sizeof(wait_extend));
+        wait_extend.frame_id = inflight->frame_id;
+        int ret = rknn_wait(npu->ctx, &wait_extend);
+        if (ret < 0)
+        {
+            fprintf(stderr, "rknn_wait fail! ret=%d\n", ret);
+            inflight->status = -1;
+            return -1;
+        }
+    }
+    if (inflight->sampled)
+    {
+        sample_profile(worker, inflight);
+    }
+    return 0;
+}
+
+int RknnBackend::fetch_outputs(int worker, InflightFrame *inflight, InferenceResult *result)
+{
+    NpuWorker *npu = &workers_[worker];
+    int ret = inflight->finished ? inflight->status : finish_run(worker, inflight);
+    if (ret < 0)
+    {
+        return -1;
+    }
+
+    if (zero_copy_)
+    {
+        // Output caches are not invalidated by the runtime; do it before the CPU reads
+        for (uint32_t i = 0; i < io_num_.n_output; i++)
+        {
+            rknn_mem_sync(npu->ctx, inflight->output_mems[i], RKNN_MEMORY_SYNC_FROM_DEVICE);
+            result->outputs[i] = inflight->output_mems[i]->virt_addr;
+        }
+        return 0;
+    }
+
+    memset(npu->outputs, 0, sizeof(npu->outputs));
+    for (uint32_t i = 0; i < io_num_.n_output; i++)
+    {
+        npu->outputs[i].index = i;
+        npu->outputs[i].want_float = 0;
+    }
+
+    ret = rknn_outputs_get(npu->ctx, io_num_.n_output, npu->outputs, NULL);
+    if (ret < 0)
+    {
+        fprintf(stderr, "rknn_outputs_get fail! ret=%d\n", ret);
+        return -1;
+    }
+    npu->holding_outputs = true;
+    for (uint32_t i = 0; i < io_num_.n_output; i++)
+    {
+        result->outputs[i] = npu->outputs[i].buf;
+    }
+    return 0;
+}
+
+void RknnBackend::release(int worker)
+{
+    NpuWorker *npu = &workers_[worker];
+    if (npu->holding_outputs)
+    {
+        rknn_outputs_release(npu->ctx, io_num_.n_output, npu->outputs);
+        npu->holding_outputs = false;
+    }
+}
+
+InferenceBackend *rknn_backend_create() { return new RknnBackend(); }
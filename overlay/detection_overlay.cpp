@@ -0,0 +1,389 @@
+#include "overlay/detection_overlay.h"
+
+#include <gst/allocators/allocators.h>
+#include <gst/base/gstbasetransform.h>
+#include <gst/video/video.h>
+#include <string.h>
+
+#include "overlay/dmabuf_pool.h"
+#include "overlay/label_atlas.h"
+#include "overlay/overlay.h"
+#include "overlay/rga_overlay.h"
+#include "preprocess/rga_preprocess.h"
+#include "yolov5/postprocess.h"
+
+typedef struct _DetectionOverlay
+{
+    GstBaseTransform parent;
+    int thickness;
+    int backend;
+    LabelAtlas *atlas;
+    bool rga_ready;
+    GstVideoInfo info;
+    int overlay_format; // OverlayPixelFormat, -1 when the CPU overlay cannot draw it
+    int rga_format;     // RK_FORMAT_*, -1 without RGA
+    GstBufferPool *pool; // private frames RGA copies shared ones into, NULL until needed
+    gsize pool_size;
+} DetectionOverlay;
+
+typedef struct _DetectionOverlayClass
+{
+    GstBaseTransformClass parent_class;
+} DetectionOverlayClass;
+
+enum
+{
+    PROP_0,
+    PROP_THICKNESS,
+    PROP_BACKEND,
+    PROP_LABEL_ATLAS,
+};
+
+static const OverlayColor LABEL_TEXT_COLOR = {255, 255, 255};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(DETECTION_OVERLAY_FORMATS)));
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(DETECTION_OVERLAY_FORMATS)));
+
+GType detection_overlay_get_type();
+G_DEFINE_TYPE(DetectionOverlay, detection_overlay, GST_TYPE_BASE_TRANSFORM);
+
+static int overlay_format_from_video_format(GstVideoFormat format)
+{
+    switch (format)
+    {
+    case GST_VIDEO_FORMAT_NV12:
+        return OVERLAY_PIXEL_NV12;
+    case GST_VIDEO_FORMAT_NV16:
+        return OVERLAY_PIXEL_NV16;
+    case GST_VIDEO_FORMAT_BGRA:
+        return OVERLAY_PIXEL_BGRA;
+    case GST_VIDEO_FORMAT_BGRx:
+        return OVERLAY_PIXEL_BGRX;
+    case GST_VIDEO_FORMAT_RGBA:
+    case GST_VIDEO_FORMAT_RGBx:
+        return OVERLAY_PIXEL_RGBA;
+    case GST_VIDEO_FORMAT_RGB:
+        return OVERLAY_PIXEL_RGB;
+    default:
+        return -1;
+    }
+}
+
+static void detection_overlay_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+    DetectionOverlay *self = (DetectionOverlay *)object;
+    switch (prop_id)
+    {
+    case PROP_THICKNESS:
+        self->thickness = g_value_get_int(value);
+        break;
+    case PROP_BACKEND:
+        self->backend = g_value_get_int(value);
+        break;
+    case PROP_LABEL_ATLAS:
+        self->atlas = (LabelAtlas *)g_value_get_pointer(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void detection_overlay_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    DetectionOverlay *self = (DetectionOverlay *)object;
+    switch (prop_id)
+    {
+    case PROP_THICKNESS:
+        g_value_set_int(value, self->thickness);
+        break;
+    case PROP_BACKEND:
+        g_value_set_int(value, self->backend);
+        break;
+    case PROP_LABEL_ATLAS:
+        g_value_set_pointer(value, self->atlas);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+// The label layer is rendered once per run, with the properties set by then
+static gboolean detection_overlay_start(GstBaseTransform *trans)
+{
+    DetectionOverlay *self = (DetectionOverlay *)trans;
+    self->rga_ready = false;
+    if (self->backend != DETECTION_OVERLAY_CPU)
+    {
+        LabelAtlas no_labels;
+        const LabelAtlas *atlas = self->atlas != NULL ? self->atlas : &no_labels;
+        self->rga_ready = rga_overlay_init(atlas, atlas->count(), LABEL_TEXT_COLOR) == 0;
+        if (!self->rga_ready)
+        {
+            g_print("RGA overlay unavailable%s\n", self->backend == DETECTION_OVERLAY_AUTO ? ", drawing on the CPU" : "");
+        }
+    }
+    return TRUE;
+}
+
+static void release_pool(DetectionOverlay *self)
+{
+    if (self->pool != NULL)
+    {
+        gst_buffer_pool_set_active(self->pool, FALSE);
+        gst_object_unref(self->pool);
+        self->pool = NULL;
+    }
+    self->pool_size = 0;
+}
+
+static gboolean detection_overlay_stop(GstBaseTransform *trans)
+{
+    DetectionOverlay *self = (DetectionOverlay *)trans;
+    release_pool(self);
+    if (self->rga_ready)
+    {
+        rga_overlay_deinit();
+        self->rga_ready = false;
+    }
+    return TRUE;
+}
+
+static gboolean detection_overlay_set_caps(GstBaseTransform *trans, GstCaps *incaps, GstCaps *outcaps)
+{
+    DetectionOverlay *self = (DetectionOverlay *)trans;
+    if (!gst_video_info_from_caps(&self->info, incaps))
+    {
+        return FALSE;
+    }
+    self->overlay_format = overlay_format_from_video_format(GST_VIDEO_INFO_FORMAT(&self->info));
+    self->rga_format = rga_format_from_video_format(GST_VIDEO_INFO_FORMAT(&self->info));
+    return TRUE;
+}
+
+static bool is_detection(GstMeta *meta)
+{
+    GstVideoRegionOfInterestMeta *roi = (GstVideoRegionOfInterestMeta *)meta;
+    return gst_video_region_of_interest_meta_get_param(roi, DETECTION_META_PARAMS) != NULL;
+}
+
+static bool has_detections(GstBuffer *buffer)
+{
+    gpointer state = NULL;
+    GstMeta *meta;
+    while ((meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE)) !=
+           NULL)
+    {
+        if (is_detection(meta))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The probe upstream only copied the GstBuffer to attach the metas, so the
+// memory of a frame with detections is usually still the decoder's, also
+// queued for analytics. RGA copies such a frame into a dmabuf of our own
+// pool, without the CPU touching it, and the boxes are drawn on that copy.
+// Everything else goes through the in-place default.
+static GstFlowReturn detection_overlay_prepare_output_buffer(GstBaseTransform *trans, GstBuffer *input,
+                                                             GstBuffer **outbuf)
+{
+    DetectionOverlay *self = (DetectionOverlay *)trans;
+    GstBaseTransformClass *parent_class = GST_BASE_TRANSFORM_CLASS(detection_overlay_parent_class);
+    GstMemory *mem = gst_buffer_peek_memory(input, 0);
+    bool shared = !gst_buffer_is_writable(input) || !gst_buffer_is_all_memory_writable(input);
+    if (!shared || !self->rga_ready || self->rga_format < 0 || gst_buffer_n_memory(input) != 1 ||
+        !gst_is_dmabuf_memory(mem) || !has_detections(input))
+    {
+        return parent_class->prepare_output_buffer(trans, input, outbuf);
+    }
+
+    gsize size = gst_buffer_get_size(input);
+    if (self->pool != NULL && self->pool_size != size)
+    {
+        release_pool(self);
+    }
+    if (self->pool == NULL)
+    {
+        self->pool = dmabuf_pool_new(size);
+        self->pool_size = self->pool != NULL ? size : 0;
+    }
+    GstBuffer *copy = NULL;
+    if (self->pool == NULL || gst_buffer_pool_acquire_buffer(self->pool, &copy, NULL) != GST_FLOW_OK)
+    {
+        return parent_class->prepare_output_buffer(trans, input, outbuf);
+    }
+    // timestamps and metas, the GstVideoMeta with the decoder's strides included
+    gst_buffer_copy_into(copy, input, GST_BUFFER_COPY_METADATA, 0, -1);
+    if (rga_overlay_copy(input, copy, &self->info, self->rga_format) < 0)
+    {
+        gst_buffer_unref(copy);
+        return parent_class->prepare_output_buffer(trans, input, outbuf);
+    }
+    *outbuf = copy;
+    return GST_FLOW_OK;
+}
+
+static void draw_cpu(DetectionOverlay *self, GstBuffer *buffer, const OverlayBox *boxes, const char *const *names,
+                     int count)
+{
+    // Planes and strides from the buffer's GstVideoMeta when it has one
+    GstVideoFrame video_frame;
+    if (!gst_video_frame_map(&video_frame, &self->info, buffer, GST_MAP_READWRITE))
+    {
+        return;
+    }
+    OverlayFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.format = (OverlayPixelFormat)self->overlay_format;
+    frame.width = GST_VIDEO_INFO_WIDTH(&self->info);
+    frame.height = GST_VIDEO_INFO_HEIGHT(&self->info);
+    frame.data = (uint8_t *)GST_VIDEO_FRAME_PLANE_DATA(&video_frame, 0);
+    frame.stride = GST_VIDEO_FRAME_PLANE_STRIDE(&video_frame, 0);
+    if (frame.format == OVERLAY_PIXEL_NV12 || frame.format == OVERLAY_PIXEL_NV16)
+    {
+        frame.uv = (uint8_t *)GST_VIDEO_FRAME_PLANE_DATA(&video_frame, 1);
+        frame.uv_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&video_frame, 1);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        const OverlayBox *box = &boxes[i];
+        OverlayColor color = overlay_class_color(box->class_id);
+        overlay_draw_box(&frame, box->left, box->top, box->right, box->bottom, self->thickness, color, NULL);
+
+        // Pre-rendered label on a bar of the box colour, baseline on the box top
+        if (self->atlas == NULL)
+        {
+            continue;
+        }
+        const LabelMask *label = self->atlas->label(box->class_id);
+        if (label == NULL && self->atlas->ready() && names[i] != NULL)
+        {
+            label = self->atlas->text(names[i]);
+        }
+        if (label != NULL)
+        {
+            overlay_draw_label(&frame, label, box->left, box->top, color, LABEL_TEXT_COLOR, NULL);
+        }
+    }
+
+    gst_video_frame_unmap(&video_frame);
+}
+
+static GstFlowReturn detection_overlay_transform_ip(GstBaseTransform *trans, GstBuffer *buffer)
+{
+    DetectionOverlay *self = (DetectionOverlay *)trans;
+    // As many as post_process() reports per frame
+    OverlayBox boxes[OBJ_NUMB_MAX_SIZE];
+    const char *names[OBJ_NUMB_MAX_SIZE];
+    int count = 0;
+    gpointer state = NULL;
+    GstMeta *meta;
+    while (count < OBJ_NUMB_MAX_SIZE &&
+           (meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE)) != NULL)
+    {
+        GstVideoRegionOfInterestMeta *roi = (GstVideoRegionOfInterestMeta *)meta;
+        GstStructure *params = gst_video_region_of_interest_meta_get_param(roi, DETECTION_META_PARAMS);
+        int class_id;
+        if (params == NULL || !gst_structure_get_int(params, DETECTION_META_CLASS_ID, &class_id))
+        {
+            continue; // someone else's region
+        }
+        boxes[count].left = roi->x;
+        boxes[count].top = roi->y;
+        boxes[count].right = roi->x + roi->w;
+        boxes[count].bottom = roi->y + roi->h;
+        boxes[count].class_id = class_id;
+        names[count] = g_quark_to_string(roi->roi_type);
+        count++;
+    }
+    if (count == 0)
+    {
+        return GST_FLOW_OK;
+    }
+
+    // Still shared when prepare_output_buffer() could not have RGA copy it
+    // (no RGA, no dma-heap, system memory): a write map swaps it for a
+    // private copy on the CPU before either backend draws
+    if (!gst_buffer_is_all_memory_writable(buffer))
+    {
+        GstMapInfo map;
+        if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+        {
+            return GST_FLOW_OK;
+        }
+        gst_buffer_unmap(buffer, &map);
+    }
+
+    // RGA fills the boxes and copies the labels without the CPU touching the
+    // frame; the CPU kernels draw when it cannot
+    if (self->rga_ready && self->rga_format >= 0 &&
+        rga_overlay_draw(buffer, &self->info, self->rga_format, boxes, count, self->thickness) == 0)
+    {
+        return GST_FLOW_OK;
+    }
+    if (self->backend != DETECTION_OVERLAY_RGA && self->overlay_format >= 0)
+    {
+        draw_cpu(self, buffer, boxes, names, count);
+    }
+    return GST_FLOW_OK;
+}
+
+static void detection_overlay_class_init(DetectionOverlayClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+
+    gobject_class->set_property = detection_overlay_set_property;
+    gobject_class->get_property = detection_overlay_get_property;
+    g_object_class_install_property(gobject_class, PROP_THICKNESS,
+                                    g_param_spec_int("thickness", "Thickness", "Box outline in pixels", 0, 64,
+                                                     OVERLAY_DEFAULT_THICKNESS,
+                                                     (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_BACKEND,
+                                    g_param_spec_int("backend", "Backend", "0 auto (RGA, CPU fallback), 1 RGA, 2 CPU",
+                                                     DETECTION_OVERLAY_AUTO, DETECTION_OVERLAY_CPU,
+                                                     DETECTION_OVERLAY_AUTO,
+                                                     (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_LABEL_ATLAS,
+                                    g_param_spec_pointer("label-atlas", "Label atlas",
+                                                         "LabelAtlas the labels are drawn from, NULL for boxes only",
+                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    gst_element_class_set_static_metadata(element_class, "Detection overlay", "Filter/Effect/Video",
+                                          "Draws the boxes and labels of detection region-of-interest metas",
+                                          "rknn-gstreamer-tutorial");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    transform_class->start = detection_overlay_start;
+    transform_class->stop = detection_overlay_stop;
+    transform_class->set_caps = detection_overlay_set_caps;
+    transform_class->prepare_output_buffer = detection_overlay_prepare_output_buffer;
+    transform_class->transform_ip = detection_overlay_transform_ip;
+}
+
+static void detection_overlay_init(DetectionOverlay *self)
+{
+    gst_base_transform_set_in_place(GST_BASE_TRANSFORM(self), TRUE);
+    self->thickness = OVERLAY_DEFAULT_THICKNESS;
+    self->backend = DETECTION_OVERLAY_AUTO;
+    self->atlas = NULL;
+    self->rga_ready = false;
+    self->overlay_format = -1;
+    self->rga_format = -1;
+    self->pool = NULL;
+    self->pool_size = 0;
+}
+
+gboolean detection_overlay_register()
+{
+    return gst_element_register(NULL, "detectionoverlay", GST_RANK_NONE, detection_overlay_get_type());
+}
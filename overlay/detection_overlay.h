@@ -0,0 +1,37 @@
+#ifndef _OVERLAY_DETECTION_OVERLAY_H_
+#define _OVERLAY_DETECTION_OVERLAY_H_
+
+#include <gst/gst.h>
+
+// Detections travel on the buffers as GstVideoRegionOfInterestMeta: roi_type
+// is the class name, and a "detection" parameter structure carries
+// "class-id" (int) and "confidence" (double). Encoders, recorders and app
+// sinks can read them without touching the pixels.
+#define DETECTION_META_PARAMS "detection"
+#define DETECTION_META_CLASS_ID "class-id"
+#define DETECTION_META_CONFIDENCE "confidence"
+
+// Formats the overlay draws on
+#define DETECTION_OVERLAY_FORMATS "{ NV12, NV16, BGRx, BGRA, RGBA, RGBx, RGB }"
+
+// Values of the "backend" property
+typedef enum _DetectionOverlayBackend
+{
+    DETECTION_OVERLAY_AUTO, // RGA, CPU kernels when RGA cannot draw a frame
+    DETECTION_OVERLAY_RGA,
+    DETECTION_OVERLAY_CPU,
+} DetectionOverlayBackend;
+
+// "detectionoverlay": an in-place filter drawing the boxes and labels of the
+// detection metas of each buffer, with overlay/rga_overlay.h or the CPU
+// overlay. Buffers without detections pass untouched. Properties:
+//   thickness    box outline in pixels
+//   backend      a DetectionOverlayBackend
+//   label-atlas  LabelAtlas * the labels are drawn from, NULL for boxes only;
+//                must outlive the element
+// A frame whose memory the decoder or another branch still holds is copied
+// by RGA into a dmabuf of the element's own pool and drawn there.
+// The RGA label layer is global, so one instance runs at a time.
+gboolean detection_overlay_register();
+
+#endif //_OVERLAY_DETECTION_OVERLAY_H_
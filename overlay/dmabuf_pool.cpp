@@ -0,0 +1,106 @@
+#include "overlay/dmabuf_pool.h"
+
+#include <fcntl.h>
+#include <gst/allocators/allocators.h>
+#include <linux/dma-heap.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// RGA2 only addresses the low 4GB, so the dma32 heap comes first
+static const char *const DMA_HEAPS[] = {"/dev/dma_heap/system-dma32", "/dev/dma_heap/system"};
+
+typedef struct _DmabufPool
+{
+    GstBufferPool parent;
+    int heap_fd;
+    gsize size;
+    GstAllocator *allocator;
+} DmabufPool;
+
+typedef struct _DmabufPoolClass
+{
+    GstBufferPoolClass parent_class;
+} DmabufPoolClass;
+
+GType dmabuf_pool_get_type();
+G_DEFINE_TYPE(DmabufPool, dmabuf_pool, GST_TYPE_BUFFER_POOL);
+
+static GstFlowReturn dmabuf_pool_alloc_buffer(GstBufferPool *pool, GstBuffer **buffer,
+                                              GstBufferPoolAcquireParams *params)
+{
+    DmabufPool *self = (DmabufPool *)pool;
+    struct dma_heap_allocation_data data;
+    memset(&data, 0, sizeof(data));
+    data.len = self->size;
+    data.fd_flags = O_RDWR | O_CLOEXEC;
+    if (ioctl(self->heap_fd, DMA_HEAP_IOCTL_ALLOC, &data) < 0)
+    {
+        return GST_FLOW_ERROR;
+    }
+    // the memory owns the fd from here on
+    GstMemory *mem = gst_dmabuf_allocator_alloc(self->allocator, data.fd, self->size);
+    if (mem == NULL)
+    {
+        close(data.fd);
+        return GST_FLOW_ERROR;
+    }
+    *buffer = gst_buffer_new();
+    gst_buffer_append_memory(*buffer, mem);
+    return GST_FLOW_OK;
+}
+
+static void dmabuf_pool_finalize(GObject *object)
+{
+    DmabufPool *self = (DmabufPool *)object;
+    if (self->heap_fd >= 0)
+    {
+        close(self->heap_fd);
+    }
+    if (self->allocator != NULL)
+    {
+        gst_object_unref(self->allocator);
+    }
+    G_OBJECT_CLASS(dmabuf_pool_parent_class)->finalize(object);
+}
+
+static void dmabuf_pool_class_init(DmabufPoolClass *klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = dmabuf_pool_finalize;
+    GST_BUFFER_POOL_CLASS(klass)->alloc_buffer = dmabuf_pool_alloc_buffer;
+}
+
+static void dmabuf_pool_init(DmabufPool *self)
+{
+    self->heap_fd = -1;
+    self->size = 0;
+    self->allocator = NULL;
+}
+
+GstBufferPool *dmabuf_pool_new(gsize size)
+{
+    int heap_fd = -1;
+    for (size_t i = 0; heap_fd < 0 && i < sizeof(DMA_HEAPS) / sizeof(DMA_HEAPS[0]); i++)
+    {
+        heap_fd = open(DMA_HEAPS[i], O_RDWR | O_CLOEXEC);
+    }
+    if (heap_fd < 0)
+    {
+        return NULL;
+    }
+    DmabufPool *self = (DmabufPool *)g_object_new(dmabuf_pool_get_type(), NULL);
+    gst_object_ref_sink(self);
+    self->heap_fd = heap_fd;
+    self->size = size;
+    self->allocator = gst_dmabuf_allocator_new();
+
+    GstBufferPool *pool = GST_BUFFER_POOL(self);
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, NULL, size, 0, 0);
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+    {
+        gst_object_unref(pool);
+        return NULL;
+    }
+    return pool;
+}
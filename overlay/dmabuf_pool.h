@@ -0,0 +1,12 @@
+#ifndef _OVERLAY_DMABUF_POOL_H_
+#define _OVERLAY_DMABUF_POOL_H_
+
+#include <gst/gst.h>
+
+// A GstBufferPool of single-memory dmabuf buffers of `size` bytes from a
+// Linux dma-heap, i.e. memory RGA reaches by fd and that no decoder or tee
+// branch also holds. Grows with the buffers in use downstream and reuses
+// them afterwards. Active on return; NULL without a usable dma-heap.
+GstBufferPool *dmabuf_pool_new(gsize size);
+
+#endif //_OVERLAY_DMABUF_POOL_H_
@@ -0,0 +1,176 @@
+#include "overlay/label_atlas.h"
+
+#include <string.h>
+
+#include <freetype2/ft2build.h>
+#include FT_FREETYPE_H
+
+LabelAtlas::LabelAtlas() : ready_(false), pixel_size_(0), ascent_(0), height_(0)
+{
+    memset(glyphs_, 0, sizeof(glyphs_));
+    memset(&text_, 0, sizeof(text_));
+}
+
+static bool cached(unsigned char c) { return c >= LABEL_ATLAS_FIRST_CHAR && c <= LABEL_ATLAS_LAST_CHAR; }
+
+// Width of `text` and where the pen starts, so that no glyph bitmap
+// sticks out on the left
+void LabelAtlas::measure(const char *text, int *width, int *pen_start) const
+{
+    int pen = 0, min_x = 0, max_x = 0;
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p)
+    {
+        if (!cached(*p))
+        {
+            continue;
+        }
+        const LabelGlyph *g = &glyphs_[*p];
+        if (pen + g->left < min_x)
+        {
+            min_x = pen + g->left;
+        }
+        if (pen + g->left + g->width > max_x)
+        {
+            max_x = pen + g->left + g->width;
+        }
+        pen += g->advance;
+    }
+    if (pen > max_x)
+    {
+        max_x = pen;
+    }
+    *pen_start = -min_x;
+    *width = max_x - min_x;
+}
+
+void LabelAtlas::compose(const char *text, int width, int pen_start, uint8_t *alpha) const
+{
+    memset(alpha, 0, (size_t)width * height_);
+    int pen = pen_start;
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p)
+    {
+        if (!cached(*p))
+        {
+            continue;
+        }
+        const LabelGlyph *g = &glyphs_[*p];
+        const uint8_t *src = &glyph_pixels_[g->offset];
+        for (int row = 0; row < g->rows; row++)
+        {
+            int y = ascent_ - g->top + row;
+            if (y < 0 || y >= height_)
+            {
+                continue;
+            }
+            uint8_t *dst = alpha + (size_t)y * width + pen + g->left;
+            for (int col = 0; col < g->width; col++)
+            {
+                // neighbouring glyphs may overlap by a pixel
+                if (src[row * g->width + col] > dst[col])
+                {
+                    dst[col] = src[row * g->width + col];
+                }
+            }
+        }
+        pen += g->advance;
+    }
+}
+
+int LabelAtlas::init(const char *font_path, int pixel_size, const char *const *labels, int count)
+{
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library))
+    {
+        return -1;
+    }
+    if (FT_New_Face(library, font_path, 0, &face))
+    {
+        FT_Done_FreeType(library);
+        return -1;
+    }
+    FT_Set_Pixel_Sizes(face, 0, pixel_size);
+    pixel_size_ = pixel_size;
+    ascent_ = (int)(face->size->metrics.ascender >> 6);
+    height_ = ascent_ - (int)(face->size->metrics.descender >> 6);
+
+    glyph_pixels_.clear();
+    for (int c = LABEL_ATLAS_FIRST_CHAR; c <= LABEL_ATLAS_LAST_CHAR; c++)
+    {
+        LabelGlyph *g = &glyphs_[c];
+        memset(g, 0, sizeof(*g));
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+        {
+            continue;
+        }
+        const FT_Bitmap *bitmap = &face->glyph->bitmap;
+        g->width = bitmap->width;
+        g->rows = bitmap->rows;
+        g->left = face->glyph->bitmap_left;
+        g->top = face->glyph->bitmap_top;
+        g->advance = (int)(face->glyph->advance.x >> 6);
+        g->offset = glyph_pixels_.size();
+        for (int row = 0; row < g->rows; row++)
+        {
+            const uint8_t *src = bitmap->buffer + row * bitmap->pitch;
+            glyph_pixels_.insert(glyph_pixels_.end(), src, src + g->width);
+        }
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+
+    // every label's alpha mask in one buffer; pointers are set once it stops
+    // growing
+    labels_.assign(count, LabelMask());
+    std::vector<size_t> offsets(count);
+    std::vector<int> pen_starts(count);
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        LabelMask *mask = &labels_[i];
+        measure(labels[i] != NULL ? labels[i] : "", &mask->width, &pen_starts[i]);
+        mask->height = height_;
+        mask->ascent = ascent_;
+        offsets[i] = total;
+        total += (size_t)mask->width * mask->height;
+    }
+    label_pixels_.assign(total, 0);
+    for (int i = 0; i < count; i++)
+    {
+        LabelMask *mask = &labels_[i];
+        uint8_t *alpha = label_pixels_.data() + offsets[i];
+        compose(labels[i] != NULL ? labels[i] : "", mask->width, pen_starts[i], alpha);
+        mask->alpha = alpha;
+    }
+    ready_ = true;
+    return 0;
+}
+
+const LabelMask *LabelAtlas::label(int class_id) const
+{
+    if (!ready_ || class_id < 0 || class_id >= (int)labels_.size())
+    {
+        return NULL;
+    }
+    return &labels_[class_id];
+}
+
+const LabelMask *LabelAtlas::text(const char *text)
+{
+    if (!ready_)
+    {
+        return NULL;
+    }
+    int pen_start;
+    measure(text, &text_.width, &pen_start);
+    text_.height = height_;
+    text_.ascent = ascent_;
+    size_t pixels = (size_t)text_.width * text_.height;
+    if (text_pixels_.size() < pixels)
+    {
+        text_pixels_.resize(pixels);
+    }
+    compose(text, text_.width, pen_start, text_pixels_.data());
+    text_.alpha = text_pixels_.data();
+    return &text_;
+}
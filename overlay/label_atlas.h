@@ -0,0 +1,70 @@
+#ifndef _OVERLAY_LABEL_ATLAS_H_
+#define _OVERLAY_LABEL_ATLAS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Glyphs rendered for ad-hoc text: printable ASCII
+#define LABEL_ATLAS_FIRST_CHAR 32
+#define LABEL_ATLAS_LAST_CHAR 126
+
+// One pre-rendered text: 8-bit coverage, `width` x `height`, rows packed.
+// `ascent` rows lie above the baseline the text is drawn at.
+typedef struct _LabelMask
+{
+    int width;
+    int height;
+    int ascent;
+    const uint8_t *alpha;
+} LabelMask;
+
+typedef struct _LabelGlyph
+{
+    int width;
+    int rows;
+    int left;    // bitmap offset from the pen
+    int top;     // bitmap rows above the baseline
+    int advance; // pen advance in pixels
+    size_t offset; // into the glyph bitmaps
+} LabelGlyph;
+
+// Detection labels rasterized once at startup. FreeType is only used by
+// init(): every class name is rendered at the configured pixel size into one
+// buffer, together with the printable ASCII glyphs for other text, so drawing
+// a label is a blend of a few rows (overlay_draw_label()). Read-only after
+// init(), except for text(), which composes into a scratch buffer.
+class LabelAtlas
+{
+public:
+    LabelAtlas();
+
+    // -1 when the font cannot be loaded; drawing then does nothing
+    int init(const char *font_path, int pixel_size, const char *const *labels, int count);
+    bool ready() const { return ready_; }
+    int pixel_size() const { return pixel_size_; }
+    int count() const { return (int)labels_.size(); }
+
+    // The pre-rendered label of a class, NULL past the label list
+    const LabelMask *label(int class_id) const;
+    // Any text, composed from the cached glyphs; valid until the next call
+    const LabelMask *text(const char *text);
+
+private:
+    void measure(const char *text, int *width, int *pen_start) const;
+    void compose(const char *text, int width, int pen_start, uint8_t *alpha) const;
+
+    bool ready_;
+    int pixel_size_;
+    int ascent_;
+    int height_;
+    LabelGlyph glyphs_[LABEL_ATLAS_LAST_CHAR + 1];
+    std::vector<uint8_t> glyph_pixels_;
+    std::vector<LabelMask> labels_;
+    std::vector<uint8_t> label_pixels_; // every label's alpha mask
+    LabelMask text_;
+    std::vector<uint8_t> text_pixels_;
+};
+
+#endif //_OVERLAY_LABEL_ATLAS_H_
@@ -0,0 +1,343 @@
+#include "overlay/overlay.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "overlay/overlay_kernels_internal.h"
+
+// Chroma spans narrower than this are written inline
+#define OVERLAY_MIN_KERNEL_SPAN 8
+
+// Per-thread scratch of blend_mask_yuv(): summed coverage of a chroma row
+static thread_local std::vector<uint16_t> chroma_coverage;
+
+// Byte positions of the channels; A < 0 when there is no alpha byte
+template <int BPP, int R, int G, int B, int A>
+struct PixelLayout
+{
+    enum
+    {
+        bpp = BPP,
+        r = R,
+        g = G,
+        b = B,
+        a = A,
+    };
+};
+
+typedef PixelLayout<3, 0, 1, 2, -1> LayoutRgb;
+typedef PixelLayout<4, 0, 1, 2, 3> LayoutRgba;
+typedef PixelLayout<4, 2, 1, 0, 3> LayoutBgra; // also BGRx
+
+// The colour as it is stored in the frame, opaque
+template <typename L>
+static inline void pack_pixel(OverlayColor color, uint8_t *pixel)
+{
+    pixel[L::r] = color.r;
+    pixel[L::g] = color.g;
+    pixel[L::b] = color.b;
+    if (L::a >= 0)
+    {
+        pixel[L::a] = 255;
+    }
+}
+
+// Clips [x, x + width) x [y, y + height) to the frame, false when nothing is left
+static bool clip_rect(const OverlayFrame *frame, int *x, int *y, int *width, int *height)
+{
+    int x0 = *x < 0 ? 0 : *x;
+    int y0 = *y < 0 ? 0 : *y;
+    int x1 = *x + *width > frame->width ? frame->width : *x + *width;
+    int y1 = *y + *height > frame->height ? frame->height : *y + *height;
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return false;
+    }
+    *x = x0;
+    *y = y0;
+    *width = x1 - x0;
+    *height = y1 - y0;
+    return true;
+}
+
+template <typename L>
+static void fill_rect(const OverlayFrame *frame, int x, int y, int width, int height, OverlayColor color,
+                      const OverlayKernels *kernels)
+{
+    if (!clip_rect(frame, &x, &y, &width, &height))
+    {
+        return;
+    }
+    uint8_t pixel[4];
+    pack_pixel<L>(color, pixel);
+    uint8_t *row = frame->data + (size_t)y * frame->stride + (size_t)x * L::bpp;
+    if (L::bpp == 4)
+    {
+        uint32_t pixel4;
+        memcpy(&pixel4, pixel, 4);
+        for (int i = 0; i < height; i++, row += frame->stride)
+        {
+            kernels->fill_span4(row, pixel4, width);
+        }
+        return;
+    }
+    // 3-byte pixels: build the first span by doubling copies, then copy it
+    memcpy(row, pixel, L::bpp);
+    size_t span = (size_t)width * L::bpp;
+    for (size_t done = L::bpp; done < span; done *= 2)
+    {
+        memcpy(row + done, row, done < span - done ? done : span - done);
+    }
+    for (int i = 1; i < height; i++)
+    {
+        memcpy(row + (size_t)i * frame->stride, row, span);
+    }
+}
+
+template <typename L>
+static void blend_mask(const OverlayFrame *frame, const uint8_t *mask, int mask_width, int mask_height,
+                       int mask_stride, int x, int y, OverlayColor color, const OverlayKernels *kernels)
+{
+    int cx = x, cy = y, width = mask_width, height = mask_height;
+    if (!clip_rect(frame, &cx, &cy, &width, &height))
+    {
+        return;
+    }
+    mask += (size_t)(cy - y) * mask_stride + (cx - x);
+    uint8_t pixel[4];
+    pack_pixel<L>(color, pixel);
+    uint8_t *row = frame->data + (size_t)cy * frame->stride + (size_t)cx * L::bpp;
+    if (L::bpp == 4)
+    {
+        uint32_t pixel4;
+        memcpy(&pixel4, pixel, 4);
+        for (int i = 0; i < height; i++, row += frame->stride, mask += mask_stride)
+        {
+            kernels->blend_span4(row, mask, pixel4, width);
+        }
+        return;
+    }
+    for (int i = 0; i < height; i++, row += frame->stride, mask += mask_stride)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            int a = mask[j];
+            if (a == 0)
+            {
+                continue;
+            }
+            uint8_t *d = row + j * L::bpp;
+            for (int k = 0; k < L::bpp; k++)
+            {
+                d[k] = overlay_blend_u8(d[k], pixel[k], a);
+            }
+        }
+    }
+}
+
+// BT.601 limited range, the inverse of the preprocessor's conversion
+static void color_to_yuv(OverlayColor color, uint8_t *y, uint8_t *u, uint8_t *v)
+{
+    *y = (uint8_t)(((66 * color.r + 129 * color.g + 25 * color.b + 128) >> 8) + 16);
+    *u = (uint8_t)(((-38 * color.r - 74 * color.g + 112 * color.b + 128) >> 8) + 128);
+    *v = (uint8_t)(((112 * color.r - 94 * color.g - 18 * color.b + 128) >> 8) + 128);
+}
+
+// Chroma samples covering luma [x, x + width) x [y, y + height), already
+// clipped; V_SHIFT is 1 for NV12, 0 for NV16
+template <int V_SHIFT>
+static void chroma_rect(int x, int y, int width, int height, int *cx, int *cy, int *cwidth, int *cheight)
+{
+    *cx = x >> 1;
+    *cy = y >> V_SHIFT;
+    *cwidth = ((x + width + 1) >> 1) - *cx;
+    *cheight = ((y + height + (1 << V_SHIFT) - 1) >> V_SHIFT) - *cy;
+}
+
+template <int V_SHIFT>
+static void fill_rect_yuv(const OverlayFrame *frame, int x, int y, int width, int height, OverlayColor color,
+                          const OverlayKernels *kernels)
+{
+    if (!clip_rect(frame, &x, &y, &width, &height))
+    {
+        return;
+    }
+    uint8_t luma, uv[4];
+    color_to_yuv(color, &luma, &uv[0], &uv[1]);
+    uv[2] = uv[0];
+    uv[3] = uv[1];
+    for (int i = 0; i < height; i++)
+    {
+        memset(frame->data + (size_t)(y + i) * frame->stride + x, luma, width);
+    }
+
+    // two UV pairs per 4-byte store, plus an odd one
+    int cx, cy, cwidth, cheight;
+    chroma_rect<V_SHIFT>(x, y, width, height, &cx, &cy, &cwidth, &cheight);
+    uint32_t pair2;
+    memcpy(&pair2, uv, 4);
+    for (int i = 0; i < cheight; i++)
+    {
+        uint8_t *row = frame->uv + (size_t)(cy + i) * frame->uv_stride + (size_t)cx * 2;
+        int j = 0;
+        if (cwidth >= OVERLAY_MIN_KERNEL_SPAN)
+        {
+            kernels->fill_span4(row, pair2, cwidth / 2);
+            j = cwidth & ~1;
+        }
+        // box sides are a sample or two wide: not worth a call per row
+        for (; j < cwidth; j++)
+        {
+            row[j * 2] = uv[0];
+            row[j * 2 + 1] = uv[1];
+        }
+    }
+}
+
+template <int V_SHIFT>
+static void blend_mask_yuv(const OverlayFrame *frame, const uint8_t *mask, int mask_width, int mask_height,
+                           int mask_stride, int x, int y, OverlayColor color, const OverlayKernels *kernels)
+{
+    int cx0 = x, cy0 = y, width = mask_width, height = mask_height;
+    if (!clip_rect(frame, &cx0, &cy0, &width, &height))
+    {
+        return;
+    }
+    const uint8_t *clipped = mask + (size_t)(cy0 - y) * mask_stride + (cx0 - x);
+    uint8_t luma, u, v;
+    color_to_yuv(color, &luma, &u, &v);
+    for (int i = 0; i < height; i++)
+    {
+        kernels->blend_span1(frame->data + (size_t)(cy0 + i) * frame->stride + cx0, clipped + (size_t)i * mask_stride,
+                             luma, width);
+    }
+
+    // A chroma sample takes the mean coverage of its luma block; pixels
+    // outside the clipped mask count as uncovered
+    const int block = 2 << V_SHIFT;
+    int cx, cy, cwidth, cheight;
+    chroma_rect<V_SHIFT>(cx0, cy0, width, height, &cx, &cy, &cwidth, &cheight);
+    chroma_coverage.resize(cwidth);
+    uint16_t *coverage = chroma_coverage.data();
+    for (int i = 0; i < cheight; i++)
+    {
+        memset(coverage, 0, cwidth * sizeof(uint16_t));
+        int row_begin = (cy + i) << V_SHIFT;
+        int row_end = (cy + i + 1) << V_SHIFT;
+        for (int by = row_begin < cy0 ? cy0 : row_begin; by < row_end && by < cy0 + height; by++)
+        {
+            // an odd first column is the right half of its block
+            const uint8_t *m = clipped + (size_t)(by - cy0) * mask_stride;
+            int k = cx0 & 1;
+            uint16_t *sum = coverage;
+            if (k)
+            {
+                *sum++ += m[0];
+            }
+            for (; k + 2 <= width; k += 2)
+            {
+                *sum++ += m[k] + m[k + 1];
+            }
+            if (k < width)
+            {
+                *sum += m[k];
+            }
+        }
+        uint8_t *row = frame->uv + (size_t)(cy + i) * frame->uv_stride + (size_t)cx * 2;
+        for (int j = 0; j < cwidth; j++)
+        {
+            int a = (coverage[j] + block / 2) >> (1 + V_SHIFT);
+            if (a != 0)
+            {
+                row[j * 2] = overlay_blend_u8(row[j * 2], u, a);
+                row[j * 2 + 1] = overlay_blend_u8(row[j * 2 + 1], v, a);
+            }
+        }
+    }
+}
+
+// Calls FN<layout>(frame, args...), or FN_yuv<V_SHIFT> for semi-planar
+// frames, for the frame's format
+#define OVERLAY_DISPATCH(FN, frame, ...)            \
+    switch ((frame)->format)                        \
+    {                                               \
+    case OVERLAY_PIXEL_RGB:                         \
+        FN<LayoutRgb>(frame, __VA_ARGS__);          \
+        break;                                      \
+    case OVERLAY_PIXEL_RGBA:                        \
+        FN<LayoutRgba>(frame, __VA_ARGS__);         \
+        break;                                      \
+    case OVERLAY_PIXEL_BGRA:                        \
+    case OVERLAY_PIXEL_BGRX:                        \
+        FN<LayoutBgra>(frame, __VA_ARGS__);         \
+        break;                                      \
+    case OVERLAY_PIXEL_NV12:                        \
+        FN##_yuv<1>(frame, __VA_ARGS__);            \
+        break;                                      \
+    case OVERLAY_PIXEL_NV16:                        \
+        FN##_yuv<0>(frame, __VA_ARGS__);            \
+        break;                                      \
+    }
+
+OverlayColor overlay_class_color(int class_id)
+{
+    // 20 colours, distinct enough side by side, cycled over the classes
+    static const OverlayColor palette[] = {
+        {0xff, 0x38, 0x38}, {0xff, 0x9d, 0x97}, {0xff, 0x70, 0x1f}, {0xff, 0xb2, 0x1d}, {0xcf, 0xd2, 0x31},
+        {0x48, 0xf9, 0x0a}, {0x92, 0xcc, 0x17}, {0x3d, 0xdb, 0x86}, {0x1a, 0x93, 0x34}, {0x00, 0xd4, 0xbb},
+        {0x2c, 0x99, 0xa8}, {0x00, 0xc2, 0xff}, {0x34, 0x45, 0x93}, {0x64, 0x73, 0xff}, {0x00, 0x18, 0xec},
+        {0x84, 0x38, 0xff}, {0x52, 0x00, 0x85}, {0xcb, 0x38, 0xff}, {0xff, 0x95, 0xc8}, {0xff, 0x37, 0xc7},
+    };
+    int n = sizeof(palette) / sizeof(palette[0]);
+    return palette[(class_id % n + n) % n];
+}
+
+void overlay_fill_rect(const OverlayFrame *frame, int x, int y, int width, int height, OverlayColor color,
+                       const OverlayKernels *kernels)
+{
+    if (kernels == NULL)
+    {
+        kernels = overlay_kernels_best();
+    }
+    OVERLAY_DISPATCH(fill_rect, frame, x, y, width, height, color, kernels);
+}
+
+void overlay_draw_box(const OverlayFrame *frame, int left, int top, int right, int bottom, int thickness,
+                      OverlayColor color, const OverlayKernels *kernels)
+{
+    int width = right - left;
+    int height = bottom - top;
+    if (width <= 0 || height <= 0 || thickness <= 0)
+    {
+        return;
+    }
+    if (2 * thickness >= width || 2 * thickness >= height)
+    {
+        overlay_fill_rect(frame, left, top, width, height, color, kernels);
+        return;
+    }
+    // top and bottom spans full width, the sides in between
+    overlay_fill_rect(frame, left, top, width, thickness, color, kernels);
+    overlay_fill_rect(frame, left, bottom - thickness, width, thickness, color, kernels);
+    overlay_fill_rect(frame, left, top + thickness, thickness, height - 2 * thickness, color, kernels);
+    overlay_fill_rect(frame, right - thickness, top + thickness, thickness, height - 2 * thickness, color, kernels);
+}
+
+void overlay_blend_mask(const OverlayFrame *frame, const uint8_t *mask, int mask_width, int mask_height,
+                        int mask_stride, int x, int y, OverlayColor color, const OverlayKernels *kernels)
+{
+    if (kernels == NULL)
+    {
+        kernels = overlay_kernels_best();
+    }
+    OVERLAY_DISPATCH(blend_mask, frame, mask, mask_width, mask_height, mask_stride, x, y, color, kernels);
+}
+
+void overlay_draw_label(const OverlayFrame *frame, const LabelMask *label, int x, int y, OverlayColor background,
+                        OverlayColor text, const OverlayKernels *kernels)
+{
+    int top = y - label->ascent;
+    overlay_fill_rect(frame, x, top, label->width, label->height, background, kernels);
+    overlay_blend_mask(frame, label->alpha, label->width, label->height, label->width, x, top, text, kernels);
+}
@@ -0,0 +1,77 @@
+#ifndef _OVERLAY_OVERLAY_H_
+#define _OVERLAY_OVERLAY_H_
+
+#include <stdint.h>
+
+#include "overlay/label_atlas.h"
+#include "overlay/overlay_kernels.h"
+
+#define OVERLAY_DEFAULT_THICKNESS 2
+
+typedef enum _OverlayPixelFormat
+{
+    OVERLAY_PIXEL_RGB,
+    OVERLAY_PIXEL_RGBA,
+    OVERLAY_PIXEL_BGRA,
+    OVERLAY_PIXEL_BGRX, // the padding byte is written like an alpha byte
+    OVERLAY_PIXEL_NV12, // Y plane + interleaved UV plane at half width and height
+    OVERLAY_PIXEL_NV16, // Y plane + interleaved UV plane at half width
+} OverlayPixelFormat;
+
+typedef struct _OverlayFrame
+{
+    OverlayPixelFormat format;
+    int width;
+    int height;
+    uint8_t *data; // pixels, or the Y plane
+    int stride;    // bytes per row
+    uint8_t *uv;   // NV12/NV16 only
+    int uv_stride;
+} OverlayFrame;
+
+typedef struct _OverlayColor
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} OverlayColor;
+
+// A detection as drawn: corners in frame pixels, and the class picking its
+// colour and label
+typedef struct _OverlayBox
+{
+    int left;
+    int top;
+    int right;
+    int bottom;
+    int class_id;
+} OverlayBox;
+
+// Drawing on packed and semi-planar frames, specialised per pixel layout.
+// Everything is clipped to the frame, so boxes and labels may run past its
+// edges. Rows are drawn as spans through `kernels` (overlay_kernels_best()
+// when NULL) on 4-byte formats and on NV12/NV16 luma; RGB uses scalar spans.
+// On NV12/NV16 colours are converted to BT.601 limited range, as the
+// preprocessor reads them, and chroma is written for every 2x2 (2x1) block a
+// shape touches, so it may bleed a pixel past odd edges.
+
+// Colour of a class, from a fixed palette
+OverlayColor overlay_class_color(int class_id);
+
+void overlay_fill_rect(const OverlayFrame *frame, int x, int y, int width, int height, OverlayColor color,
+                       const OverlayKernels *kernels);
+
+// Outline of [left, right) x [top, bottom), `thickness` pixels inwards
+void overlay_draw_box(const OverlayFrame *frame, int left, int top, int right, int bottom, int thickness,
+                      OverlayColor color, const OverlayKernels *kernels);
+
+// Blends `color` over the frame with `mask` (8-bit coverage, `mask_stride`
+// bytes per row) as alpha, its top-left corner at (x, y)
+void overlay_blend_mask(const OverlayFrame *frame, const uint8_t *mask, int mask_width, int mask_height,
+                        int mask_stride, int x, int y, OverlayColor color, const OverlayKernels *kernels);
+
+// A label on a `background` bar, text blended in `text`, baseline at (x, y)
+void overlay_draw_label(const OverlayFrame *frame, const LabelMask *label, int x, int y, OverlayColor background,
+                        OverlayColor text, const OverlayKernels *kernels);
+
+#endif //_OVERLAY_OVERLAY_H_
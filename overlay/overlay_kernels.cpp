@@ -0,0 +1,90 @@
+#include "overlay/overlay_kernels_internal.h"
+
+#include <stddef.h>
+#include <string.h>
+
+void overlay_fill_span4_c(uint8_t *dst, uint32_t pixel, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(dst + i * 4, &pixel, 4);
+    }
+}
+
+void overlay_blend_span4_c(uint8_t *dst, const uint8_t *mask, uint32_t pixel, int n)
+{
+    uint8_t c[4];
+    memcpy(c, &pixel, 4);
+    for (int i = 0; i < n; i++)
+    {
+        int a = mask[i];
+        if (a == 0)
+        {
+            continue;
+        }
+        uint8_t *d = dst + i * 4;
+        d[0] = overlay_blend_u8(d[0], c[0], a);
+        d[1] = overlay_blend_u8(d[1], c[1], a);
+        d[2] = overlay_blend_u8(d[2], c[2], a);
+        d[3] = overlay_blend_u8(d[3], c[3], a);
+    }
+}
+
+void overlay_blend_span1_c(uint8_t *dst, const uint8_t *mask, uint8_t value, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (mask[i] != 0)
+        {
+            dst[i] = overlay_blend_u8(dst[i], value, mask[i]);
+        }
+    }
+}
+
+static const OverlayKernels OVERLAY_KERNELS_SCALAR = {CPU_ISA_SCALAR, "scalar", overlay_fill_span4_c,
+                                                      overlay_blend_span4_c, overlay_blend_span1_c};
+
+const OverlayKernels *overlay_kernels_get(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CPU_ISA_SCALAR:
+        return &OVERLAY_KERNELS_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+    case CPU_ISA_SSE41:
+        return __builtin_cpu_supports("sse4.1") ? &OVERLAY_KERNELS_SSE41 : NULL;
+    case CPU_ISA_AVX2:
+        return __builtin_cpu_supports("avx2") ? &OVERLAY_KERNELS_AVX2 : NULL;
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    case CPU_ISA_NEON:
+        return &OVERLAY_KERNELS_NEON;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static const OverlayKernels *pick_best()
+{
+    // SSE4.1 over AVX2, as for the decode kernels: spans are short (box
+    // edges, label rows), so 32-byte vectors win little in optimised builds
+    // and lose unoptimised; both stay selectable through overlay_kernels_get()
+    static const CpuIsa preference[] = {CPU_ISA_NEON, CPU_ISA_SSE41, CPU_ISA_AVX2, CPU_ISA_SCALAR};
+    for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); i++)
+    {
+        const OverlayKernels *kernels = overlay_kernels_get(preference[i]);
+        if (kernels != NULL)
+        {
+            return kernels;
+        }
+    }
+    return NULL;
+}
+
+const OverlayKernels *overlay_kernels_best()
+{
+    // Static local: safe when several threads ask first at the same time
+    static const OverlayKernels *best = pick_best();
+    return best;
+}
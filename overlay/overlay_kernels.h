@@ -0,0 +1,32 @@
+#ifndef _OVERLAY_OVERLAY_KERNELS_H_
+#define _OVERLAY_OVERLAY_KERNELS_H_
+
+#include <stdint.h>
+
+#include "preprocess/cpu_kernels.h"
+
+// Span kernels of the overlay, one table per instruction set. `pixel` is the
+// colour as the 4 bytes of a packed pixel appear in the frame, read as a
+// native uint32_t, so the kernels need not know the channel order; 1-byte
+// spans are planes such as luma. Every variant writes exactly what the
+// scalar one writes.
+typedef struct _OverlayKernels
+{
+    CpuIsa isa;
+    const char *name;
+    // dst[0..n-1] = pixel
+    void (*fill_span4)(uint8_t *dst, uint32_t pixel, int n);
+    // Blends pixel over dst[0..n-1], mask[i] being the coverage of pixel i:
+    // per byte (d * (255 - a) + c * a) / 255, rounded to nearest
+    void (*blend_span4)(uint8_t *dst, const uint8_t *mask, uint32_t pixel, int n);
+    // Same on single bytes: dst[i] blended towards value with mask[i]
+    void (*blend_span1)(uint8_t *dst, const uint8_t *mask, uint8_t value, int n);
+} OverlayKernels;
+
+// NULL when `isa` is not built in or not supported by the running CPU
+const OverlayKernels *overlay_kernels_get(CpuIsa isa);
+
+// Fastest kernels usable on the running CPU, detected once
+const OverlayKernels *overlay_kernels_best();
+
+#endif //_OVERLAY_OVERLAY_KERNELS_H_
@@ -0,0 +1,27 @@
+#ifndef _OVERLAY_OVERLAY_KERNELS_INTERNAL_H_
+#define _OVERLAY_OVERLAY_KERNELS_INTERNAL_H_
+
+#include "overlay/overlay_kernels.h"
+
+// (d * (255 - a) + c * a) / 255 rounded, without a division. Every
+// intermediate fits in 16 bits, so the SIMD kernels compute the same.
+static inline uint8_t overlay_blend_u8(int d, int c, int a)
+{
+    int v = d * (255 - a) + c * a + 128;
+    return (uint8_t)((v + (v >> 8)) >> 8);
+}
+
+// Scalar reference kernels, also used for the tails of the SIMD spans
+void overlay_fill_span4_c(uint8_t *dst, uint32_t pixel, int n);
+void overlay_blend_span4_c(uint8_t *dst, const uint8_t *mask, uint32_t pixel, int n);
+void overlay_blend_span1_c(uint8_t *dst, const uint8_t *mask, uint8_t value, int n);
+
+#if defined(__x86_64__) || defined(__i386__)
+extern const OverlayKernels OVERLAY_KERNELS_SSE41;
+extern const OverlayKernels OVERLAY_KERNELS_AVX2;
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+extern const OverlayKernels OVERLAY_KERNELS_NEON;
+#endif
+
+#endif //_OVERLAY_OVERLAY_KERNELS_INTERNAL_H_
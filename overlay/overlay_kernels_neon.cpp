@@ -0,0 +1,79 @@
+#include "overlay/overlay_kernels_internal.h"
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+
+#include <string.h>
+
+#include <arm_neon.h>
+
+static void fill_span4_neon(uint8_t *dst, uint32_t pixel, int n)
+{
+    const uint8x16_t v = vreinterpretq_u8_u32(vdupq_n_u32(pixel));
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        vst1q_u8(dst + i * 4, v);
+        vst1q_u8(dst + i * 4 + 16, v);
+    }
+    overlay_fill_span4_c(dst + i * 4, pixel, n - i);
+}
+
+static inline uint8x8_t blend_u8_neon(uint8x8_t d, uint8x8_t c, uint8x8_t a, uint8x8_t inv_a)
+{
+    uint16x8_t v = vmlal_u8(vmull_u8(d, inv_a), c, a);
+    v = vaddq_u16(v, vdupq_n_u16(128));
+    return vshrn_n_u16(vsraq_n_u16(v, v, 8), 8);
+}
+
+static void blend_span4_neon(uint8_t *dst, const uint8_t *mask, uint32_t pixel, int n)
+{
+    uint8_t c[4];
+    memcpy(c, &pixel, 4);
+    const uint8x8_t c0 = vdup_n_u8(c[0]);
+    const uint8x8_t c1 = vdup_n_u8(c[1]);
+    const uint8x8_t c2 = vdup_n_u8(c[2]);
+    const uint8x8_t c3 = vdup_n_u8(c[3]);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint8x8_t a = vld1_u8(mask + i);
+        if (vget_lane_u64(vreinterpret_u64_u8(a), 0) == 0)
+        {
+            continue; // glyph masks are mostly empty
+        }
+        // one register per byte of the pixel: the coverage applies as is
+        uint8x8_t inv_a = vmvn_u8(a);
+        uint8x8x4_t d = vld4_u8(dst + i * 4);
+        d.val[0] = blend_u8_neon(d.val[0], c0, a, inv_a);
+        d.val[1] = blend_u8_neon(d.val[1], c1, a, inv_a);
+        d.val[2] = blend_u8_neon(d.val[2], c2, a, inv_a);
+        d.val[3] = blend_u8_neon(d.val[3], c3, a, inv_a);
+        vst4_u8(dst + i * 4, d);
+    }
+    overlay_blend_span4_c(dst + i * 4, mask + i, pixel, n - i);
+}
+
+static void blend_span1_neon(uint8_t *dst, const uint8_t *mask, uint8_t value, int n)
+{
+    const uint8x8_t c = vdup_n_u8(value);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t a = vld1q_u8(mask + i);
+        if (vget_lane_u64(vreinterpret_u64_u8(vorr_u8(vget_low_u8(a), vget_high_u8(a))), 0) == 0)
+        {
+            continue;
+        }
+        uint8x16_t inv_a = vmvnq_u8(a);
+        uint8x16_t d = vld1q_u8(dst + i);
+        uint8x8_t lo = blend_u8_neon(vget_low_u8(d), c, vget_low_u8(a), vget_low_u8(inv_a));
+        uint8x8_t hi = blend_u8_neon(vget_high_u8(d), c, vget_high_u8(a), vget_high_u8(inv_a));
+        vst1q_u8(dst + i, vcombine_u8(lo, hi));
+    }
+    overlay_blend_span1_c(dst + i, mask + i, value, n - i);
+}
+
+const OverlayKernels OVERLAY_KERNELS_NEON = {CPU_ISA_NEON, "neon", fill_span4_neon, blend_span4_neon,
+                                             blend_span1_neon};
+
+#endif
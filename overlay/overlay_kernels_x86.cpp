@@ -0,0 +1,167 @@
+#include "overlay/overlay_kernels_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <string.h>
+
+#include <immintrin.h>
+
+// Built with per-function target attributes so the rest of the program keeps
+// the baseline ISA; overlay_kernels_get() checks the CPU before handing these out.
+#define SSE41_FN __attribute__((target("sse4.1")))
+#define AVX2_FN __attribute__((target("avx2")))
+// SSE4.1 code the AVX2 kernels share: always inlined, so it comes out
+// VEX-encoded there instead of as calls into legacy SSE code (an SSE/AVX
+// transition on every call, and nothing is inlined at -O0)
+#define SSE41_INLINE __attribute__((target("sse4.1"), always_inline)) static inline
+
+SSE41_FN static void fill_span4_sse41(uint8_t *dst, uint32_t pixel, int n)
+{
+    const __m128i v = _mm_set1_epi32((int)pixel);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(dst + i * 4), v);
+    }
+    overlay_fill_span4_c(dst + i * 4, pixel, n - i);
+}
+
+// Blends the 16-bit lanes of 8 bytes: d, c and a each widened the same way
+SSE41_INLINE __m128i blend_epi16_sse41(__m128i d, __m128i c, __m128i a)
+{
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i round = _mm_set1_epi16(128);
+    __m128i v = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(full, a)), _mm_mullo_epi16(c, a));
+    v = _mm_add_epi16(v, round);
+    return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+}
+
+SSE41_INLINE void blend_span4_128(uint8_t *dst, const uint8_t *mask, uint32_t pixel, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i spread = _mm_set1_epi32(0x01010101);
+    const __m128i c = _mm_set1_epi32((int)pixel);
+    const __m128i c_lo = _mm_unpacklo_epi8(c, zero);
+    const __m128i c_hi = _mm_unpackhi_epi8(c, zero);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        int32_t m4;
+        memcpy(&m4, mask + i, 4);
+        if (m4 == 0)
+        {
+            continue; // glyph masks are mostly empty
+        }
+        // the coverage of each pixel in all 4 of its bytes
+        __m128i a = _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(m4)), spread);
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i * 4));
+        __m128i lo = blend_epi16_sse41(_mm_unpacklo_epi8(d, zero), c_lo, _mm_unpacklo_epi8(a, zero));
+        __m128i hi = blend_epi16_sse41(_mm_unpackhi_epi8(d, zero), c_hi, _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    overlay_blend_span4_c(dst + i * 4, mask + i, pixel, n - i);
+}
+
+SSE41_FN static void blend_span4_sse41(uint8_t *dst, const uint8_t *mask, uint32_t pixel, int n)
+{
+    blend_span4_128(dst, mask, pixel, n);
+}
+
+SSE41_INLINE void blend_span1_128(uint8_t *dst, const uint8_t *mask, uint8_t value, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c = _mm_set1_epi16(value);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(mask + i));
+        if (_mm_testz_si128(a, a))
+        {
+            continue;
+        }
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = blend_epi16_sse41(_mm_unpacklo_epi8(d, zero), c, _mm_unpacklo_epi8(a, zero));
+        __m128i hi = blend_epi16_sse41(_mm_unpackhi_epi8(d, zero), c, _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    overlay_blend_span1_c(dst + i, mask + i, value, n - i);
+}
+
+SSE41_FN static void blend_span1_sse41(uint8_t *dst, const uint8_t *mask, uint8_t value, int n)
+{
+    blend_span1_128(dst, mask, value, n);
+}
+
+const OverlayKernels OVERLAY_KERNELS_SSE41 = {CPU_ISA_SSE41, "sse4.1", fill_span4_sse41, blend_span4_sse41,
+                                              blend_span1_sse41};
+
+AVX2_FN static void fill_span4_avx2(uint8_t *dst, uint32_t pixel, int n)
+{
+    const __m256i v = _mm256_set1_epi32((int)pixel);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), v);
+    }
+    overlay_fill_span4_c(dst + i * 4, pixel, n - i);
+}
+
+AVX2_FN static inline __m256i blend_epi16_avx2(__m256i d, __m256i c, __m256i a)
+{
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i round = _mm256_set1_epi16(128);
+    __m256i v = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(full, a)), _mm256_mullo_epi16(c, a));
+    v = _mm256_add_epi16(v, round);
+    return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+}
+
+AVX2_FN static void blend_span4_avx2(uint8_t *dst, const uint8_t *mask, uint32_t pixel, int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i spread = _mm256_set1_epi32(0x01010101);
+    const __m256i c = _mm256_set1_epi32((int)pixel);
+    const __m256i c_lo = _mm256_unpacklo_epi8(c, zero);
+    const __m256i c_hi = _mm256_unpackhi_epi8(c, zero);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        int64_t m8;
+        memcpy(&m8, mask + i, 8);
+        if (m8 == 0)
+        {
+            continue;
+        }
+        // unpack and pack work within 128-bit lanes, so the order comes back
+        __m256i a = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(mask + i))), spread);
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i * 4));
+        __m256i lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero), c_lo, _mm256_unpacklo_epi8(a, zero));
+        __m256i hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero), c_hi, _mm256_unpackhi_epi8(a, zero));
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    blend_span4_128(dst + i * 4, mask + i, pixel, n - i);
+}
+
+AVX2_FN static void blend_span1_avx2(uint8_t *dst, const uint8_t *mask, uint8_t value, int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c = _mm256_set1_epi16(value);
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(mask + i));
+        if (_mm256_testz_si256(a, a))
+        {
+            continue;
+        }
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero), c, _mm256_unpacklo_epi8(a, zero));
+        __m256i hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero), c, _mm256_unpackhi_epi8(a, zero));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    blend_span1_128(dst + i, mask + i, value, n - i);
+}
+
+const OverlayKernels OVERLAY_KERNELS_AVX2 = {CPU_ISA_AVX2, "avx2", fill_span4_avx2, blend_span4_avx2,
+                                             blend_span1_avx2};
+
+#endif
@@ -0,0 +1,312 @@
+#include "overlay/rga_overlay.h"
+#include "preprocess/rga_import.h"
+
+#include <rga/im2d.h>
+#include <string.h>
+
+#include <vector>
+
+// Tasks per RGA job; the driver caps how many a single job may carry
+#define RGA_OVERLAY_JOB_TASKS 32
+
+typedef struct _LayerLabel
+{
+    im_rect rect; // in the layer, even-sized
+    int ascent;
+} LayerLabel;
+
+// The label layer, set up by rga_overlay_init() and read-only afterwards
+static bool initialized = false;
+static std::vector<uint8_t> layer_pixels;
+static int layer_width = 0;
+static int layer_height = 0;
+static std::vector<LayerLabel> layer_labels;
+static rga_buffer_handle_t layer_handle = 0;
+
+typedef struct _OverlayJob
+{
+    im_job_handle_t handle;
+    int tasks;
+    bool failed;
+} OverlayJob;
+
+static int align_down2(int v) { return v & ~1; }
+
+static int align_up2(int v) { return (v + 1) & ~1; }
+
+// Fill colours are given as an RGBA8888 pixel, R in the low byte; RGA
+// converts them for YUV destinations
+static uint32_t fill_color(OverlayColor color)
+{
+    return 0xff000000u | (uint32_t)color.b << 16 | (uint32_t)color.g << 8 | (uint32_t)color.r;
+}
+
+int rga_overlay_init(const LabelAtlas *atlas, int count, OverlayColor text)
+{
+    rga_overlay_deinit();
+
+    // One label under the other, each padded to even width and height
+    layer_labels.resize(count);
+    for (int i = 0; atlas->ready() && i < count; i++)
+    {
+        const LabelMask *label = atlas->label(i);
+        int width = label != NULL ? align_up2(label->width) : 0;
+        int height = label != NULL ? align_up2(label->height) : 0;
+        layer_labels[i].rect = {0, layer_height, width, height};
+        layer_labels[i].ascent = label != NULL ? label->ascent : 0;
+        layer_width = width > layer_width ? width : layer_width;
+        layer_height += height;
+    }
+    if (layer_width == 0 || layer_height == 0)
+    {
+        layer_labels.clear();
+        initialized = true;
+        return 0;
+    }
+
+    // Drawn with the CPU overlay, so a label looks as overlay_draw_label() draws it
+    layer_pixels.assign((size_t)layer_width * layer_height * 4, 0);
+    OverlayFrame layer;
+    memset(&layer, 0, sizeof(layer));
+    layer.format = OVERLAY_PIXEL_RGBA;
+    layer.width = layer_width;
+    layer.height = layer_height;
+    layer.data = layer_pixels.data();
+    layer.stride = layer_width * 4;
+    for (int i = 0; i < count; i++)
+    {
+        const LabelMask *label = atlas->label(i);
+        const im_rect &rect = layer_labels[i].rect;
+        if (rect.width == 0 || rect.height == 0)
+        {
+            continue;
+        }
+        overlay_fill_rect(&layer, 0, rect.y, rect.width, rect.height, overlay_class_color(i), NULL);
+        overlay_blend_mask(&layer, label->alpha, label->width, label->height, label->width, 0, rect.y, text, NULL);
+    }
+
+    layer_handle = importbuffer_virtualaddr(layer_pixels.data(), layer_pixels.size());
+    if (layer_handle == 0)
+    {
+        rga_overlay_deinit();
+        return -1;
+    }
+    initialized = true;
+    return 0;
+}
+
+static void job_begin(OverlayJob *job)
+{
+    job->handle = imbeginJob();
+    job->tasks = 0;
+    job->failed = job->handle == 0;
+}
+
+static void job_end(OverlayJob *job)
+{
+    if (job->failed || job->tasks == 0)
+    {
+        if (job->handle != 0)
+        {
+            imcancelJob(job->handle);
+        }
+    }
+    else if (imendJob(job->handle) != IM_STATUS_SUCCESS)
+    {
+        job->failed = true;
+    }
+    job->handle = 0;
+}
+
+// Starts the next job once this one is full
+static bool job_reserve(OverlayJob *job)
+{
+    if (job->failed)
+    {
+        return false;
+    }
+    if (job->tasks == RGA_OVERLAY_JOB_TASKS)
+    {
+        job_end(job);
+        if (!job->failed)
+        {
+            job_begin(job);
+        }
+    }
+    return !job->failed;
+}
+
+// Fills a rectangle rounded outwards to even coordinates, clipped to the
+// (even) frame bounds
+static void job_fill(OverlayJob *job, rga_buffer_t dst, int frame_width, int frame_height, int x, int y, int width,
+                     int height, uint32_t color)
+{
+    int x0 = align_down2(x);
+    int y0 = align_down2(y);
+    int x1 = align_up2(x + width);
+    int y1 = align_up2(y + height);
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > frame_width ? frame_width : x1;
+    y1 = y1 > frame_height ? frame_height : y1;
+    if (x1 <= x0 || y1 <= y0 || !job_reserve(job))
+    {
+        return;
+    }
+    im_rect rect = {x0, y0, x1 - x0, y1 - y0};
+    if (imfillTask(job->handle, dst, rect, color) != IM_STATUS_SUCCESS)
+    {
+        job->failed = true;
+    }
+    else
+    {
+        job->tasks++;
+    }
+}
+
+// Copies a class's label out of the layer, baseline at (x, y)
+static void job_label(OverlayJob *job, rga_buffer_t layer, rga_buffer_t dst, int frame_width, int frame_height,
+                      const LayerLabel *label, int x, int y)
+{
+    int x0 = align_down2(x);
+    int y0 = align_down2(y - label->ascent);
+    int cx0 = x0 < 0 ? 0 : x0;
+    int cy0 = y0 < 0 ? 0 : y0;
+    int cx1 = x0 + label->rect.width > frame_width ? frame_width : x0 + label->rect.width;
+    int cy1 = y0 + label->rect.height > frame_height ? frame_height : y0 + label->rect.height;
+    if (cx1 <= cx0 || cy1 <= cy0 || !job_reserve(job))
+    {
+        return;
+    }
+    im_rect src_rect = {label->rect.x + cx0 - x0, label->rect.y + cy0 - y0, cx1 - cx0, cy1 - cy0};
+    im_rect dst_rect = {cx0, cy0, cx1 - cx0, cy1 - cy0};
+    // The bar is opaque, so a copy (with colour conversion) draws the label
+    if (improcessTask(job->handle, layer, dst, {}, src_rect, dst_rect, {}, NULL, 0) != IM_STATUS_SUCCESS)
+    {
+        job->failed = true;
+    }
+    else
+    {
+        job->tasks++;
+    }
+}
+
+int rga_overlay_draw(GstBuffer *buffer, const GstVideoInfo *info, int rga_format, const OverlayBox *boxes, int count,
+                     int thickness)
+{
+    if (!initialized)
+    {
+        return -1;
+    }
+    for (int i = 0; i < count && !layer_labels.empty(); i++)
+    {
+        if (boxes[i].class_id < 0 || boxes[i].class_id >= (int)layer_labels.size())
+        {
+            return -1;
+        }
+    }
+
+    int width = GST_VIDEO_INFO_WIDTH(info);
+    int height = GST_VIDEO_INFO_HEIGHT(info);
+    RgaImport dst;
+    if (rga_import_buffer(buffer, width, height, rga_format, GST_MAP_READWRITE, &dst) < 0)
+    {
+        return -1;
+    }
+    rga_buffer_t dst_img = wrapbuffer_handle(dst.handle, width, height, rga_format, dst.wstride, dst.hstride);
+    rga_buffer_t layer_img;
+    memset(&layer_img, 0, sizeof(layer_img));
+    if (layer_handle != 0)
+    {
+        layer_img = wrapbuffer_handle(layer_handle, layer_width, layer_height, RK_FORMAT_RGBA_8888);
+    }
+    int clip_width = align_down2(width);
+    int clip_height = align_down2(height);
+
+    // Same rectangles, in the same order, as overlay_draw_box() and
+    // overlay_draw_label() per detection
+    OverlayJob job;
+    job_begin(&job);
+    for (int i = 0; i < count; i++)
+    {
+        const OverlayBox *box = &boxes[i];
+        int box_width = box->right - box->left;
+        int box_height = box->bottom - box->top;
+        uint32_t color = fill_color(overlay_class_color(box->class_id));
+        // Without an outline the label is still drawn
+        bool outline = box_width > 0 && box_height > 0 && thickness > 0;
+        if (outline && (2 * thickness >= box_width || 2 * thickness >= box_height))
+        {
+            job_fill(&job, dst_img, clip_width, clip_height, box->left, box->top, box_width, box_height, color);
+        }
+        else if (outline)
+        {
+            int side_height = box_height - 2 * thickness;
+            job_fill(&job, dst_img, clip_width, clip_height, box->left, box->top, box_width, thickness, color);
+            job_fill(&job, dst_img, clip_width, clip_height, box->left, box->bottom - thickness, box_width, thickness,
+                     color);
+            job_fill(&job, dst_img, clip_width, clip_height, box->left, box->top + thickness, thickness, side_height,
+                     color);
+            job_fill(&job, dst_img, clip_width, clip_height, box->right - thickness, box->top + thickness, thickness,
+                     side_height, color);
+        }
+        if (layer_handle != 0)
+        {
+            job_label(&job, layer_img, dst_img, clip_width, clip_height, &layer_labels[box->class_id], box->left,
+                      box->top);
+        }
+    }
+    job_end(&job);
+
+    rga_release_buffer(buffer, &dst);
+    if (job.failed)
+    {
+        g_print("RGA overlay job failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int rga_overlay_copy(GstBuffer *src, GstBuffer *dst, const GstVideoInfo *info, int rga_format)
+{
+    int width = GST_VIDEO_INFO_WIDTH(info);
+    int height = GST_VIDEO_INFO_HEIGHT(info);
+    RgaImport src_import;
+    if (rga_import_buffer(src, width, height, rga_format, GST_MAP_READ, &src_import) < 0)
+    {
+        return -1;
+    }
+    RgaImport dst_import;
+    if (rga_import_buffer(dst, width, height, rga_format, GST_MAP_WRITE, &dst_import) < 0)
+    {
+        rga_release_buffer(src, &src_import);
+        return -1;
+    }
+    rga_buffer_t src_img =
+        wrapbuffer_handle(src_import.handle, width, height, rga_format, src_import.wstride, src_import.hstride);
+    rga_buffer_t dst_img =
+        wrapbuffer_handle(dst_import.handle, width, height, rga_format, dst_import.wstride, dst_import.hstride);
+    IM_STATUS status = imcopy(src_img, dst_img);
+    rga_release_buffer(dst, &dst_import);
+    rga_release_buffer(src, &src_import);
+    if (status != IM_STATUS_SUCCESS)
+    {
+        g_print("RGA overlay copy failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+void rga_overlay_deinit()
+{
+    if (layer_handle != 0)
+    {
+        releasebuffer_handle(layer_handle);
+        layer_handle = 0;
+    }
+    layer_pixels.clear();
+    layer_labels.clear();
+    layer_width = 0;
+    layer_height = 0;
+    initialized = false;
+}
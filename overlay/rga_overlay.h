@@ -0,0 +1,42 @@
+#ifndef _OVERLAY_RGA_OVERLAY_H_
+#define _OVERLAY_RGA_OVERLAY_H_
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "overlay/label_atlas.h"
+#include "overlay/overlay.h"
+
+// Boxes and labels drawn by RGA instead of the CPU. The label of every class
+// is composited once, on its bar in the class colour, into one RGBA layer
+// that stays imported into RGA; a frame is then a batch of colour fills for
+// the box edges and of copies out of that layer, submitted as RGA jobs.
+// RGA works on 2-pixel aligned rectangles, so edges are rounded outwards to
+// even coordinates and may land a pixel off the CPU drawing, which stays the
+// reference (overlay_draw_box(), overlay_draw_label()).
+
+// Renders the labels of classes [0, count) of `atlas` on bars of
+// overlay_class_color() with `text` blended in. Without a ready atlas frames
+// get their boxes only, as on the CPU. -1 when RGA cannot import the layer.
+int rga_overlay_init(const LabelAtlas *atlas, int count, OverlayColor text);
+
+// Draws `boxes` with their labels into a writable display buffer of `info`,
+// with `rga_format` from rga_format_from_video_format(). A dmabuf still held
+// by another buffer (the analytics branch, the decoder) is swapped for a
+// private copy first, as a CPU write map would; rga_overlay_copy() into
+// memory of our own avoids that. -1 when RGA rejected a job or
+// a box has a class without a pre-rendered label; the caller then draws the
+// frame on the CPU.
+int rga_overlay_draw(GstBuffer *buffer, const GstVideoInfo *info, int rga_format, const OverlayBox *boxes, int count,
+                     int thickness);
+
+// Copies the frame of `src` into `dst`, a buffer of the same layout (its
+// GstVideoMeta, if any, already copied over) whose memory RGA may write,
+// for a frame whose own memory is still held by another buffer. -1 when RGA
+// cannot import either buffer or rejected the copy.
+int rga_overlay_copy(GstBuffer *src, GstBuffer *dst, const GstVideoInfo *info, int rga_format);
+
+// Releases the label layer
+void rga_overlay_deinit();
+
+#endif //_OVERLAY_RGA_OVERLAY_H_
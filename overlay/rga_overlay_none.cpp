@@ -0,0 +1,16 @@
+#include "overlay/rga_overlay.h"
+
+// Built instead of rga_overlay.cpp when librga is missing (replay builds on a
+// host): every frame is drawn on the CPU
+
+int rga_overlay_init(const LabelAtlas *atlas, int count, OverlayColor text) { return -1; }
+
+int rga_overlay_draw(GstBuffer *buffer, const GstVideoInfo *info, int rga_format, const OverlayBox *boxes, int count,
+                     int thickness)
+{
+    return -1;
+}
+
+int rga_overlay_copy(GstBuffer *src, GstBuffer *dst, const GstVideoInfo *info, int rga_format) { return -1; }
+
+void rga_overlay_deinit() {}
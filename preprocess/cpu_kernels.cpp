@@ -0,0 +1,253 @@
+#include "preprocess/cpu_kernels_internal.h"
+
+#include <string.h>
+
+#include <vector>
+
+static inline int saturate_s16(int v) { return v < -32768 ? -32768 : (v > 32767 ? 32767 : v); }
+
+static inline uint8_t saturate_u8(int v) { return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v)); }
+
+// Same rounding as _mm_mulhrs_epi16 / vqrdmulhq_s16
+static inline int mulhrs(int a, int b) { return (a * b + 0x4000) >> 15; }
+
+void cpu_blend_rows_c(const int16_t *r0, const int16_t *r1, int16_t wy, uint8_t *dst, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        int v = r0[i] + mulhrs(r1[i] - r0[i], wy);
+        dst[i] = saturate_u8((v + 64) >> 7);
+    }
+}
+
+// The SIMD versions add with saturation in 16 bits, which only matters for
+// values that clamp to 0/255 anyway; mirror it so the outputs are identical.
+static inline uint8_t yuv_to_u8(int v) { return saturate_u8(saturate_s16(saturate_s16(v) + 32) >> 6); }
+
+void cpu_nv12_row_to_rgb_c(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        int yy = (y[x] - 16) * CPU_YUV_Y;
+        int u = uv[(x >> 1) * 2] - 128;
+        int v = uv[(x >> 1) * 2 + 1] - 128;
+        rgb[x * 3 + 0] = yuv_to_u8(yy + v * CPU_YUV_VR);
+        rgb[x * 3 + 1] = yuv_to_u8(yy - (u * CPU_YUV_UG + v * CPU_YUV_VG));
+        rgb[x * 3 + 2] = yuv_to_u8(yy + u * CPU_YUV_UB);
+    }
+}
+
+static const CpuKernels CPU_KERNELS_SCALAR = {CPU_ISA_SCALAR, "scalar", cpu_blend_rows_c, cpu_nv12_row_to_rgb_c};
+
+const CpuKernels *cpu_kernels_get(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CPU_ISA_SCALAR:
+        return &CPU_KERNELS_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+    case CPU_ISA_SSE41:
+        return __builtin_cpu_supports("sse4.1") ? &CPU_KERNELS_SSE41 : NULL;
+    case CPU_ISA_AVX2:
+        return __builtin_cpu_supports("avx2") ? &CPU_KERNELS_AVX2 : NULL;
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    case CPU_ISA_NEON:
+        return &CPU_KERNELS_NEON;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static const CpuKernels *pick_best()
+{
+    // SSE4.1 over AVX2, as for the decode and overlay kernels, so the whole
+    // pipeline runs one vector width by default; AVX2 stays selectable
+    // through cpu_kernels_get()
+    static const CpuIsa preference[] = {CPU_ISA_NEON, CPU_ISA_SSE41, CPU_ISA_AVX2, CPU_ISA_SCALAR};
+    for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); i++)
+    {
+        const CpuKernels *kernels = cpu_kernels_get(preference[i]);
+        if (kernels != NULL)
+        {
+            return kernels;
+        }
+    }
+    return NULL;
+}
+
+const CpuKernels *cpu_kernels_best()
+{
+    // Static local: safe when several threads ask first at the same time
+    static const CpuKernels *best = pick_best();
+    return best;
+}
+
+// Per-thread scratch, grown on demand and reused for every frame
+typedef struct _ResizeScratch
+{
+    std::vector<int> xofs;      // first source pixel of each output column
+    std::vector<int> xofs1;     // second source pixel
+    std::vector<int16_t> xw;    // weight of the second pixel, 7 bits
+    std::vector<int16_t> rows;  // two horizontally resized rows
+    std::vector<uint8_t> luma;  // resized planes of NV12 input
+    std::vector<uint8_t> chroma;
+} ResizeScratch;
+
+static thread_local ResizeScratch scratch;
+
+// Maps output coordinate `d` to the two source samples and the weight of the
+// second one, with OpenCV's half-pixel convention.
+static void bilinear_coord(int d, double scale, int src_size, int *s0, int *s1, double *frac)
+{
+    double s = (d + 0.5) * scale - 0.5;
+    if (s < 0)
+    {
+        s = 0;
+    }
+    int i = (int)s;
+    double f = s - i;
+    if (i >= src_size - 1)
+    {
+        i = src_size - 1;
+        f = 0;
+    }
+    *s0 = i;
+    *s1 = i + 1 < src_size ? i + 1 : i;
+    *frac = f;
+}
+
+// Horizontal step for one source row: picks channels `map[0..CN_OUT-1]` out
+// of `CN_IN` interleaved ones and writes 7-bit fixed-point samples. The
+// channel counts are template arguments so the inner loop unrolls.
+template <int CN_IN, int CN_OUT>
+static void resize_row_horizontal(const uint8_t *src, const int *map, int16_t *dst, int dst_width)
+{
+    const int *xofs = scratch.xofs.data();
+    const int *xofs1 = scratch.xofs1.data();
+    const int16_t *xw = scratch.xw.data();
+    for (int dx = 0; dx < dst_width; dx++)
+    {
+        const uint8_t *p0 = src + xofs[dx] * CN_IN;
+        const uint8_t *p1 = src + xofs1[dx] * CN_IN;
+        int w1 = xw[dx];
+        int w0 = 128 - w1;
+        for (int c = 0; c < CN_OUT; c++)
+        {
+            dst[dx * CN_OUT + c] = (int16_t)(p0[map[c]] * w0 + p1[map[c]] * w1);
+        }
+    }
+}
+
+template <int CN_IN, int CN_OUT>
+static void resize_plane(const uint8_t *src, int src_stride, int src_width, int src_height, const int *map,
+                         uint8_t *dst, int dst_stride, int dst_width, int dst_height, const CpuKernels *kernels)
+{
+    scratch.xofs.resize(dst_width);
+    scratch.xofs1.resize(dst_width);
+    scratch.xw.resize(dst_width);
+    double scale_x = (double)src_width / dst_width;
+    for (int dx = 0; dx < dst_width; dx++)
+    {
+        double f;
+        bilinear_coord(dx, scale_x, src_width, &scratch.xofs[dx], &scratch.xofs1[dx], &f);
+        scratch.xw[dx] = (int16_t)(f * 128 + 0.5);
+    }
+
+    // Keep the last two horizontally resized source rows: when downscaling
+    // most output rows share one of them with the previous output row.
+    int row_len = dst_width * CN_OUT;
+    scratch.rows.resize(row_len * 2);
+    int16_t *rows[2] = {scratch.rows.data(), scratch.rows.data() + row_len};
+    int cached[2] = {-1, -1};
+
+    double scale_y = (double)src_height / dst_height;
+    for (int dy = 0; dy < dst_height; dy++)
+    {
+        int y0, y1;
+        double f;
+        bilinear_coord(dy, scale_y, src_height, &y0, &y1, &f);
+        int wy = (int)(f * 32768 + 0.5);
+        if (wy > 32767)
+        {
+            wy = 32767;
+        }
+
+        int a = cached[0] == y0 ? 0 : (cached[1] == y0 ? 1 : -1);
+        if (a < 0)
+        {
+            a = cached[0] == y1 ? 1 : 0;
+            resize_row_horizontal<CN_IN, CN_OUT>(src + (size_t)y0 * src_stride, map, rows[a], dst_width);
+            cached[a] = y0;
+        }
+        int b = cached[0] == y1 ? 0 : (cached[1] == y1 ? 1 : -1);
+        if (b < 0)
+        {
+            b = 1 - a;
+            resize_row_horizontal<CN_IN, CN_OUT>(src + (size_t)y1 * src_stride, map, rows[b], dst_width);
+            cached[b] = y1;
+        }
+        kernels->blend_rows(rows[a], rows[b], (int16_t)wy, dst + (size_t)dy * dst_stride, row_len);
+    }
+}
+
+int cpu_resize_to_rgb(const CpuImage *src, uint8_t *dst, int dst_width, int dst_height, int dst_wstride,
+                      const CpuKernels *kernels)
+{
+    if (src == NULL || dst == NULL || kernels == NULL || src->width <= 0 || src->height <= 0 || dst_width <= 0 ||
+        dst_height <= 0 || dst_wstride < dst_width || src->plane[0] == NULL)
+    {
+        return -1;
+    }
+    int dst_stride = dst_wstride * 3;
+
+    switch (src->format)
+    {
+    case CPU_PIXEL_BGRA:
+    {
+        static const int bgra_to_rgb[3] = {2, 1, 0};
+        resize_plane<4, 3>(src->plane[0], src->stride[0], src->width, src->height, bgra_to_rgb, dst, dst_stride,
+                           dst_width, dst_height, kernels);
+        return 0;
+    }
+    case CPU_PIXEL_RGBA:
+    {
+        static const int rgba_to_rgb[3] = {0, 1, 2};
+        resize_plane<4, 3>(src->plane[0], src->stride[0], src->width, src->height, rgba_to_rgb, dst, dst_stride,
+                           dst_width, dst_height, kernels);
+        return 0;
+    }
+    case CPU_PIXEL_NV12:
+    case CPU_PIXEL_NV21:
+    {
+        if (src->plane[1] == NULL)
+        {
+            return -1;
+        }
+        // Resize both planes to the output size (chroma at half resolution)
+        // and convert once per output pixel instead of once per input pixel.
+        static const int luma_map[1] = {0};
+        static const int uv_map[2] = {0, 1};
+        static const int vu_map[2] = {1, 0};
+        int chroma_width = (dst_width + 1) / 2;
+        int chroma_height = (dst_height + 1) / 2;
+        scratch.luma.resize((size_t)dst_width * dst_height);
+        scratch.chroma.resize((size_t)chroma_width * 2 * chroma_height);
+        resize_plane<1, 1>(src->plane[0], src->stride[0], src->width, src->height, luma_map, scratch.luma.data(),
+                           dst_width, dst_width, dst_height, kernels);
+        resize_plane<2, 2>(src->plane[1], src->stride[1], (src->width + 1) / 2, (src->height + 1) / 2,
+                           src->format == CPU_PIXEL_NV12 ? uv_map : vu_map, scratch.chroma.data(), chroma_width * 2,
+                           chroma_width, chroma_height, kernels);
+        for (int dy = 0; dy < dst_height; dy++)
+        {
+            kernels->nv12_row_to_rgb(scratch.luma.data() + (size_t)dy * dst_width,
+                                     scratch.chroma.data() + (size_t)(dy / 2) * chroma_width * 2,
+                                     dst + (size_t)dy * dst_stride, dst_width);
+        }
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
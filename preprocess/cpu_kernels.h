@@ -0,0 +1,60 @@
+#ifndef _PREPROCESS_CPU_KERNELS_H_
+#define _PREPROCESS_CPU_KERNELS_H_
+
+#include <stdint.h>
+
+// CPU image kernels behind the software preprocessor. They do not depend on
+// GStreamer so they can be built and benchmarked on any host.
+
+typedef enum _CpuPixelFormat
+{
+    CPU_PIXEL_NV12, // Y plane + interleaved UV plane
+    CPU_PIXEL_NV21, // Y plane + interleaved VU plane
+    CPU_PIXEL_BGRA, // also BGRx
+    CPU_PIXEL_RGBA, // also RGBx
+} CpuPixelFormat;
+
+typedef struct _CpuImage
+{
+    CpuPixelFormat format;
+    int width;
+    int height;
+    const uint8_t *plane[2]; // packed formats only use plane[0]
+    int stride[2];           // bytes per row
+} CpuImage;
+
+typedef enum _CpuIsa
+{
+    CPU_ISA_SCALAR,
+    CPU_ISA_SSE41,
+    CPU_ISA_AVX2,
+    CPU_ISA_NEON,
+} CpuIsa;
+
+// Row kernels of one instruction set. Every variant is bit-exact with the
+// scalar one, so they can be swapped freely and checked against it.
+typedef struct _CpuKernels
+{
+    CpuIsa isa;
+    const char *name;
+    // Vertical bilinear step: rows hold 7-bit fixed-point samples from the
+    // horizontal step, `wy` is the weight of r1 in Q15.
+    void (*blend_rows)(const int16_t *r0, const int16_t *r1, int16_t wy, uint8_t *dst, int n);
+    // BT.601 limited-range NV12 row (UV order) to packed RGB888
+    void (*nv12_row_to_rgb)(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, int width);
+} CpuKernels;
+
+// NULL when `isa` is not built in or not supported by the running CPU
+const CpuKernels *cpu_kernels_get(CpuIsa isa);
+
+// Fastest kernels usable on the running CPU, detected once
+const CpuKernels *cpu_kernels_best();
+
+// Bilinear resize (half-pixel centres) plus conversion to RGB888 rows of
+// `dst_wstride` pixels. NV12 is resized per plane at the destination size and
+// converted afterwards; BGRA/RGBA channels are reordered during the resize.
+// Scratch buffers are per thread. Returns 0 on success, -1 on bad arguments.
+int cpu_resize_to_rgb(const CpuImage *src, uint8_t *dst, int dst_width, int dst_height, int dst_wstride,
+                      const CpuKernels *kernels);
+
+#endif //_PREPROCESS_CPU_KERNELS_H_
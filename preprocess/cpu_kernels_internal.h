@@ -0,0 +1,25 @@
+#ifndef _PREPROCESS_CPU_KERNELS_INTERNAL_H_
+#define _PREPROCESS_CPU_KERNELS_INTERNAL_H_
+
+#include "preprocess/cpu_kernels.h"
+
+// BT.601 limited range in Q6: 1.164, 1.596, 0.391, 0.813, 2.018
+#define CPU_YUV_Y 75
+#define CPU_YUV_VR 102
+#define CPU_YUV_UG 25
+#define CPU_YUV_VG 52
+#define CPU_YUV_UB 129
+
+// Scalar reference kernels, also used for the tails of the SIMD rows
+void cpu_blend_rows_c(const int16_t *r0, const int16_t *r1, int16_t wy, uint8_t *dst, int n);
+void cpu_nv12_row_to_rgb_c(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, int width);
+
+#if defined(__x86_64__) || defined(__i386__)
+extern const CpuKernels CPU_KERNELS_SSE41;
+extern const CpuKernels CPU_KERNELS_AVX2;
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+extern const CpuKernels CPU_KERNELS_NEON;
+#endif
+
+#endif //_PREPROCESS_CPU_KERNELS_INTERNAL_H_
@@ -0,0 +1,58 @@
+#include "preprocess/cpu_kernels_internal.h"
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static void blend_rows_neon(const int16_t *r0, const int16_t *r1, int16_t wy, uint8_t *dst, int n)
+{
+    const int16x8_t w = vdupq_n_s16(wy);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        int16x8_t a0 = vld1q_s16(r0 + i);
+        int16x8_t a1 = vld1q_s16(r0 + i + 8);
+        int16x8_t b0 = vld1q_s16(r1 + i);
+        int16x8_t b1 = vld1q_s16(r1 + i + 8);
+        int16x8_t v0 = vaddq_s16(a0, vqrdmulhq_s16(vsubq_s16(b0, a0), w));
+        int16x8_t v1 = vaddq_s16(a1, vqrdmulhq_s16(vsubq_s16(b1, a1), w));
+        vst1q_u8(dst + i, vcombine_u8(vqrshrun_n_s16(v0, 7), vqrshrun_n_s16(v1, 7)));
+    }
+    cpu_blend_rows_c(r0 + i, r1 + i, wy, dst + i, n - i);
+}
+
+static void nv12_row_to_rgb_neon(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, int width)
+{
+    const int16x8_t y_offset = vdupq_n_s16(16);
+    const int16x8_t uv_offset = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t y8 = vld1q_u8(y + x);
+        int16x8_t y_lo = vmulq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8))), y_offset), CPU_YUV_Y);
+        int16x8_t y_hi = vmulq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8))), y_offset), CPU_YUV_Y);
+
+        // 8 chroma pairs cover the 16 pixels
+        uint8x8x2_t uv8 = vld2_u8(uv + x);
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uv8.val[0])), uv_offset);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uv8.val[1])), uv_offset);
+        int16x8x2_t vr = vzipq_s16(vmulq_n_s16(v, CPU_YUV_VR), vmulq_n_s16(v, CPU_YUV_VR));
+        int16x8_t uvg1 = vmlaq_n_s16(vmulq_n_s16(u, CPU_YUV_UG), v, CPU_YUV_VG);
+        int16x8x2_t uvg = vzipq_s16(uvg1, uvg1);
+        int16x8x2_t ub = vzipq_s16(vmulq_n_s16(u, CPU_YUV_UB), vmulq_n_s16(u, CPU_YUV_UB));
+
+        uint8x16x3_t out;
+        out.val[0] = vcombine_u8(vqrshrun_n_s16(vqaddq_s16(y_lo, vr.val[0]), 6),
+                                 vqrshrun_n_s16(vqaddq_s16(y_hi, vr.val[1]), 6));
+        out.val[1] = vcombine_u8(vqrshrun_n_s16(vqsubq_s16(y_lo, uvg.val[0]), 6),
+                                 vqrshrun_n_s16(vqsubq_s16(y_hi, uvg.val[1]), 6));
+        out.val[2] = vcombine_u8(vqrshrun_n_s16(vqaddq_s16(y_lo, ub.val[0]), 6),
+                                 vqrshrun_n_s16(vqaddq_s16(y_hi, ub.val[1]), 6));
+        vst3q_u8(rgb + x * 3, out);
+    }
+    cpu_nv12_row_to_rgb_c(y + x, uv + x, rgb + x * 3, width - x);
+}
+
+const CpuKernels CPU_KERNELS_NEON = {CPU_ISA_NEON, "neon", blend_rows_neon, nv12_row_to_rgb_neon};
+
+#endif
@@ -0,0 +1,175 @@
+#include "preprocess/cpu_kernels_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// Built with per-function target attributes so the rest of the program keeps
+// the baseline ISA; cpu_kernels_get() checks the CPU before handing these out.
+#define SSE41_FN __attribute__((target("sse4.1")))
+#define AVX2_FN __attribute__((target("avx2")))
+// SSE4.1 helpers the AVX2 kernels share: always inlined, so they come out
+// VEX-encoded there instead of as calls into legacy SSE code (an SSE/AVX
+// transition on every call, and nothing is inlined at -O0)
+#define SSE41_INLINE __attribute__((target("sse4.1"), always_inline)) static inline
+
+SSE41_FN static void blend_rows_sse41(const int16_t *r0, const int16_t *r1, int16_t wy, uint8_t *dst, int n)
+{
+    const __m128i w = _mm_set1_epi16(wy);
+    const __m128i round = _mm_set1_epi16(64);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(r0 + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(r0 + i + 8));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(r1 + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(r1 + i + 8));
+        __m128i v0 = _mm_add_epi16(a0, _mm_mulhrs_epi16(_mm_sub_epi16(b0, a0), w));
+        __m128i v1 = _mm_add_epi16(a1, _mm_mulhrs_epi16(_mm_sub_epi16(b1, a1), w));
+        v0 = _mm_srli_epi16(_mm_add_epi16(v0, round), 7);
+        v1 = _mm_srli_epi16(_mm_add_epi16(v1, round), 7);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(v0, v1));
+    }
+    cpu_blend_rows_c(r0 + i, r1 + i, wy, dst + i, n - i);
+}
+
+// Interleaves 16 R, G and B bytes into 48 bytes of RGB888
+SSE41_INLINE void store_rgb_sse41(uint8_t *rgb, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+    __m128i out0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0));
+    __m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1));
+    __m128i out2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2));
+    _mm_storeu_si128((__m128i *)rgb, out0);
+    _mm_storeu_si128((__m128i *)(rgb + 16), out1);
+    _mm_storeu_si128((__m128i *)(rgb + 32), out2);
+}
+
+// Rounds Q6 to 8 bits: saturate((v + 32) >> 6)
+SSE41_INLINE __m128i descale_sse41(__m128i v)
+{
+    return _mm_srai_epi16(_mm_adds_epi16(v, _mm_set1_epi16(32)), 6);
+}
+
+SSE41_FN static void nv12_row_to_rgb_sse41(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i y_offset = _mm_set1_epi16(16);
+    const __m128i uv_offset = _mm_set1_epi16(128);
+    const __m128i low_byte = _mm_set1_epi16(0xff);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i y8 = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i y_lo = _mm_mullo_epi16(_mm_sub_epi16(_mm_cvtepu8_epi16(y8), y_offset), _mm_set1_epi16(CPU_YUV_Y));
+        __m128i y_hi = _mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(y8, zero), y_offset), _mm_set1_epi16(CPU_YUV_Y));
+
+        // 8 chroma pairs cover the 16 pixels
+        __m128i uv8 = _mm_loadu_si128((const __m128i *)(uv + x));
+        __m128i u = _mm_sub_epi16(_mm_and_si128(uv8, low_byte), uv_offset);
+        __m128i v = _mm_sub_epi16(_mm_srli_epi16(uv8, 8), uv_offset);
+        __m128i vr = _mm_mullo_epi16(v, _mm_set1_epi16(CPU_YUV_VR));
+        __m128i uvg = _mm_add_epi16(_mm_mullo_epi16(u, _mm_set1_epi16(CPU_YUV_UG)),
+                                    _mm_mullo_epi16(v, _mm_set1_epi16(CPU_YUV_VG)));
+        __m128i ub = _mm_mullo_epi16(u, _mm_set1_epi16(CPU_YUV_UB));
+
+        __m128i r = _mm_packus_epi16(descale_sse41(_mm_adds_epi16(y_lo, _mm_unpacklo_epi16(vr, vr))),
+                                     descale_sse41(_mm_adds_epi16(y_hi, _mm_unpackhi_epi16(vr, vr))));
+        __m128i g = _mm_packus_epi16(descale_sse41(_mm_subs_epi16(y_lo, _mm_unpacklo_epi16(uvg, uvg))),
+                                     descale_sse41(_mm_subs_epi16(y_hi, _mm_unpackhi_epi16(uvg, uvg))));
+        __m128i b = _mm_packus_epi16(descale_sse41(_mm_adds_epi16(y_lo, _mm_unpacklo_epi16(ub, ub))),
+                                     descale_sse41(_mm_adds_epi16(y_hi, _mm_unpackhi_epi16(ub, ub))));
+        store_rgb_sse41(rgb + x * 3, r, g, b);
+    }
+    cpu_nv12_row_to_rgb_c(y + x, uv + x, rgb + x * 3, width - x);
+}
+
+AVX2_FN static void blend_rows_avx2(const int16_t *r0, const int16_t *r1, int16_t wy, uint8_t *dst, int n)
+{
+    const __m256i w = _mm256_set1_epi16(wy);
+    const __m256i round = _mm256_set1_epi16(64);
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(r0 + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(r0 + i + 16));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(r1 + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(r1 + i + 16));
+        __m256i v0 = _mm256_add_epi16(a0, _mm256_mulhrs_epi16(_mm256_sub_epi16(b0, a0), w));
+        __m256i v1 = _mm256_add_epi16(a1, _mm256_mulhrs_epi16(_mm256_sub_epi16(b1, a1), w));
+        v0 = _mm256_srli_epi16(_mm256_add_epi16(v0, round), 7);
+        v1 = _mm256_srli_epi16(_mm256_add_epi16(v1, round), 7);
+        // packus works per 128-bit lane, restore the element order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), 0xD8);
+        _mm256_storeu_si256((__m256i *)(dst + i), packed);
+    }
+    cpu_blend_rows_c(r0 + i, r1 + i, wy, dst + i, n - i);
+}
+
+// Duplicates 16 chroma terms into pixel order: t0 t0 t1 t1 ... for pixels
+// 0-15 in *lo and 16-31 in *hi
+AVX2_FN static inline void upsample_chroma_avx2(__m256i t, __m256i *lo, __m256i *hi)
+{
+    __m256i a = _mm256_unpacklo_epi16(t, t);
+    __m256i b = _mm256_unpackhi_epi16(t, t);
+    *lo = _mm256_permute2x128_si256(a, b, 0x20);
+    *hi = _mm256_permute2x128_si256(a, b, 0x31);
+}
+
+AVX2_FN static inline __m256i descale_avx2(__m256i v)
+{
+    return _mm256_srai_epi16(_mm256_adds_epi16(v, _mm256_set1_epi16(32)), 6);
+}
+
+AVX2_FN static inline __m256i pack_avx2(__m256i lo, __m256i hi)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(descale_avx2(lo), descale_avx2(hi)), 0xD8);
+}
+
+AVX2_FN static void nv12_row_to_rgb_avx2(const uint8_t *y, const uint8_t *uv, uint8_t *rgb, int width)
+{
+    const __m256i y_offset = _mm256_set1_epi16(16);
+    const __m256i uv_offset = _mm256_set1_epi16(128);
+    const __m256i low_byte = _mm256_set1_epi16(0xff);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i y8 = _mm256_loadu_si256((const __m256i *)(y + x));
+        __m256i y_lo = _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(y8)), y_offset),
+                                          _mm256_set1_epi16(CPU_YUV_Y));
+        __m256i y_hi =
+            _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(y8, 1)), y_offset),
+                               _mm256_set1_epi16(CPU_YUV_Y));
+
+        __m256i uv8 = _mm256_loadu_si256((const __m256i *)(uv + x));
+        __m256i u = _mm256_sub_epi16(_mm256_and_si256(uv8, low_byte), uv_offset);
+        __m256i v = _mm256_sub_epi16(_mm256_srli_epi16(uv8, 8), uv_offset);
+        __m256i vr_lo, vr_hi, uvg_lo, uvg_hi, ub_lo, ub_hi;
+        upsample_chroma_avx2(_mm256_mullo_epi16(v, _mm256_set1_epi16(CPU_YUV_VR)), &vr_lo, &vr_hi);
+        upsample_chroma_avx2(_mm256_add_epi16(_mm256_mullo_epi16(u, _mm256_set1_epi16(CPU_YUV_UG)),
+                                              _mm256_mullo_epi16(v, _mm256_set1_epi16(CPU_YUV_VG))),
+                             &uvg_lo, &uvg_hi);
+        upsample_chroma_avx2(_mm256_mullo_epi16(u, _mm256_set1_epi16(CPU_YUV_UB)), &ub_lo, &ub_hi);
+
+        __m256i r = pack_avx2(_mm256_adds_epi16(y_lo, vr_lo), _mm256_adds_epi16(y_hi, vr_hi));
+        __m256i g = pack_avx2(_mm256_subs_epi16(y_lo, uvg_lo), _mm256_subs_epi16(y_hi, uvg_hi));
+        __m256i b = pack_avx2(_mm256_adds_epi16(y_lo, ub_lo), _mm256_adds_epi16(y_hi, ub_hi));
+        store_rgb_sse41(rgb + x * 3, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+        store_rgb_sse41(rgb + x * 3 + 48, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1),
+                        _mm256_extracti128_si256(b, 1));
+    }
+    cpu_nv12_row_to_rgb_c(y + x, uv + x, rgb + x * 3, width - x);
+}
+
+const CpuKernels CPU_KERNELS_SSE41 = {CPU_ISA_SSE41, "sse4.1", blend_rows_sse41, nv12_row_to_rgb_sse41};
+const CpuKernels CPU_KERNELS_AVX2 = {CPU_ISA_AVX2, "avx2", blend_rows_avx2, nv12_row_to_rgb_avx2};
+
+#endif
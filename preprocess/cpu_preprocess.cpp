@@ -0,0 +1,65 @@
+#include "preprocess/cpu_preprocess.h"
+
+#include <string.h>
+
+#include "preprocess/cpu_kernels.h"
+
+static int cpu_format_from_video_format(GstVideoFormat format)
+{
+    switch (format)
+    {
+    case GST_VIDEO_FORMAT_NV12:
+        return CPU_PIXEL_NV12;
+    case GST_VIDEO_FORMAT_NV21:
+        return CPU_PIXEL_NV21;
+    case GST_VIDEO_FORMAT_BGRA:
+    case GST_VIDEO_FORMAT_BGRx:
+        return CPU_PIXEL_BGRA;
+    case GST_VIDEO_FORMAT_RGBA:
+    case GST_VIDEO_FORMAT_RGBx:
+        return CPU_PIXEL_RGBA;
+    default:
+        return -1;
+    }
+}
+
+int cpu_preprocess_frame(GstBuffer *buffer, int width, int height, GstVideoFormat format, AnalyticsFrame *frame,
+                         int dst_width, int dst_height, int dst_wstride)
+{
+    int cpu_format = cpu_format_from_video_format(format);
+    if (cpu_format < 0)
+    {
+        return -1;
+    }
+
+    GstVideoInfo info;
+    GstVideoFrame video_frame;
+    gst_video_info_set_format(&info, format, width, height);
+    if (!gst_video_frame_map(&video_frame, &info, buffer, GST_MAP_READ))
+    {
+        return -1;
+    }
+
+    CpuImage image;
+    memset(&image, 0, sizeof(image));
+    image.format = (CpuPixelFormat)cpu_format;
+    image.width = width;
+    image.height = height;
+    for (guint i = 0; i < GST_VIDEO_FRAME_N_PLANES(&video_frame) && i < 2; i++)
+    {
+        image.plane[i] = (const uint8_t *)GST_VIDEO_FRAME_PLANE_DATA(&video_frame, i);
+        image.stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE(&video_frame, i);
+    }
+
+    int ret = cpu_resize_to_rgb(&image, (uint8_t *)frame->input, dst_width, dst_height, dst_wstride,
+                                cpu_kernels_best());
+    gst_video_frame_unmap(&video_frame);
+    if (ret == 0)
+    {
+        // Written through the CPU cache: device tensors need a sync before the run
+        frame->input_dirty = true;
+    }
+    return ret;
+}
+
+const char *cpu_preprocess_kernels() { return cpu_kernels_best()->name; }
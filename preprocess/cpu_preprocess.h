@@ -0,0 +1,21 @@
+#ifndef _PREPROCESS_CPU_PREPROCESS_H_
+#define _PREPROCESS_CPU_PREPROCESS_H_
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "analytics/analytics_stage.h"
+
+// Software counterpart of rga_preprocess_frame(), for hosts without RGA or
+// when RGA rejects a job: bilinear resize plus conversion to RGB888 rows of
+// `dst_wstride` pixels with the fastest SIMD kernels of the running CPU.
+// Handles NV12/NV21 and BGRA/RGBA (and the x variants). Strides and plane
+// offsets come from the buffer's GstVideoMeta when present.
+// Returns 0 on success, -1 if the format is not supported or mapping failed.
+int cpu_preprocess_frame(GstBuffer *buffer, int width, int height, GstVideoFormat format, AnalyticsFrame *frame,
+                         int dst_width, int dst_height, int dst_wstride);
+
+// Name of the kernels cpu_preprocess_frame() uses, e.g. "neon"
+const char *cpu_preprocess_kernels();
+
+#endif //_PREPROCESS_CPU_PREPROCESS_H_
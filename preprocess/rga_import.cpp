@@ -0,0 +1,113 @@
+#include "preprocess/rga_import.h"
+
+#include <gst/allocators/allocators.h>
+#include <gst/video/video.h>
+#include <rga/RgaApi.h>
+
+static int rga_format_bpp(int rga_format)
+{
+    switch (rga_format)
+    {
+    case RK_FORMAT_RGBA_8888:
+    case RK_FORMAT_BGRA_8888:
+    case RK_FORMAT_RGBX_8888:
+    case RK_FORMAT_BGRX_8888:
+        return 4;
+    case RK_FORMAT_RGB_888:
+    case RK_FORMAT_BGR_888:
+        return 3;
+    default:
+        return 1; // semi-planar YUV: luma plane stride
+    }
+}
+
+static GQuark rga_handle_quark()
+{
+    static GQuark quark = 0;
+    if (quark == 0)
+    {
+        quark = g_quark_from_static_string("rga-import-handle");
+    }
+    return quark;
+}
+
+static void release_rga_handle(gpointer data) { releasebuffer_handle((rga_buffer_handle_t)GPOINTER_TO_INT(data)); }
+
+// The handle lives as long as the memory, i.e. as long as the pool buffer
+static rga_buffer_handle_t import_dmabuf_memory(GstMemory *mem)
+{
+    gpointer cached = gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem), rga_handle_quark());
+    if (cached != NULL)
+    {
+        return (rga_buffer_handle_t)GPOINTER_TO_INT(cached);
+    }
+    rga_buffer_handle_t handle = importbuffer_fd(gst_dmabuf_memory_get_fd(mem), mem->maxsize);
+    if (handle == 0)
+    {
+        return 0;
+    }
+    gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(mem), rga_handle_quark(), GINT_TO_POINTER(handle),
+                              release_rga_handle);
+    return handle;
+}
+
+int rga_import_buffer(GstBuffer *buffer, int width, int height, int rga_format, GstMapFlags flags,
+                      RgaImport *import)
+{
+    // Upstream may pad rows (and planes); the video meta carries the real layout
+    import->wstride = width;
+    import->hstride = height;
+    GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+    if (meta != NULL && meta->stride[0] > 0)
+    {
+        import->wstride = meta->stride[0] / rga_format_bpp(rga_format);
+        if (meta->n_planes > 1 && meta->offset[1] > 0)
+        {
+            import->hstride = meta->offset[1] / meta->stride[0];
+        }
+    }
+
+    import->handle = 0;
+    import->cached = false;
+    import->mapped = false;
+    // Memory another buffer also holds (a tee branch, the decoder's
+    // reference frames) is not drawn into in place: mapping a writable buffer
+    // for write swaps it for a private copy first
+    GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
+    bool write = (flags & GST_MAP_WRITE) != 0;
+    if (gst_buffer_n_memory(buffer) == 1 && gst_is_dmabuf_memory(mem) && mem->offset == 0 &&
+        (!write || gst_memory_is_writable(mem)))
+    {
+        import->handle = import_dmabuf_memory(mem);
+        import->cached = import->handle != 0;
+    }
+    if (import->handle == 0)
+    {
+        if (!gst_buffer_map(buffer, &import->map, flags))
+        {
+            return -1;
+        }
+        import->mapped = true;
+        import->handle = importbuffer_virtualaddr(import->map.data, import->map.size);
+    }
+    if (import->handle == 0)
+    {
+        rga_release_buffer(buffer, import);
+        return -1;
+    }
+    return 0;
+}
+
+void rga_release_buffer(GstBuffer *buffer, RgaImport *import)
+{
+    if (import->handle != 0 && !import->cached)
+    {
+        releasebuffer_handle(import->handle);
+    }
+    if (import->mapped)
+    {
+        gst_buffer_unmap(buffer, &import->map);
+    }
+    import->handle = 0;
+    import->mapped = false;
+}
@@ -0,0 +1,30 @@
+#ifndef _PREPROCESS_RGA_IMPORT_H_
+#define _PREPROCESS_RGA_IMPORT_H_
+
+#include <gst/gst.h>
+#include <rga/im2d.h>
+
+// A video buffer as an RGA handle, shared by the preprocessor and the
+// overlay. Only built with librga.
+typedef struct _RgaImport
+{
+    rga_buffer_handle_t handle;
+    int wstride; // pixels per row, from the GstVideoMeta when upstream pads rows
+    int hstride; // rows per plane
+    bool cached; // handle owned by the GstMemory, not released by us
+    bool mapped;
+    GstMapInfo map;
+} RgaImport;
+
+// Buffers backed by a single GstDmaBufMemory are imported by fd and never
+// mapped by the CPU; the handle is cached on the GstMemory, so each
+// buffer-pool buffer is imported once for its whole lifetime. With
+// GST_MAP_WRITE that only applies to memory no other buffer holds. Other
+// buffers are mapped with `flags` and imported by virtual address; mapping
+// shared memory for write copies it, and fails unless `buffer` is writable.
+// Returns -1 when neither works.
+int rga_import_buffer(GstBuffer *buffer, int width, int height, int rga_format, GstMapFlags flags,
+                      RgaImport *import);
+void rga_release_buffer(GstBuffer *buffer, RgaImport *import);
+
+#endif //_PREPROCESS_RGA_IMPORT_H_
@@ -0,0 +1,114 @@
+#include "preprocess/rga_preprocess.h"
+#include "preprocess/rga_import.h"
+
+#include <rga/RgaApi.h>
+#include <rga/im2d.h>
+#include <string.h>
+
+#define RGA_MAX_DST_HANDLES 32
+
+typedef struct _DstHandle
+{
+    void *addr;
+    rga_buffer_handle_t handle;
+} DstHandle;
+
+// Analytics slots are allocated once, so their handles are imported once.
+// Only used from the streaming thread.
+static DstHandle dst_handles[RGA_MAX_DST_HANDLES];
+static int dst_handle_count = 0;
+
+int rga_format_from_video_format(GstVideoFormat format)
+{
+    switch (format)
+    {
+    case GST_VIDEO_FORMAT_NV12:
+        return RK_FORMAT_YCbCr_420_SP;
+    case GST_VIDEO_FORMAT_NV21:
+        return RK_FORMAT_YCrCb_420_SP;
+    case GST_VIDEO_FORMAT_NV16:
+        return RK_FORMAT_YCbCr_422_SP;
+    case GST_VIDEO_FORMAT_RGBA:
+        return RK_FORMAT_RGBA_8888;
+    case GST_VIDEO_FORMAT_BGRA:
+        return RK_FORMAT_BGRA_8888;
+    case GST_VIDEO_FORMAT_RGBx:
+        return RK_FORMAT_RGBX_8888;
+    case GST_VIDEO_FORMAT_BGRx:
+        return RK_FORMAT_BGRX_8888;
+    case GST_VIDEO_FORMAT_RGB:
+        return RK_FORMAT_RGB_888;
+    case GST_VIDEO_FORMAT_BGR:
+        return RK_FORMAT_BGR_888;
+    default:
+        return -1;
+    }
+}
+
+static rga_buffer_handle_t import_dst(AnalyticsFrame *frame)
+{
+    for (int i = 0; i < dst_handle_count; i++)
+    {
+        if (dst_handles[i].addr == frame->input)
+        {
+            return dst_handles[i].handle;
+        }
+    }
+    if (dst_handle_count == RGA_MAX_DST_HANDLES)
+    {
+        return 0;
+    }
+    rga_buffer_handle_t handle = frame->input_fd >= 0 ? importbuffer_fd(frame->input_fd, frame->input_size)
+                                                      : importbuffer_virtualaddr(frame->input, frame->input_size);
+    if (handle != 0)
+    {
+        dst_handles[dst_handle_count].addr = frame->input;
+        dst_handles[dst_handle_count].handle = handle;
+        dst_handle_count++;
+    }
+    return handle;
+}
+
+int rga_preprocess_frame(GstBuffer *buffer, int width, int height, int rga_format, AnalyticsFrame *frame,
+                         int dst_width, int dst_height, int dst_wstride)
+{
+    rga_buffer_handle_t dst_handle = import_dst(frame);
+    if (dst_handle == 0)
+    {
+        return -1;
+    }
+
+    RgaImport src;
+    if (rga_import_buffer(buffer, width, height, rga_format, GST_MAP_READ, &src) < 0)
+    {
+        return -1;
+    }
+
+    int ret = -1;
+    rga_buffer_t src_img = wrapbuffer_handle(src.handle, width, height, rga_format, src.wstride, src.hstride);
+    rga_buffer_t dst_img = wrapbuffer_handle(dst_handle, dst_width, dst_height, RK_FORMAT_RGB_888, dst_wstride,
+                                             dst_height);
+    if (imcheck(src_img, dst_img, {}, {}) == IM_STATUS_NOERROR)
+    {
+        if (imresize(src_img, dst_img) == IM_STATUS_SUCCESS)
+        {
+            ret = 0;
+        }
+        else
+        {
+            g_print("imresize failed\n");
+        }
+    }
+
+    rga_release_buffer(buffer, &src);
+    return ret;
+}
+
+void rga_preprocess_deinit()
+{
+    for (int i = 0; i < dst_handle_count; i++)
+    {
+        releasebuffer_handle(dst_handles[i].handle);
+    }
+    dst_handle_count = 0;
+}
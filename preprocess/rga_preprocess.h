@@ -0,0 +1,26 @@
+#ifndef _PREPROCESS_RGA_PREPROCESS_H_
+#define _PREPROCESS_RGA_PREPROCESS_H_
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "analytics/analytics_stage.h"
+
+// Resizes (and colour-converts) one video frame into the model input of an
+// analytics slot with RGA, writing RGB888 rows of `dst_wstride` pixels.
+//
+// Buffers backed by a single GstDmaBufMemory are imported by fd and never
+// mapped by the CPU; the RGA handle is cached on the GstMemory, so each
+// buffer-pool buffer is imported once for its whole lifetime. System-memory
+// buffers fall back to a read-only map and the virtual-address import.
+// Returns 0 on success, -1 if RGA rejected the job.
+int rga_preprocess_frame(GstBuffer *buffer, int width, int height, int rga_format, AnalyticsFrame *frame,
+                         int dst_width, int dst_height, int dst_wstride);
+
+// RK_FORMAT_* matching a raw video format, -1 when RGA cannot read it
+int rga_format_from_video_format(GstVideoFormat format);
+
+// Releases the cached destination handles
+void rga_preprocess_deinit();
+
+#endif //_PREPROCESS_RGA_PREPROCESS_H_
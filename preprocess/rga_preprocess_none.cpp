@@ -0,0 +1,14 @@
+#include "preprocess/rga_preprocess.h"
+
+// Built instead of rga_preprocess.cpp when librga is missing (replay builds
+// on a host): every frame goes to the CPU preprocessor
+
+int rga_preprocess_frame(GstBuffer *buffer, int width, int height, int rga_format, AnalyticsFrame *frame,
+                         int dst_width, int dst_height, int dst_wstride)
+{
+    return -1;
+}
+
+int rga_format_from_video_format(GstVideoFormat format) { return -1; }
+
+void rga_preprocess_deinit() {}
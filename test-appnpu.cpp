@@ -7,31 +7,40 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <gst/gst.h>
-#include <freetype2/ft2build.h>
-#include FT_FREETYPE_H
-#include <rga/RgaApi.h>
-#include <rga/im2d.h>
 #include <sys/mman.h>
 #include <errno.h>
 
-#include "rknn/rknn_api.h"
+#include "inference/inference_backend.h"
 #include "yolov5/postprocess.h"
+#include "analytics/analytics_stage.h"
+#include "overlay/label_atlas.h"
+#include "overlay/overlay.h"
+#include "overlay/detection_overlay.h"
+#include "preprocess/rga_preprocess.h"
+#include "preprocess/cpu_preprocess.h"
 
 #include <png.h>
 #include <iostream>
 #include <fstream>
+#include <atomic>
 
 #define RENDERING_WIDTH 720
 #define RENDERING_HEIGHT 1280
-#define RENDERING_CHANNEL 4
 
-#define RKNN_WIDTH 640
-#define RKNN_HEIGHT 640
-#define RKNN_CHANNEL 3
+// Formats the overlay draws on, the decoder's own first: videoconvert stays in
+// passthrough unless the sink needs something else. RKNN_DISPLAY_FORMAT
+// forces one of them (e.g. BGRA for sinks without NV12).
+#define DISPLAY_FORMATS DETECTION_OVERLAY_FORMATS
+
+#define LABEL_FONT_PATH "./simsun.ttc"
+#define LABEL_PIXEL_SIZE 24
 
 #define NMS_THRESH 0.45
 #define BOX_THRESH 0.25
 
+// Frames written out when RKNN_DUMP_OUTPUTS is set
+#define RKNN_DUMP_MAX_FRAMES 16
+
 double __get_us(struct timeval t) { return (t.tv_sec * 1000000 + t.tv_usec); }
 
 // 1. 全局变量保存实际渲染宽高
@@ -47,24 +56,39 @@ typedef struct _CustomData {
     GstElement *demuxer;        // only for local file
     GstElement *parse;
     GstElement *decoder;
+    GstElement *tee;            // decoder output: display branch + analytics branch
+    GstElement *display_queue;
+    GstElement *analytics_queue;
+    GstElement *analytics_sink;
     GstElement *videoscale;
     GstElement *scale_capsfilter;
     GstElement *videoconvert;
-    GstElement *rgb_capsfilter;
+    GstElement *format_capsfilter; // display formats the overlay draws on
+    GstElement *overlay;           // NULL with RKNN_OVERLAY=none
     GstElement *sink;
     GMainLoop *main_loop;
     gboolean is_eos_handling_active;
 } CustomData;
 
+static GstCaps *display_caps()
+{
+    const char *format = getenv("RKNN_DISPLAY_FORMAT");
+    if (format != NULL)
+    {
+        return gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, format, NULL);
+    }
+    return gst_caps_from_string("video/x-raw, format=(string)" DISPLAY_FORMATS);
+}
+
 // 2. 更新渲染相关属性
 static void update_rendering_properties(CustomData *data, int width, int height) {
     GstCaps *scale_caps = gst_caps_new_simple("video/x-raw", "width", G_TYPE_INT, width,
                                               "height", G_TYPE_INT, height, NULL);
     g_object_set(data->scale_capsfilter, "caps", scale_caps, NULL);
     gst_caps_unref(scale_caps);
-    GstCaps *rgb_caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "BGRA", NULL);
-    g_object_set(data->rgb_capsfilter, "caps", rgb_caps, NULL);
-    gst_caps_unref(rgb_caps);
+    GstCaps *format_caps = display_caps();
+    g_object_set(data->format_capsfilter, "caps", format_caps, NULL);
+    gst_caps_unref(format_caps);
     const gchar *property_name = "render-rectangle";
     GValue render_rectangle = G_VALUE_INIT;
     g_value_init(&render_rectangle, GST_TYPE_ARRAY);
@@ -345,276 +369,202 @@ static gboolean on_bus_message(GstBus *bus, GstMessage *msg, CustomData *data) {
     }
     return TRUE;
 }
-// Function to draw a rectangle on an RGB frame
-void draw_box_on_rgb_frame(guint8 *rgb_frame, int width, int height, int x, int y, int box_width, int box_height)
+
+// Where the model runs: the NPU, or recorded outputs with RKNN_REPLAY_DIR
+static InferenceBackend *G_BACKEND = NULL;
+// Input size and head geometry of the loaded model, as the backend reports it
+static int G_MODEL_WIDTH = 0;
+static int G_MODEL_HEIGHT = 0;
+static YoloModel G_MODEL;
+// RKNN_CLASSES allow-list, empty for every class
+static int G_CLASSES[YOLO_MAX_CLASSES];
+static float G_CLASS_THRESHOLDS[YOLO_MAX_CLASSES];
+static int G_NUM_CLASSES = 0;
+
+// Inference runs on the analytics worker threads, off the streaming thread
+static AnalyticsStage G_ANALYTICS;
+// Decode scratch per analytics worker, reused every frame
+static PostProcessWorkspace G_POSTPROCESS[INFERENCE_MAX_WORKERS];
+// Class names rendered once at startup, blended onto the display frames
+static LabelAtlas G_LABEL_ATLAS;
+static int G_BOX_THICKNESS = OVERLAY_DEFAULT_THICKNESS;
+// RKNN_DUMP_OUTPUTS=<dir>: raw outputs of the first frames, for bench-decode
+static const char *G_DUMP_DIR = NULL;
+static std::atomic<int> G_DUMPED_FRAMES(0);
+
+// RKNN_PREPROCESS: auto (RGA, CPU fallback) | rga | cpu
+typedef enum _PreprocessMode
 {
-    // Each pixel in RGB is 3 bytes (R, G, B)
-    for (int i = 0; i < box_width; i++)
-    {
-        // Draw top line of the box
-        guint8 *top_pixel = rgb_frame + ((y * width + x + i) * 3);
-        top_pixel[0] = 255; // R
-        top_pixel[1] = 0;   // G
-        top_pixel[2] = 0;   // B
+    PREPROCESS_AUTO,
+    PREPROCESS_RGA,
+    PREPROCESS_CPU,
+} PreprocessMode;
 
-        // Draw bottom line of the box
-        guint8 *bottom_pixel = rgb_frame + (((y + box_height - 1) * width + x + i) * 3);
-        bottom_pixel[0] = 255; // R
-        bottom_pixel[1] = 0;   // G
-        bottom_pixel[2] = 0;   // B
-    }
+static PreprocessMode G_PREPROCESS_MODE = PREPROCESS_AUTO;
 
-    for (int i = 0; i < box_height; i++)
-    {
-        // Draw left line of the box
-        guint8 *left_pixel = rgb_frame + (((y + i) * width + x) * 3);
-        left_pixel[0] = 255; // R
-        left_pixel[1] = 0;   // G
-        left_pixel[2] = 0;   // B
+// RKNN_OVERLAY: auto (RGA, CPU fallback) | rga | cpu | none (detections only
+// as metas, nothing drawn); a DetectionOverlayBackend, -1 for none
+static int G_OVERLAY_BACKEND = DETECTION_OVERLAY_AUTO;
 
-        // Draw right line of the box
-        guint8 *right_pixel = rgb_frame + (((y + i) * width + x + box_width - 1) * 3);
-        right_pixel[0] = 255; // R
-        right_pixel[1] = 0;   // G
-        right_pixel[2] = 0;   // B
-    }
-}
-
-// Function to draw a rectangle on an RGBA frame
-void draw_box_on_rgba_frame(guint8 *rgba_frame, int width, int height, int x, int y, int box_width, int box_height)
+static int get_env_int(const char *name, int default_value)
 {
-    // Each pixel in RGBA is 4 bytes (R, G, B, A)
-    for (int i = 0; i < box_width; i++)
-    {
-        // Draw top line of the box
-        guint8 *top_pixel = rgba_frame + ((y * width + x + i) * 4);
-        top_pixel[0] = 255; // R
-        top_pixel[1] = 0;   // G
-        top_pixel[2] = 0;   // B
-        top_pixel[3] = 255; // A (opaque)
-
-        // Draw bottom line of the box
-        guint8 *bottom_pixel = rgba_frame + (((y + box_height - 1) * width + x + i) * 4);
-        bottom_pixel[0] = 255; // R
-        bottom_pixel[1] = 0;   // G
-        bottom_pixel[2] = 0;   // B
-        bottom_pixel[3] = 255; // A (opaque)
-    }
-
-    for (int i = 0; i < box_height; i++)
-    {
-        // Draw left line of the box
-        guint8 *left_pixel = rgba_frame + (((y + i) * width + x) * 4);
-        left_pixel[0] = 255; // R
-        left_pixel[1] = 0;   // G
-        left_pixel[2] = 0;   // B
-        left_pixel[3] = 255; // A (opaque)
-
-        // Draw right line of the box
-        guint8 *right_pixel = rgba_frame + (((y + i) * width + x + box_width - 1) * 4);
-        right_pixel[0] = 255; // R
-        right_pixel[1] = 0;   // G
-        right_pixel[2] = 0;   // B
-        right_pixel[3] = 255; // A (opaque)
-    }
+    const char *value = getenv(name);
+    return value != NULL ? atoi(value) : default_value;
 }
 
-FT_Library ft_library;
-FT_Face ft_face;
-
-// Function to draw text on RGB frame using FreeType
-static void draw_text_on_rgb_frame_freetype(guint8 *rgb_frame, const char *font_path, guint width, guint height, const char *text, int x, int y)
+// Decoding settings on top of the backend's model description. RKNN_ANCHORS
+// ("10,13,16,30,...", heads in output order) replaces the default YOLOv5
+// anchors of custom models.
+static int configure_model()
 {
-    static int ft_init = -1;
-    if (ft_init == -1)
-    {
-        if (FT_Init_FreeType(&ft_library))
-        {
-            return;
-        }
-
-        if (FT_New_Face(ft_library, font_path, 0, &ft_face))
-        {
-            FT_Done_FreeType(ft_library);
-            return;
-        }
-
-        ft_init = 0;
-    }
-
-    // Set the font size
-    FT_Set_Pixel_Sizes(ft_face, 0, 24);
+    G_MODEL = G_BACKEND->model();
+    G_MODEL_WIDTH = G_MODEL.input_w;
+    G_MODEL_HEIGHT = G_MODEL.input_h;
 
-    // Draw each character
-    int pen_x = x;
-    int pen_y = y;
-    for (const char *p = text; *p; ++p)
+    const char *anchors = getenv("RKNN_ANCHORS");
+    if (anchors != NULL)
     {
-        if (FT_Load_Char(ft_face, *p, FT_LOAD_RENDER))
-        {
-            continue;
-        }
-
-        FT_Bitmap *bitmap = &ft_face->glyph->bitmap;
-        int bitmap_width = bitmap->width;
-        int bitmap_height = bitmap->rows;
-        int bitmap_left = ft_face->glyph->bitmap_left;
-        int bitmap_top = ft_face->glyph->bitmap_top;
-
-        // Copy bitmap to RGB frame
-        for (int row = 0; row < bitmap_height; ++row)
+        int values[YOLO_MAX_HEADS * YOLO_MAX_ANCHORS * 2];
+        int count = 0;
+        const char *p = anchors;
+        while (count < (int)(sizeof(values) / sizeof(values[0])) && *p != '\0')
         {
-            for (int col = 0; col < bitmap_width; ++col)
+            char *end;
+            long value = strtol(p, &end, 10);
+            if (end == p)
             {
-                int x_offset = pen_x + bitmap_left + col;
-                int y_offset = pen_y - bitmap_top + row;
-
-                if (x_offset >= 0 && x_offset < width && y_offset >= 0 && y_offset < height)
-                {
-                    int index = (y_offset * width + x_offset) * 3;
-                    uint8_t gray = bitmap->buffer[row * bitmap->width + col];
-                    rgb_frame[index] = gray;     // Red
-                    rgb_frame[index + 1] = gray; // Green
-                    rgb_frame[index + 2] = gray; // Blue
-                }
+                break;
             }
+            values[count++] = (int)value;
+            p = *end == ',' ? end + 1 : end;
         }
-
-        pen_x += ft_face->glyph->advance.x >> 6; // Advance to the next character position
-    }
-}
-
-// Function to draw text on RGBA frame using FreeType
-static void draw_text_on_rgba_frame_freetype(guint8 *rgba_frame, const char *font_path, guint width, guint height, const char *text, int x, int y)
-{
-    static int ft_init = -1;
-    if (ft_init == -1)
-    {
-        if (FT_Init_FreeType(&ft_library))
+        if (yolo_model_set_anchors(&G_MODEL, values, count) < 0)
         {
-            return;
+            std::cerr << "RKNN_ANCHORS: expected " << G_MODEL.num_heads * YOLO_MAX_ANCHORS * 2 << " values" << std::endl;
+            return -1;
         }
-
-        if (FT_New_Face(ft_library, font_path, 0, &ft_face))
-        {
-            FT_Done_FreeType(ft_library);
-            return;
-        }
-
-        ft_init = 0;
     }
 
-    // Set the font size
-    FT_Set_Pixel_Sizes(ft_face, 0, 24);
-
-    // Draw each character
-    int pen_x = x;
-    int pen_y = y;
-    for (const char *p = text; *p; ++p)
+    // RKNN_CLASSES ("0,1,2:0.4,3,5,7"): decode only these class ids, each
+    // with an optional score threshold (BOX_THRESH otherwise)
+    const char *classes = getenv("RKNN_CLASSES");
+    for (const char *p = classes; p != NULL && *p != '\0' && G_NUM_CLASSES < YOLO_MAX_CLASSES;)
     {
-        if (FT_Load_Char(ft_face, *p, FT_LOAD_RENDER))
+        char *end;
+        long id = strtol(p, &end, 10);
+        if (end == p || id < 0 || id >= G_MODEL.num_classes)
         {
-            continue;
+            std::cerr << "RKNN_CLASSES: expected class ids below " << G_MODEL.num_classes << std::endl;
+            return -1;
         }
-
-        FT_Bitmap *bitmap = &ft_face->glyph->bitmap;
-        int bitmap_width = bitmap->width;
-        int bitmap_height = bitmap->rows;
-        int bitmap_left = ft_face->glyph->bitmap_left;
-        int bitmap_top = ft_face->glyph->bitmap_top;
-
-        // Copy bitmap to RGBA frame
-        for (int row = 0; row < bitmap_height; ++row)
+        G_CLASSES[G_NUM_CLASSES] = (int)id;
+        G_CLASS_THRESHOLDS[G_NUM_CLASSES] = BOX_THRESH;
+        if (*end == ':')
         {
-            for (int col = 0; col < bitmap_width; ++col)
-            {
-                int x_offset = pen_x + bitmap_left + col;
-                int y_offset = pen_y - bitmap_top + row;
-
-                if (x_offset >= 0 && x_offset < width && y_offset >= 0 && y_offset < height)
-                {
-                    int index = (y_offset * width + x_offset) * 4;
-                    uint8_t gray = bitmap->buffer[row * bitmap->width + col];
-
-                    rgba_frame[index] = gray;     // Red
-                    rgba_frame[index + 1] = gray; // Green
-                    rgba_frame[index + 2] = gray; // Blue
-                    rgba_frame[index + 3] = 255;  // Alpha (fully opaque)
-                }
-            }
+            p = end + 1;
+            G_CLASS_THRESHOLDS[G_NUM_CLASSES] = strtof(p, &end);
         }
-
-        pen_x += ft_face->glyph->advance.x >> 6; // Advance to the next character position
+        G_NUM_CLASSES++;
+        p = *end == ',' ? end + 1 : end;
     }
+    std::cout << "model " << G_MODEL_WIDTH << "x" << G_MODEL_HEIGHT << " classes=" << G_MODEL.num_classes
+              << " heads=" << G_MODEL.num_heads
+              << " decoded classes=" << (G_NUM_CLASSES > 0 ? G_NUM_CLASSES : G_MODEL.num_classes) << std::endl;
+    return 0;
 }
 
-void *G_DIST_BUFFER;
-rknn_context G_RKNN_CONTEXT = 0;
-rknn_input_output_num G_IO_NUM;
-rknn_sdk_version G_SDK_VER;
-rknn_tensor_attr *G_INPUT_ATTRS;
-rknn_tensor_attr *G_OUTPUT_ATTRS;
-
 static int bootstrap_init(int *argc, char ***argv)
 {
-    // Malloc a buffer for the output of the rknn model
-    G_DIST_BUFFER = malloc(RKNN_WIDTH * RKNN_HEIGHT * 3);
-    if (G_DIST_BUFFER == NULL)
+    InferenceOptions options;
+    memset(&options, 0, sizeof(options));
+    options.model_path = "./yolov5s-640-640.rknn";
+    options.pipelined = get_env_int("RKNN_PIPELINE", 0) != 0;
+    options.zero_copy = get_env_int("RKNN_ZERO_COPY", 0) != 0;
+    options.native_outputs = get_env_int("RKNN_NATIVE_OUTPUTS", 0) != 0;
+    options.core_mode = getenv("RKNN_CORE_MODE");
+    options.contexts = get_env_int("RKNN_CONTEXTS", INFERENCE_DEFAULT_CONTEXTS);
+    options.replay_dir = getenv("RKNN_REPLAY_DIR");
+    options.replay_latency_us = get_env_int("RKNN_REPLAY_LATENCY_US", 0);
+    options.replay_jitter_us = get_env_int("RKNN_REPLAY_JITTER_US", 0);
+    options.share_internal_mem = get_env_int("RKNN_SHARE_INTERNAL_MEM", 0) != 0;
+    options.profile_interval = get_env_int("RKNN_PROFILE", 0);
+    options.profile_path = getenv("RKNN_PROFILE_REPORT") != NULL ? getenv("RKNN_PROFILE_REPORT") : "./rknn_profile.txt";
+    G_DUMP_DIR = getenv("RKNN_DUMP_OUTPUTS");
+
+    const char *preprocess = getenv("RKNN_PREPROCESS");
+    if (preprocess != NULL && strcmp(preprocess, "rga") == 0)
     {
-        return -1;
+        G_PREPROCESS_MODE = PREPROCESS_RGA;
     }
-
-    // Load RKNN Model
-    int ret = rknn_init(&G_RKNN_CONTEXT, (void *)"./yolov5s-640-640.rknn", 0, 0, NULL);
-    if (ret < 0)
+    else if (preprocess != NULL && strcmp(preprocess, "cpu") == 0)
+    {
+        G_PREPROCESS_MODE = PREPROCESS_CPU;
+    }
+    std::cout << "preprocess=" << (preprocess != NULL ? preprocess : "auto") << " cpu kernels=" << cpu_preprocess_kernels()
+              << std::endl;
+
+    // RKNN_REPLAY_DIR replays recorded outputs instead of running the NPU;
+    // builds without librknnrt (INFERENCE_BACKEND=replay) always replay
+#ifdef INFERENCE_HAVE_RKNN
+    G_BACKEND = options.replay_dir != NULL ? replay_backend_create() : rknn_backend_create();
+#else
+    G_BACKEND = replay_backend_create();
+#endif
+    std::cout << "inference backend=" << G_BACKEND->name() << std::endl;
+    if (G_BACKEND->init(options) < 0)
     {
-        std::cerr << "rknn_init fail! ret=" << ret << std::endl;
         return -1;
     }
-
-    // Set core mask
-    // ret = rknn_set_core_mask(G_RKNN_CONTEXT, RKNN_NPU_CORE_0_1_2);
-    // if (ret < 0)
-    // {
-    //     std::cerr << "rknn_set_core_mask fail! ret=" << ret << std::endl;
-    //     return -1;
-    // }
-
-    // Get sdk and driver version
-    ret = rknn_query(G_RKNN_CONTEXT, RKNN_QUERY_SDK_VERSION, &G_SDK_VER, sizeof(G_SDK_VER));
-    if (ret != RKNN_SUCC)
+    if (configure_model() < 0)
     {
-        std::cerr << "rknn_query fail! ret=" << ret << std::endl;
         return -1;
     }
-    std::cout << "api version: " << G_SDK_VER.api_version << std::endl;
 
-    // Get Model Input Output Info
-    ret = rknn_query(G_RKNN_CONTEXT, RKNN_QUERY_IN_OUT_NUM, &G_IO_NUM, sizeof(G_IO_NUM));
-    if (ret != RKNN_SUCC)
+    // Decode scratch and quantization are set up once, not per frame.
+    // RKNN_DECODE_THREADS: threads per context decoding a frame's heads, for
+    // when the NPU outruns one (little) core
+    int decode_threads = get_env_int("RKNN_DECODE_THREADS", 1);
+    for (int w = 0; w < G_BACKEND->workers(); w++)
     {
-        std::cerr << "rknn_query fail! ret=" << ret << std::endl;
-        return -1;
+        G_POSTPROCESS[w].set_decode_threads(decode_threads);
+        G_POSTPROCESS[w].configure(G_MODEL);
+        G_POSTPROCESS[w].set_classes(G_CLASSES, G_CLASS_THRESHOLDS, G_NUM_CLASSES);
     }
-    std::cout << "n_input=" << G_IO_NUM.n_input << " n_output=" << G_IO_NUM.n_output << std::endl;
+    std::cout << "decode threads=" << decode_threads << " parallel=" << G_POSTPROCESS[0].parallel() << std::endl;
 
-    G_INPUT_ATTRS = (rknn_tensor_attr *)malloc(G_IO_NUM.n_input * sizeof(rknn_tensor_attr));
-    memset(G_INPUT_ATTRS, 0, G_IO_NUM.n_input * sizeof(rknn_tensor_attr));
-    for (uint32_t i = 0; i < G_IO_NUM.n_input; i++)
+    // RKNN_LABEL_SIZE: label text height in pixels
+    static char fallback_labels[YOLO_MAX_CLASSES][OBJ_NAME_MAX_SIZE];
+    const char *labels[YOLO_MAX_CLASSES];
+    for (int i = 0; i < G_MODEL.num_classes; i++)
     {
-        G_INPUT_ATTRS[i].index = i;
-        rknn_query(G_RKNN_CONTEXT, RKNN_QUERY_INPUT_ATTR, &(G_INPUT_ATTRS[i]), sizeof(rknn_tensor_attr));
+        labels[i] = post_process_label(i);
+        if (labels[i] == NULL)
+        {
+            snprintf(fallback_labels[i], OBJ_NAME_MAX_SIZE, "class%d", i);
+            labels[i] = fallback_labels[i];
+        }
+    }
+    const char *overlay = getenv("RKNN_OVERLAY");
+    if (overlay != NULL && strcmp(overlay, "rga") == 0)
+    {
+        G_OVERLAY_BACKEND = DETECTION_OVERLAY_RGA;
+    }
+    else if (overlay != NULL && strcmp(overlay, "cpu") == 0)
+    {
+        G_OVERLAY_BACKEND = DETECTION_OVERLAY_CPU;
+    }
+    else if (overlay != NULL && strcmp(overlay, "none") == 0)
+    {
+        G_OVERLAY_BACKEND = -1;
     }
-    std::cout << "input[0] fmt=" << get_format_string(G_INPUT_ATTRS[0].fmt) << std::endl; // npu only support NHWC in zero copy mode
+    std::cout << "overlay=" << (overlay != NULL ? overlay : "auto") << std::endl;
 
-    G_OUTPUT_ATTRS = (rknn_tensor_attr *)malloc(G_IO_NUM.n_output * sizeof(rknn_tensor_attr));
-    memset(G_OUTPUT_ATTRS, 0, G_IO_NUM.n_output * sizeof(rknn_tensor_attr));
-    for (int i = 0; i < G_IO_NUM.n_output; i++)
+    int label_size = get_env_int("RKNN_LABEL_SIZE", LABEL_PIXEL_SIZE);
+    G_BOX_THICKNESS = get_env_int("RKNN_BOX_THICKNESS", OVERLAY_DEFAULT_THICKNESS);
+    if (G_OVERLAY_BACKEND >= 0 && G_LABEL_ATLAS.init(LABEL_FONT_PATH, label_size, labels, G_MODEL.num_classes) < 0)
     {
-        G_OUTPUT_ATTRS[i].index = i;
-        rknn_query(G_RKNN_CONTEXT, RKNN_QUERY_OUTPUT_ATTR, &(G_OUTPUT_ATTRS[i]), sizeof(rknn_tensor_attr));
+        std::cerr << "cannot load " << LABEL_FONT_PATH << ", labels are not drawn" << std::endl;
     }
-    std::cout << "output[0] fmt=" << get_format_string(G_OUTPUT_ATTRS[0].fmt) << std::endl;
 
     return 0;
 }
@@ -681,119 +631,252 @@ void save_image_to_disk(const std::string &file_path, const guint8 *rgba_frame,
     std::cout << "Image saved to " << file_path << std::endl;
 }
 
-static GstPadProbeReturn process_frame_callback(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+static int inference_alloc_input(AnalyticsFrame *frame, size_t size, void *user_data)
+{
+    return G_BACKEND->alloc_input(frame, size);
+}
+
+static void inference_free_input(AnalyticsFrame *frame, void *user_data) { G_BACKEND->free_input(frame); }
+
+// Runs on the analytics worker: model input is already resized by the probe
+static int inference_run(int worker, AnalyticsFrame *frame, void *user_data) { return G_BACKEND->run(worker, frame); }
+
+static void dump_outputs(void **output_bufs)
 {
-    struct timeval start_time, stop_time;
-    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
-    g_print("process_frame_callback ...\n");
-    // Map the buffer to access frame data
-    GstMapInfo map;
-    if (gst_buffer_map(buffer, &map, GST_MAP_READWRITE))
-    {
-        // Assuming RGB format (video/x-raw, format=RGB)
-        guint8 *rgba_frame = map.data; // Pointer to RGB data
-
-        gettimeofday(&start_time, NULL);
-        // Resize the frame using RGA
-        // rga_buffer_handle_t src_handle = importbuffer_virtualaddr(rgba_frame, RENDERING_WIDTH * RENDERING_HEIGHT * RENDERING_CHANNEL);
-        // rga_buffer_handle_t dst_handle = importbuffer_virtualaddr(G_DIST_BUFFER, RKNN_WIDTH * RKNN_HEIGHT * RKNN_CHANNEL);
-        // if (src_handle == 0 || dst_handle == 0)
-        // {
-        //     g_print("gst_buffer_map %d, dst_handle:%d...\n", src_handle, dst_handle);
-        //     return GST_PAD_PROBE_OK;
-        // }
-
-        // 使用自适应宽高
-        int frame_width = g_rendering_width > 0 ? g_rendering_width : RENDERING_WIDTH;
-        int frame_height = g_rendering_height > 0 ? g_rendering_height : RENDERING_HEIGHT;
-        rga_buffer_t src_img = {0};
-        rga_buffer_t dst_img = {0};
-        src_img.vir_addr = (void *)rgba_frame; 
-        src_img.width = frame_width;
-        src_img.height = frame_height;
-        src_img.format = RK_FORMAT_RGBA_8888;
-        src_img.wstride = frame_width; 
-        src_img.hstride = frame_height;
-        dst_img.vir_addr = (void *)G_DIST_BUFFER;
-        dst_img.width = RKNN_WIDTH;
-        dst_img.height = RKNN_HEIGHT;
-        dst_img.format = RK_FORMAT_RGB_888;
-        dst_img.wstride = RKNN_WIDTH;
-        dst_img.hstride = RKNN_HEIGHT;
-
-
-        int ret = imcheck(src_img, dst_img, {}, {});
-        if (ret != IM_STATUS_NOERROR)
+    int index = G_DUMPED_FRAMES++;
+    if (index >= RKNN_DUMP_MAX_FRAMES)
+    {
+        return;
+    }
+    char path[256];
+    if (index == 0)
+    {
+        // what bench-golden and the replay backend need to decode the dumps
+        snprintf(path, sizeof(path), "%s/model.txt", G_DUMP_DIR);
+        FILE *fp = fopen(path, "w");
+        if (fp != NULL)
         {
-            return GST_PAD_PROBE_OK;
+            yolo_model_write(fp, &G_MODEL);
+            fclose(fp);
         }
-
-        ret = imresize(src_img, dst_img);
-        if (ret != IM_STATUS_SUCCESS)
+    }
+    for (int i = 0; i < G_MODEL.num_heads; i++)
+    {
+        snprintf(path, sizeof(path), "%s/frame%03d_out%d.bin", G_DUMP_DIR, index, i);
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL)
         {
-             g_print("imresize failed");
-            return GST_PAD_PROBE_OK;
+            g_print("cannot write %s\n", path);
+            return;
         }
+        fwrite(output_bufs[i], 1, yolo_head_size(&G_MODEL, i), fp);
+        fclose(fp);
+    }
+}
 
-        float scale_w = (float)RKNN_WIDTH / frame_width;
-        float scale_h = (float)RKNN_HEIGHT / frame_height;
+// Waits for the outputs of the oldest frame in flight and decodes them
+static int inference_collect(int worker, AnalyticsFrame **frame, detect_result_group_t *detect_result_group,
+                             void *user_data)
+{
+    InferenceResult result;
+    int ret = G_BACKEND->wait(worker, &result);
+    *frame = result.frame;
+    if (ret < 0)
+    {
+        return -1;
+    }
 
-        rknn_input inputs[1];
-        memset(inputs, 0, sizeof(inputs));
-        inputs[0].index = 0;
-        inputs[0].type = RKNN_TENSOR_UINT8;
-        inputs[0].size = RKNN_WIDTH * RKNN_HEIGHT * RKNN_CHANNEL;
-        inputs[0].fmt = RKNN_TENSOR_NHWC;
-        inputs[0].pass_through = 0;
-        inputs[0].buf = G_DIST_BUFFER;
+    struct timeval outputs_time;
+    gettimeofday(&outputs_time, NULL);
+    if (G_DUMP_DIR != NULL)
+    {
+        dump_outputs(result.outputs);
+    }
 
-        rknn_inputs_set(G_RKNN_CONTEXT, G_IO_NUM.n_input, inputs);
+    float scale_w = (float)G_MODEL_WIDTH / (*frame)->src_width;
+    float scale_h = (float)G_MODEL_HEIGHT / (*frame)->src_height;
 
-        rknn_output outputs[G_IO_NUM.n_output];
-        memset(outputs, 0, sizeof(outputs));
-        for (int i = 0; i < G_IO_NUM.n_output; i++)
-        {
-            outputs[i].index = i;
-            outputs[i].want_float = 0;
-        }
+    post_process(result.outputs, BOX_THRESH, NMS_THRESH, scale_w, scale_h, &G_POSTPROCESS[worker], detect_result_group);
+    G_BACKEND->release(worker);
 
-        ret = rknn_run(G_RKNN_CONTEXT, NULL);
-        ret = rknn_outputs_get(G_RKNN_CONTEXT, G_IO_NUM.n_output, outputs, NULL);
+    // run() to outputs (queueing on the NPU included), then decoding + NMS
+    struct timeval stop_time;
+    gettimeofday(&stop_time, NULL);
+    std::cout << "Inference time (ctx " << worker << "): " << (__get_us(stop_time) - __get_us(result.start_time)) / 1000
+              << " ms (npu " << (__get_us(outputs_time) - __get_us(result.start_time)) / 1000 << " ms, post-process "
+              << (__get_us(stop_time) - __get_us(outputs_time)) / 1000 << " ms)" << std::endl;
+    return 0;
+}
 
-        detect_result_group_t detect_result_group;
-        std::vector<float> out_scales;
-        std::vector<int32_t> out_zps;
-        for (int i = 0; i < G_IO_NUM.n_output; ++i)
-        {
-            out_scales.push_back(G_OUTPUT_ATTRS[i].scale);
-            out_zps.push_back(G_OUTPUT_ATTRS[i].zp);
-        }
-        post_process((int8_t *)outputs[0].buf, (int8_t *)outputs[1].buf, (int8_t *)outputs[2].buf, RKNN_HEIGHT, RKNN_WIDTH,
-                     BOX_THRESH, NMS_THRESH, scale_w, scale_h, out_zps, out_scales, &detect_result_group);
+static const AnalyticsOps G_INFERENCE_OPS = {inference_run, inference_collect, NULL, NULL};
+static const AnalyticsOps G_INFERENCE_DEVICE_INPUT_OPS = {inference_run, inference_collect, inference_alloc_input,
+                                                          inference_free_input};
 
-        for (int i = 0; i < detect_result_group.count; i++)
-        {
-            detect_result_t *det_result = &(detect_result_group.results[i]);
+// Format of the decoder output seen by the analytics branch, updated from
+// its CAPS events on the streaming thread
+typedef struct _AnalyticsTapInfo
+{
+    int width;
+    int height;
+    GstVideoFormat format;
+    int rga_format;
+} AnalyticsTapInfo;
+
+static AnalyticsTapInfo G_ANALYTICS_TAP = {0, 0, GST_VIDEO_FORMAT_UNKNOWN, -1};
+
+// Resize the decoded frame into a free analytics slot and queue it. This sees
+// mppvideodec's native NV12, so a single RGA job does the colour conversion
+// and the resize; the frame is imported into RGA by fd when it is a dma-buf,
+// so hardware buffers are never touched by the CPU on their way to the NPU.
+// The SIMD CPU preprocessor takes over when RGA cannot read the format or
+// rejects the job (e.g. saturated by other streams), or when forced.
+static void submit_frame_for_analytics(GstBuffer *buffer)
+{
+    if (G_ANALYTICS_TAP.format == GST_VIDEO_FORMAT_UNKNOWN)
+    {
+        return;
+    }
+    AnalyticsFrame *frame = G_ANALYTICS.acquire();
+    if (frame == NULL)
+    {
+        return;
+    }
 
-            // Draw a box on the RGB frame
-            draw_box_on_rgba_frame(rgba_frame, frame_width, frame_height, det_result->box.left, det_result->box.top,
-                                   det_result->box.right - det_result->box.left, det_result->box.bottom - det_result->box.top);
+    bool ready = false;
+    if (G_PREPROCESS_MODE != PREPROCESS_CPU && G_ANALYTICS_TAP.rga_format >= 0)
+    {
+        ready = rga_preprocess_frame(buffer, G_ANALYTICS_TAP.width, G_ANALYTICS_TAP.height, G_ANALYTICS_TAP.rga_format,
+                                     frame, G_MODEL_WIDTH, G_MODEL_HEIGHT, G_BACKEND->input_wstride()) == 0;
+    }
+    if (!ready && G_PREPROCESS_MODE != PREPROCESS_RGA)
+    {
+        ready = cpu_preprocess_frame(buffer, G_ANALYTICS_TAP.width, G_ANALYTICS_TAP.height, G_ANALYTICS_TAP.format,
+                                     frame, G_MODEL_WIDTH, G_MODEL_HEIGHT, G_BACKEND->input_wstride()) == 0;
+    }
+    if (!ready)
+    {
+        G_ANALYTICS.discard(frame);
+        return;
+    }
+
+    frame->pts = GST_BUFFER_PTS(buffer);
+    frame->src_width = G_ANALYTICS_TAP.width;
+    frame->src_height = G_ANALYTICS_TAP.height;
+    G_ANALYTICS.submit(frame);
+}
+
+static GstPadProbeReturn analytics_tap_callback(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    {
+        submit_frame_for_analytics(GST_PAD_PROBE_INFO_BUFFER(info));
+        return GST_PAD_PROBE_OK;
+    }
 
-            // Draw text using FreeType
-            draw_text_on_rgba_frame_freetype(rgba_frame, "./simsun.ttc", frame_width, frame_height, det_result->name,
-                                             det_result->box.left, det_result->box.top);
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+    {
+        GstCaps *caps;
+        GstVideoInfo video_info;
+        gst_event_parse_caps(event, &caps);
+        if (gst_video_info_from_caps(&video_info, caps))
+        {
+            G_ANALYTICS_TAP.width = GST_VIDEO_INFO_WIDTH(&video_info);
+            G_ANALYTICS_TAP.height = GST_VIDEO_INFO_HEIGHT(&video_info);
+            G_ANALYTICS_TAP.format = GST_VIDEO_INFO_FORMAT(&video_info);
+            G_ANALYTICS_TAP.rga_format = rga_format_from_video_format(G_ANALYTICS_TAP.format);
+            if (G_ANALYTICS_TAP.rga_format < 0)
+            {
+                g_print("analytics: RGA cannot read %s, using the CPU preprocessor\n",
+                        gst_video_format_to_string(G_ANALYTICS_TAP.format));
+            }
         }
+    }
+    return GST_PAD_PROBE_OK;
+}
 
-        // save_image_to_disk("output.png", rgba_frame, frame_width, frame_height);
+// Display frames as negotiated on the format capsfilter, for box coordinates
+static GstVideoInfo G_DISPLAY_INFO;
+static bool G_DISPLAY_INFO_VALID = false;
 
-        gettimeofday(&stop_time, NULL);
-        std::cout << "Inference time: " << (__get_us(stop_time) - __get_us(start_time)) / 1000 << " ms" << std::endl;
-        rknn_outputs_release(G_RKNN_CONTEXT, G_IO_NUM.n_output, outputs);
+static GstPadProbeReturn display_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+    {
+        GstCaps *caps;
+        gst_event_parse_caps(event, &caps);
+        G_DISPLAY_INFO_VALID = gst_video_info_from_caps(&G_DISPLAY_INFO, caps);
+        if (G_DISPLAY_INFO_VALID)
+        {
+            g_print("display: %s %dx%d\n", gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&G_DISPLAY_INFO)),
+                    GST_VIDEO_INFO_WIDTH(&G_DISPLAY_INFO), GST_VIDEO_INFO_HEIGHT(&G_DISPLAY_INFO));
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
 
-        // Unmap when done
-        gst_buffer_unmap(buffer, &map);
+static int clamp_coord(float v, int max)
+{
+    return v < 0 ? 0 : v > max ? max : (int)v;
+}
+
+// Attaches the newest result as GstVideoRegionOfInterestMeta in display
+// coordinates; the pixels are neither mapped nor copied. The overlay element,
+// if any, draws from the metas.
+static GstPadProbeReturn attach_detections_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    if (!G_DISPLAY_INFO_VALID)
+    {
+        return GST_PAD_PROBE_OK;
     }
+    // It usually belongs to an earlier frame
+    AnalyticsResult result;
+    if (!G_ANALYTICS.latest(GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)), &result) || result.group.count == 0)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    // Metas need a writable buffer, but a shared one is only copied shallowly:
+    // the new buffer refers to the same memory
+    GstBuffer *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+    int width = GST_VIDEO_INFO_WIDTH(&G_DISPLAY_INFO);
+    int height = GST_VIDEO_INFO_HEIGHT(&G_DISPLAY_INFO);
+    float sx = (float)width / result.src_width;
+    float sy = (float)height / result.src_height;
+    for (int i = 0; i < result.group.count; i++)
+    {
+        detect_result_t *det_result = &(result.group.results[i]);
+        int left = clamp_coord(det_result->box.left * sx, width);
+        int top = clamp_coord(det_result->box.top * sy, height);
+        int right = clamp_coord(det_result->box.right * sx, width);
+        int bottom = clamp_coord(det_result->box.bottom * sy, height);
+        if (right <= left || bottom <= top)
+        {
+            continue;
+        }
+        // name[] is a fixed-size field; terminate a copy before it becomes a quark
+        char name[OBJ_NAME_MAX_SIZE + 1];
+        snprintf(name, sizeof(name), "%.*s", OBJ_NAME_MAX_SIZE, det_result->name);
+        GstVideoRegionOfInterestMeta *meta =
+            gst_buffer_add_video_region_of_interest_meta(buffer, name, left, top, right - left, bottom - top);
+        meta->id = i;
+        gst_video_region_of_interest_meta_add_param(
+            meta, gst_structure_new(DETECTION_META_PARAMS, DETECTION_META_CLASS_ID, G_TYPE_INT, det_result->class_id,
+                                    DETECTION_META_CONFIDENCE, G_TYPE_DOUBLE, (double)det_result->prop, NULL));
+    }
+    return GST_PAD_PROBE_OK;
+}
 
+// Queued frames and results are stale after a flushing seek (e.g. looping)
+static GstPadProbeReturn analytics_flush_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+    {
+        G_ANALYTICS.flush();
+    }
     return GST_PAD_PROBE_OK;
 }
 // --- Main Function ---
@@ -802,10 +885,22 @@ int main(int argc, char *argv[]) {
     gchar *uri;
 
     // Your custom initialization
-    bootstrap_init(&argc, &argv);
+    if (bootstrap_init(&argc, &argv) < 0)
+    {
+        g_printerr("Failed to set up inference\n");
+        return -1;
+    }
+    if (G_ANALYTICS.start(G_BACKEND->input_size(), ANALYTICS_QUEUE_DEPTH, G_BACKEND->workers(),
+                          G_BACKEND->pipeline_depth(),
+                          G_BACKEND->device_inputs() ? &G_INFERENCE_DEVICE_INPUT_OPS : &G_INFERENCE_OPS, NULL) < 0)
+    {
+        g_printerr("Failed to start analytics stage\n");
+        return -1;
+    }
 
     // Initialize GStreamer
     gst_init(&argc, &argv);
+    detection_overlay_register();
 
    // Check for command-line arguments. If there are none, use a default URI.
     if (argc < 2) {
@@ -824,11 +919,30 @@ int main(int argc, char *argv[]) {
     data.parse = NULL;
     data.depay = NULL;
     data.decoder = gst_element_factory_make("mppvideodec", "decoder");
+    if (!data.decoder) {
+        // hosts without the Rockchip MPP plugin, e.g. replay builds on x86
+        data.decoder = gst_element_factory_make("avdec_h264", "decoder");
+    }
+    data.tee = gst_element_factory_make("tee", "tee");
+    data.display_queue = gst_element_factory_make("queue", "display_queue");
+    data.analytics_queue = gst_element_factory_make("queue", "analytics_queue");
+    data.analytics_sink = gst_element_factory_make("fakesink", "analytics_sink");
     data.videoscale = gst_element_factory_make("videoscale", "videoscale");
     data.scale_capsfilter = gst_element_factory_make("capsfilter", "scale_capsfilter");
     data.videoconvert = gst_element_factory_make("videoconvert", "videoconvert");
-    data.rgb_capsfilter = gst_element_factory_make("capsfilter", "rgb_capsfilter");
+    data.format_capsfilter = gst_element_factory_make("capsfilter", "format_capsfilter");
+    data.overlay = NULL;
+    if (G_OVERLAY_BACKEND >= 0) {
+        data.overlay = gst_element_factory_make("detectionoverlay", "overlay");
+        if (data.overlay) {
+            g_object_set(data.overlay, "thickness", G_BOX_THICKNESS, "backend", G_OVERLAY_BACKEND, "label-atlas",
+                         &G_LABEL_ATLAS, NULL);
+        }
+    }
     data.sink = gst_element_factory_make("waylandsink", "sink");
+    if (!data.sink) {
+        data.sink = gst_element_factory_make("autovideosink", "sink");
+    }
 
     // --- 2. Determine URI type and build the data source ---
     if (g_str_has_prefix(uri, "rtsp://")) {
@@ -849,8 +963,9 @@ int main(int argc, char *argv[]) {
     }
 
     // Check if all elements were created successfully
-    if (!data.pipeline || !data.source || !data.decoder || !data.videoscale || !data.scale_capsfilter ||
-        !data.videoconvert || !data.sink) {
+    if (!data.pipeline || !data.source || !data.decoder || !data.tee || !data.display_queue ||
+        !data.analytics_queue || !data.analytics_sink || !data.videoscale || !data.scale_capsfilter ||
+        !data.videoconvert || !data.sink || (G_OVERLAY_BACKEND >= 0 && !data.overlay)) {
         g_error("Failed to create one or more elements");
         return -1;
     }
@@ -866,9 +981,17 @@ int main(int argc, char *argv[]) {
     g_object_set(data.scale_capsfilter, "caps", scale_caps, NULL);
     gst_caps_unref(scale_caps);
 
-    GstCaps *rgb_caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "BGRA", NULL);
-    g_object_set(data.rgb_capsfilter, "caps", rgb_caps, NULL);
-    gst_caps_unref(rgb_caps);
+    GstCaps *format_caps = display_caps();
+    g_object_set(data.format_capsfilter, "caps", format_caps, NULL);
+    gst_caps_unref(format_caps);
+
+    // The analytics branch only ever holds the newest decoded frame, so a slow
+    // NPU drops frames there instead of stalling the display branch. fakesink
+    // syncs to the clock so inputs are taken at presentation rate.
+    g_object_set(data.analytics_queue, "leaky", 2 /* downstream */, "max-size-buffers", 1,
+                 "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+    g_object_set(data.analytics_sink, "sync", TRUE, "async", FALSE, NULL);
+    g_object_set(data.display_queue, "max-size-buffers", 4, "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
 
     const gchar *property_name = "render-rectangle";
     GValue render_rectangle = G_VALUE_INIT;
@@ -881,16 +1004,27 @@ int main(int argc, char *argv[]) {
         gst_value_array_append_value(&render_rectangle, &val);
         g_value_unset(&val);
     }
-    g_object_set_property(G_OBJECT(data.sink), property_name, &render_rectangle);
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(data.sink), property_name)) {
+        g_object_set_property(G_OBJECT(data.sink), property_name, &render_rectangle);
+    }
     g_value_unset(&render_rectangle);
 
     // --- 4. Add and link the common elements ---
     // parse/depay 后续动态创建
-    gst_bin_add_many(GST_BIN(data.pipeline), data.decoder, data.videoscale, data.scale_capsfilter,
-                     data.videoconvert, data.rgb_capsfilter, data.sink, NULL);
+    gst_bin_add_many(GST_BIN(data.pipeline), data.decoder, data.tee, data.display_queue, data.videoscale,
+                     data.scale_capsfilter, data.videoconvert, data.format_capsfilter, data.sink,
+                     data.analytics_queue, data.analytics_sink, NULL);
+    if (data.overlay) {
+        gst_bin_add(GST_BIN(data.pipeline), data.overlay);
+    }
 
-    if (!gst_element_link_many(data.decoder, data.videoscale, data.scale_capsfilter,
-                               data.videoconvert, data.rgb_capsfilter, data.sink, NULL)) {
+    // decoder -> tee -> queue -> videoscale -> videoconvert (passthrough for NV12) -> [overlay] -> sink (display)
+    //                -> leaky queue -> fakesink (NV12 tap for the NPU)
+    if (!gst_element_link_many(data.decoder, data.tee, data.display_queue, data.videoscale, data.scale_capsfilter,
+                               data.videoconvert, data.format_capsfilter, NULL) ||
+        !(data.overlay ? gst_element_link_many(data.format_capsfilter, data.overlay, data.sink, NULL)
+                       : gst_element_link(data.format_capsfilter, data.sink)) ||
+        !gst_element_link_many(data.tee, data.analytics_queue, data.analytics_sink, NULL)) {
         g_error("Failed to link common elements");
         gst_object_unref(data.pipeline);
         return -1;
@@ -904,10 +1038,19 @@ int main(int argc, char *argv[]) {
         g_signal_connect(data.demuxer, "pad-added", G_CALLBACK(on_pad_added), &data);
     }
 
-    // Add buffer probe for RGB processing on the rgb_capsfilter's src pad
-    GstPad *rgb_capsfilter_src_pad = gst_element_get_static_pad(data.rgb_capsfilter, "src");
-    gst_pad_add_probe(rgb_capsfilter_src_pad, GST_PAD_PROBE_TYPE_BUFFER, process_frame_callback, NULL, NULL);
-    gst_object_unref(rgb_capsfilter_src_pad);
+    // Detections are attached to the display frames as metas, in their final size
+    GstPad *format_capsfilter_src_pad = gst_element_get_static_pad(data.format_capsfilter, "src");
+    gst_pad_add_probe(format_capsfilter_src_pad, GST_PAD_PROBE_TYPE_BUFFER, attach_detections_probe, NULL, NULL);
+    gst_pad_add_probe(format_capsfilter_src_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, display_caps_probe, NULL, NULL);
+    gst_pad_add_probe(format_capsfilter_src_pad, GST_PAD_PROBE_TYPE_EVENT_FLUSH, analytics_flush_probe, NULL, NULL);
+    gst_object_unref(format_capsfilter_src_pad);
+
+    // Model input is taken from the decoder output, before any conversion
+    GstPad *analytics_sink_pad = gst_element_get_static_pad(data.analytics_sink, "sink");
+    gst_pad_add_probe(analytics_sink_pad,
+                      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                      analytics_tap_callback, NULL, NULL);
+    gst_object_unref(analytics_sink_pad);
     // --- 5. Run the main loop ---
     GstBus *bus = gst_element_get_bus(data.pipeline);
     gst_bus_add_watch(bus, (GstBusFunc)on_bus_message, &data);
@@ -925,6 +1068,9 @@ int main(int argc, char *argv[]) {
     gst_element_set_state(data.pipeline, GST_STATE_NULL);
     gst_object_unref(data.pipeline);
     g_main_loop_unref(data.main_loop);
+    G_ANALYTICS.stop();
+    delete G_BACKEND; // after the input slots are freed; writes the RKNN_PROFILE report
+    rga_preprocess_deinit();
 
     return 0;
 }
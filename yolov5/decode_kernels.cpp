@@ -0,0 +1,80 @@
+#include "decode_kernels_internal.h"
+
+#include <stddef.h>
+
+int decode_threshold_compress_c(const int8_t *plane, int n, int8_t threshold, int *cells)
+{
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (plane[i] >= threshold)
+        {
+            cells[count++] = i;
+        }
+    }
+    return count;
+}
+
+int decode_argmax_c(const int8_t *values, int n, int8_t *max_value)
+{
+    int8_t best = values[0];
+    int best_index = 0;
+    for (int k = 1; k < n; ++k)
+    {
+        if (values[k] > best)
+        {
+            best = values[k];
+            best_index = k;
+        }
+    }
+    *max_value = best;
+    return best_index;
+}
+
+static const DecodeKernels DECODE_KERNELS_SCALAR = {CPU_ISA_SCALAR, "scalar", decode_threshold_compress_c,
+                                                    decode_argmax_c};
+
+const DecodeKernels *decode_kernels_get(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CPU_ISA_SCALAR:
+        return &DECODE_KERNELS_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+    case CPU_ISA_SSE41:
+        return __builtin_cpu_supports("sse4.1") ? &DECODE_KERNELS_SSE41 : NULL;
+    case CPU_ISA_AVX2:
+        return __builtin_cpu_supports("avx2") ? &DECODE_KERNELS_AVX2 : NULL;
+#endif
+#if defined(__aarch64__)
+    case CPU_ISA_NEON:
+        return &DECODE_KERNELS_NEON;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static const DecodeKernels *pick_best()
+{
+    // SSE4.1 over AVX2: rows of 80 classes leave the 32-byte loads little to
+    // win, and the two-pass decoder measured no faster with AVX2 (slower
+    // unoptimised); both stay selectable through decode_kernels_get()
+    static const CpuIsa preference[] = {CPU_ISA_NEON, CPU_ISA_SSE41, CPU_ISA_AVX2, CPU_ISA_SCALAR};
+    for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); i++)
+    {
+        const DecodeKernels *kernels = decode_kernels_get(preference[i]);
+        if (kernels != NULL)
+        {
+            return kernels;
+        }
+    }
+    return NULL;
+}
+
+const DecodeKernels *decode_kernels_best()
+{
+    // Static local: safe when several threads ask first at the same time
+    static const DecodeKernels *best = pick_best();
+    return best;
+}
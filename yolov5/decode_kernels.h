@@ -0,0 +1,27 @@
+#ifndef _RKNN_YOLOV5_DEMO_DECODE_KERNELS_H_
+#define _RKNN_YOLOV5_DEMO_DECODE_KERNELS_H_
+
+#include <stdint.h>
+
+#include "preprocess/cpu_kernels.h"
+
+// Int8 kernels of the head decoder, one table per instruction set. Every
+// variant returns exactly what the scalar one returns.
+typedef struct _DecodeKernels
+{
+    CpuIsa isa;
+    const char *name;
+    // Writes the index of every plane[i] >= threshold to `cells`, in
+    // increasing order, and returns how many there are
+    int (*threshold_compress)(const int8_t *plane, int n, int8_t threshold, int *cells);
+    // Index of the first maximum of values[0..n-1]; the maximum goes to *max_value
+    int (*argmax)(const int8_t *values, int n, int8_t *max_value);
+} DecodeKernels;
+
+// NULL when `isa` is not built in or not supported by the running CPU
+const DecodeKernels *decode_kernels_get(CpuIsa isa);
+
+// Fastest kernels usable on the running CPU, detected once
+const DecodeKernels *decode_kernels_best();
+
+#endif //_RKNN_YOLOV5_DEMO_DECODE_KERNELS_H_
@@ -0,0 +1,18 @@
+#ifndef _RKNN_YOLOV5_DEMO_DECODE_KERNELS_INTERNAL_H_
+#define _RKNN_YOLOV5_DEMO_DECODE_KERNELS_INTERNAL_H_
+
+#include "decode_kernels.h"
+
+// Scalar reference kernels, also used for the tails of the SIMD loops
+int decode_threshold_compress_c(const int8_t *plane, int n, int8_t threshold, int *cells);
+int decode_argmax_c(const int8_t *values, int n, int8_t *max_value);
+
+#if defined(__x86_64__) || defined(__i386__)
+extern const DecodeKernels DECODE_KERNELS_SSE41;
+extern const DecodeKernels DECODE_KERNELS_AVX2;
+#endif
+#if defined(__aarch64__)
+extern const DecodeKernels DECODE_KERNELS_NEON;
+#endif
+
+#endif //_RKNN_YOLOV5_DEMO_DECODE_KERNELS_INTERNAL_H_
@@ -0,0 +1,79 @@
+#include "decode_kernels_internal.h"
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+// NEON has no movemask: narrowing the 0x00/0xff compare result by 4 bits
+// gives a 64-bit mask with one nibble per byte.
+static inline uint64_t nibble_mask(uint8x16_t cmp)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0);
+}
+
+static int threshold_compress_neon(const int8_t *plane, int n, int8_t threshold, int *cells)
+{
+    const int8x16_t t = vdupq_n_s8(threshold);
+    int count = 0;
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint64_t mask = nibble_mask(vcgeq_s8(vld1q_s8(plane + i), t));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctzll(mask);
+            cells[count++] = i + (bit >> 2);
+            mask &= ~(0xfull << (bit & ~3));
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (plane[i] >= threshold)
+        {
+            cells[count++] = i;
+        }
+    }
+    return count;
+}
+
+static int argmax_neon(const int8_t *values, int n, int8_t *max_value)
+{
+    if (n < 16)
+    {
+        return decode_argmax_c(values, n, max_value);
+    }
+    int8x16_t m = vld1q_s8(values);
+    int i = 16;
+    for (; i + 16 <= n; i += 16)
+    {
+        m = vmaxq_s8(m, vld1q_s8(values + i));
+    }
+    int8_t best = vmaxvq_s8(m);
+    for (; i < n; i++)
+    {
+        best = values[i] > best ? values[i] : best;
+    }
+    *max_value = best;
+
+    const int8x16_t b = vdupq_n_s8(best);
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        uint64_t mask = nibble_mask(vceqq_s8(vld1q_s8(values + i), b));
+        if (mask != 0)
+        {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (values[i] == best)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+const DecodeKernels DECODE_KERNELS_NEON = {CPU_ISA_NEON, "neon", threshold_compress_neon, argmax_neon};
+
+#endif
@@ -0,0 +1,174 @@
+#include "decode_kernels_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// Built with per-function target attributes, like the preprocessing kernels;
+// decode_kernels_get() checks the CPU before handing these out.
+#define SSE41_FN __attribute__((target("sse4.1")))
+#define AVX2_FN __attribute__((target("avx2")))
+// SSE4.1 helpers the AVX2 kernels share: always inlined, so they come out
+// VEX-encoded there instead of as calls into legacy SSE code (an SSE/AVX
+// transition on every call, and nothing is inlined at -O0)
+#define SSE41_INLINE __attribute__((target("sse4.1"), always_inline)) static inline
+
+// Emits base + bit position for every set bit of `mask`, lowest first
+static inline int emit_mask(unsigned mask, int base, int *cells, int count)
+{
+    while (mask != 0)
+    {
+        cells[count++] = base + __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+static inline int compress_tail(const int8_t *plane, int i, int n, int8_t threshold, int *cells, int count)
+{
+    for (; i < n; i++)
+    {
+        if (plane[i] >= threshold)
+        {
+            cells[count++] = i;
+        }
+    }
+    return count;
+}
+
+SSE41_FN static int threshold_compress_sse41(const int8_t *plane, int n, int8_t threshold, int *cells)
+{
+    // v >= t  <=>  !(t > v)
+    const __m128i t = _mm_set1_epi8(threshold);
+    int count = 0;
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i below = _mm_cmpgt_epi8(t, _mm_loadu_si128((const __m128i *)(plane + i)));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(below) & 0xffff;
+        count = emit_mask(mask, i, cells, count);
+    }
+    return compress_tail(plane, i, n, threshold, cells, count);
+}
+
+SSE41_INLINE int8_t hmax_sse41(__m128i m)
+{
+    m = _mm_max_epi8(m, _mm_srli_si128(m, 8));
+    m = _mm_max_epi8(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epi8(m, _mm_srli_si128(m, 2));
+    m = _mm_max_epi8(m, _mm_srli_si128(m, 1));
+    return (int8_t)_mm_extract_epi8(m, 0);
+}
+
+// Index of the first byte equal to `best` in values[i..n-1]
+SSE41_INLINE int find_first_sse41(const int8_t *values, int i, int n, int8_t best)
+{
+    const __m128i b = _mm_set1_epi8(best);
+    for (; i + 16 <= n; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(values + i)), b));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (values[i] == best)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// n >= 16
+SSE41_INLINE int argmax_128(const int8_t *values, int n, int8_t *max_value)
+{
+    __m128i m = _mm_loadu_si128((const __m128i *)values);
+    int i = 16;
+    for (; i + 16 <= n; i += 16)
+    {
+        m = _mm_max_epi8(m, _mm_loadu_si128((const __m128i *)(values + i)));
+    }
+    int8_t best = hmax_sse41(m);
+    for (; i < n; i++)
+    {
+        best = values[i] > best ? values[i] : best;
+    }
+    *max_value = best;
+    return find_first_sse41(values, 0, n, best);
+}
+
+SSE41_FN static int argmax_sse41(const int8_t *values, int n, int8_t *max_value)
+{
+    if (n < 16)
+    {
+        return decode_argmax_c(values, n, max_value);
+    }
+    return argmax_128(values, n, max_value);
+}
+
+AVX2_FN static int threshold_compress_avx2(const int8_t *plane, int n, int8_t threshold, int *cells)
+{
+    const __m256i t = _mm256_set1_epi8(threshold);
+    int count = 0;
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i below = _mm256_cmpgt_epi8(t, _mm256_loadu_si256((const __m256i *)(plane + i)));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(below);
+        count = emit_mask(mask, i, cells, count);
+    }
+    return compress_tail(plane, i, n, threshold, cells, count);
+}
+
+AVX2_FN static inline int find_first_avx2(const int8_t *values, int n, int8_t best)
+{
+    const __m256i b = _mm256_set1_epi8(best);
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(values + i)), b));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return find_first_sse41(values, i, n, best);
+}
+
+AVX2_FN static int argmax_avx2(const int8_t *values, int n, int8_t *max_value)
+{
+    if (n < 16)
+    {
+        return decode_argmax_c(values, n, max_value);
+    }
+    if (n < 32)
+    {
+        return argmax_128(values, n, max_value);
+    }
+    __m256i m = _mm256_loadu_si256((const __m256i *)values);
+    int i = 32;
+    for (; i + 32 <= n; i += 32)
+    {
+        m = _mm256_max_epi8(m, _mm256_loadu_si256((const __m256i *)(values + i)));
+    }
+    __m128i m128 = _mm_max_epi8(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+    for (; i + 16 <= n; i += 16)
+    {
+        m128 = _mm_max_epi8(m128, _mm_loadu_si128((const __m128i *)(values + i)));
+    }
+    int8_t best = hmax_sse41(m128);
+    for (; i < n; i++)
+    {
+        best = values[i] > best ? values[i] : best;
+    }
+    *max_value = best;
+    return find_first_avx2(values, n, best);
+}
+
+const DecodeKernels DECODE_KERNELS_SSE41 = {CPU_ISA_SSE41, "sse4.1", threshold_compress_sse41, argmax_sse41};
+const DecodeKernels DECODE_KERNELS_AVX2 = {CPU_ISA_AVX2, "avx2", threshold_compress_avx2, argmax_avx2};
+
+#endif
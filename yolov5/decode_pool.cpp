@@ -0,0 +1,82 @@
+#include "decode_pool.h"
+
+DecodePool::DecodePool(int n_threads)
+    : n_threads_(n_threads > 1 ? n_threads : 1), generation_(0), busy_(0), stopping_(false), fn_(NULL), ctx_(NULL),
+      n_tasks_(0), next_task_(0)
+{
+    for (int i = 1; i < n_threads_; i++)
+    {
+        workers_.push_back(std::thread(&DecodePool::worker_loop, this, i));
+    }
+}
+
+DecodePool::~DecodePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_cond_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+        workers_[i].join();
+    }
+}
+
+void DecodePool::work(int thread)
+{
+    for (int task = next_task_++; task < n_tasks_; task = next_task_++)
+    {
+        fn_(task, thread, ctx_);
+    }
+}
+
+void DecodePool::run(int n_tasks, void (*fn)(int task, int thread, void *ctx), void *ctx)
+{
+    if (workers_.empty() || n_tasks <= 1)
+    {
+        for (int task = 0; task < n_tasks; task++)
+        {
+            fn(task, 0, ctx);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fn_ = fn;
+        ctx_ = ctx;
+        n_tasks_ = n_tasks;
+        next_task_ = 0;
+        busy_ = (int)workers_.size();
+        generation_++;
+    }
+    start_cond_.notify_all();
+    work(0);
+
+    // Workers may still be finishing their last task
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this] { return busy_ == 0; });
+}
+
+void DecodePool::worker_loop(int thread)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cond_.wait(lock, [this, seen] { return stopping_ || generation_ != seen; });
+            if (stopping_)
+            {
+                return;
+            }
+            seen = generation_;
+        }
+        work(thread);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0)
+        {
+            done_cond_.notify_one();
+        }
+    }
+}
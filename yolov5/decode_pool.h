@@ -0,0 +1,49 @@
+#ifndef _RKNN_YOLOV5_DEMO_DECODE_POOL_H_
+#define _RKNN_YOLOV5_DEMO_DECODE_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small persistent thread pool for splitting the decode of one frame. The
+// threads are started once and sleep between frames; run() hands out task
+// indices from an atomic counter, so a fast thread simply takes more of them.
+// The calling thread works too, as thread 0. run() does not allocate and is
+// not reentrant: one pool per PostProcessWorkspace.
+class DecodePool
+{
+public:
+    // n_threads includes the caller, so n_threads - 1 threads are started
+    explicit DecodePool(int n_threads);
+    ~DecodePool();
+
+    int threads() const { return n_threads_; }
+
+    // Calls fn(task, thread, ctx) once for every task in [0, n_tasks) and
+    // returns when all of them are done. `thread` is in [0, threads()).
+    void run(int n_tasks, void (*fn)(int task, int thread, void *ctx), void *ctx);
+
+private:
+    void worker_loop(int thread);
+    void work(int thread);
+
+    int n_threads_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cond_;
+    std::condition_variable done_cond_;
+    uint64_t generation_; // bumped by every run()
+    int busy_;            // workers still inside the current run()
+    bool stopping_;
+
+    void (*fn_)(int task, int thread, void *ctx);
+    void *ctx_;
+    int n_tasks_;
+    std::atomic<int> next_task_;
+};
+
+#endif //_RKNN_YOLOV5_DEMO_DECODE_POOL_H_
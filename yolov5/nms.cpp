@@ -0,0 +1,143 @@
+#include "nms.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#define NMS_MIN_CHUNK 64
+
+NmsEngine::NmsEngine() : count_(0), capacity_(0), num_classes_(0), bucket_size_(0) {}
+
+void NmsEngine::reserve(size_t max_candidates, int num_classes, int max_keep)
+{
+    if (max_candidates > capacity_)
+    {
+        x1_.resize(max_candidates);
+        y1_.resize(max_candidates);
+        x2_.resize(max_candidates);
+        y2_.resize(max_candidates);
+        area_.resize(max_candidates);
+        score_.resize(max_candidates);
+        class_id_.resize(max_candidates);
+        order_.resize(max_candidates);
+        capacity_ = max_candidates;
+    }
+    if (num_classes > num_classes_ || max_keep > bucket_size_)
+    {
+        num_classes_ = std::max(num_classes, num_classes_);
+        bucket_size_ = std::max(max_keep, bucket_size_);
+        size_t slots = (size_t)num_classes_ * bucket_size_;
+        kept_x1_.resize(slots);
+        kept_y1_.resize(slots);
+        kept_x2_.resize(slots);
+        kept_y2_.resize(slots);
+        kept_area_.resize(slots);
+        kept_count_.resize(num_classes_);
+    }
+}
+
+void NmsEngine::append(const NmsEngine &other, size_t begin, size_t end)
+{
+    end = std::min(end, other.count_);
+    size_t n = begin < end ? std::min(end - begin, capacity_ - count_) : 0;
+    if (n == 0)
+    {
+        return;
+    }
+    memcpy(&x1_[count_], &other.x1_[begin], n * sizeof(float));
+    memcpy(&y1_[count_], &other.y1_[begin], n * sizeof(float));
+    memcpy(&x2_[count_], &other.x2_[begin], n * sizeof(float));
+    memcpy(&y2_[count_], &other.y2_[begin], n * sizeof(float));
+    memcpy(&area_[count_], &other.area_[begin], n * sizeof(float));
+    memcpy(&score_[count_], &other.score_[begin], n * sizeof(float));
+    memcpy(&class_id_[count_], &other.class_id_[begin], n * sizeof(int));
+    count_ += n;
+}
+
+// Moves the next best candidates into order_[*sorted, *sorted + *chunk), in
+// order; ties keep the insertion order so results are deterministic.
+void NmsEngine::sort_next_chunk(size_t *sorted, size_t *chunk)
+{
+    const float *score = score_.data();
+    auto better = [score](int a, int b) { return score[a] > score[b] || (score[a] == score[b] && a < b); };
+    int *order = order_.data();
+    size_t end = std::min(count_, *sorted + *chunk);
+    if (end < count_)
+    {
+        std::nth_element(order + *sorted, order + end, order + count_, better);
+    }
+    std::sort(order + *sorted, order + end, better);
+    *sorted = end;
+    *chunk *= 2;
+}
+
+int NmsEngine::run(float iou_threshold, NmsMode mode, int max_keep, int *keep)
+{
+    if (max_keep > bucket_size_)
+    {
+        max_keep = bucket_size_;
+    }
+    if (count_ == 0 || max_keep <= 0)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < count_; i++)
+    {
+        order_[i] = (int)i;
+    }
+    int n_buckets = mode == NMS_CLASS_AWARE ? num_classes_ : 1;
+    memset(kept_count_.data(), 0, n_buckets * sizeof(int));
+
+    size_t sorted = 0;
+    size_t chunk = std::max(NMS_MIN_CHUNK, max_keep * 4);
+    int kept = 0;
+    for (size_t pos = 0; pos < count_ && kept < max_keep; pos++)
+    {
+        if (pos == sorted)
+        {
+            sort_next_chunk(&sorted, &chunk);
+        }
+        int c = order_[pos];
+        int bucket = mode == NMS_CLASS_AWARE ? class_id_[c] : 0;
+        if (bucket < 0 || bucket >= n_buckets)
+        {
+            continue;
+        }
+
+        float cx1 = x1_[c], cy1 = y1_[c], cx2 = x2_[c], cy2 = y2_[c], carea = area_[c];
+        const float *kx1 = &kept_x1_[bucket * bucket_size_];
+        const float *ky1 = &kept_y1_[bucket * bucket_size_];
+        const float *kx2 = &kept_x2_[bucket * bucket_size_];
+        const float *ky2 = &kept_y2_[bucket * bucket_size_];
+        const float *karea = &kept_area_[bucket * bucket_size_];
+        int n_kept = kept_count_[bucket];
+        bool suppressed = false;
+        for (int k = 0; k < n_kept; k++)
+        {
+            // iou > t  <=>  inter > t * union, without the division
+            float w = std::max(0.f, std::min(cx2, kx2[k]) - std::max(cx1, kx1[k]) + 1.0f);
+            float h = std::max(0.f, std::min(cy2, ky2[k]) - std::max(cy1, ky1[k]) + 1.0f);
+            float inter = w * h;
+            float uni = carea + karea[k] - inter;
+            if (uni > 0.f && inter > iou_threshold * uni)
+            {
+                suppressed = true;
+                break;
+            }
+        }
+        if (suppressed)
+        {
+            continue;
+        }
+
+        int slot = bucket * bucket_size_ + n_kept;
+        kept_x1_[slot] = cx1;
+        kept_y1_[slot] = cy1;
+        kept_x2_[slot] = cx2;
+        kept_y2_[slot] = cy2;
+        kept_area_[slot] = carea;
+        kept_count_[bucket] = n_kept + 1;
+        keep[kept++] = c;
+    }
+    return kept;
+}
@@ -0,0 +1,83 @@
+#ifndef _RKNN_YOLOV5_DEMO_NMS_H_
+#define _RKNN_YOLOV5_DEMO_NMS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+typedef enum _NmsMode
+{
+    NMS_CLASS_AWARE,    // boxes only suppress boxes of their own class
+    NMS_CLASS_AGNOSTIC, // any overlapping box with a higher score suppresses
+} NmsMode;
+
+// Greedy non-maximum suppression over a structure-of-arrays candidate list.
+//
+// Candidates are only sorted as far as needed: the best ones are selected in
+// growing chunks (nth_element + sort) and the walk stops once max_keep boxes
+// are kept, so crowded frames never pay for a full sort. Each kept box is
+// appended to its class bucket together with its precomputed area, and a new
+// candidate is only compared with the kept boxes of its bucket. The result is
+// the same as the textbook O(n^2) algorithm with a stable score order.
+//
+// Buffers are sized by reserve(); clear()/add()/run() do not allocate.
+class NmsEngine
+{
+public:
+    NmsEngine();
+
+    void reserve(size_t max_candidates, int num_classes, int max_keep);
+    void clear() { count_ = 0; }
+
+    // Box as top-left corner and size, in model input pixels. Silently
+    // dropped when the reserved capacity is exhausted.
+    void add(float x, float y, float w, float h, float score, int class_id)
+    {
+        if (count_ == capacity_)
+        {
+            return;
+        }
+        x1_[count_] = x;
+        y1_[count_] = y;
+        x2_[count_] = x + w;
+        y2_[count_] = y + h;
+        area_[count_] = (w + 1.0f) * (h + 1.0f);
+        score_[count_] = score;
+        class_id_[count_] = class_id;
+        count_++;
+    }
+
+    // Appends candidates [begin, end) of `other` in order (as far as the
+    // capacity allows), e.g. to merge per-thread decode results
+    void append(const NmsEngine &other, size_t begin, size_t end);
+
+    // Writes up to `max_keep` surviving candidate indices to `keep`, best
+    // score first, and returns how many. Two boxes overlap when their IoU is
+    // above `iou_threshold`.
+    int run(float iou_threshold, NmsMode mode, int max_keep, int *keep);
+
+    size_t size() const { return count_; }
+    float x1(int i) const { return x1_[i]; }
+    float y1(int i) const { return y1_[i]; }
+    float x2(int i) const { return x2_[i]; }
+    float y2(int i) const { return y2_[i]; }
+    float score(int i) const { return score_[i]; }
+    int class_id(int i) const { return class_id_[i]; }
+
+private:
+    void sort_next_chunk(size_t *sorted, size_t *chunk);
+
+    size_t count_;
+    size_t capacity_;
+    std::vector<float> x1_, y1_, x2_, y2_, area_, score_;
+    std::vector<int> class_id_;
+    std::vector<int> order_;
+
+    // Kept boxes per class: bucket b holds slots [b * bucket_size_, ...)
+    int num_classes_;
+    int bucket_size_;
+    std::vector<float> kept_x1_, kept_y1_, kept_x2_, kept_y2_, kept_area_;
+    std::vector<int> kept_count_;
+};
+
+#endif //_RKNN_YOLOV5_DEMO_NMS_H_
@@ -22,15 +22,12 @@
 #include <string.h>
 #include <sys/time.h>
 
-#include <set>
 #include <vector>
 #define LABEL_NALE_TXT_PATH "./coco_80_labels_list.txt"
+// class rows gathered per batch in decode_head(): 256 x 80 bytes stays in L1
+#define DECODE_GATHER_CELLS 256
 
-static char *labels[OBJ_CLASS_NUM];
-
-const int anchor0[6] = {10, 13, 16, 30, 33, 23};
-const int anchor1[6] = {30, 61, 62, 45, 59, 119};
-const int anchor2[6] = {116, 90, 156, 198, 373, 326};
+static char *labels[YOLO_MAX_CLASSES];
 
 inline static int clamp(float val, int min, int max) { return val > min ? (val < max ? val : max) : min; }
 
@@ -96,260 +93,812 @@ int readLines(const char *fileName, char *lines[], int max_line)
 
 int loadLabelName(const char *locationFilename, char *label[])
 {
-    readLines(locationFilename, label, OBJ_CLASS_NUM);
+    readLines(locationFilename, label, YOLO_MAX_CLASSES);
     return 0;
 }
 
-static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0, float xmin1, float ymin1, float xmax1,
-                              float ymax1)
+inline static int32_t __clip(float val, float min, float max)
+{
+    float f = val <= min ? min : (val >= max ? max : val);
+    return f;
+}
+
+static int8_t qnt_f32_to_affine(float f32, int32_t zp, float scale)
+{
+    float dst_val = (f32 / scale) + zp;
+    int8_t res = (int8_t)__clip(dst_val, -128, 127);
+    return res;
+}
+
+static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+
+void decode_lut_init(DecodeLut *lut, int32_t zp, float scale)
+{
+    lut->zp = zp;
+    lut->scale = scale;
+    // Same expressions (and double promotions) as the per-value code they
+    // replace, so decoding gives bit-identical boxes
+    for (int q = -128; q < 128; q++)
+    {
+        float value = deqnt_affine_to_f32((int8_t)q, zp, scale);
+        float size = value * 2.0;
+        lut->dequant[q + 128] = value;
+        lut->xy[q + 128] = value * 2.0 - 0.5;
+        lut->wh[q + 128] = size * size;
+    }
+}
+
+// Decoders are templates on the class and anchor counts so that the common
+// models get constant trip counts; 0 reads them from the model at runtime.
+template <int NUM_CLASSES>
+static inline int class_argmax(const int8_t *row, int num_classes, const DecodeKernels *kernels, int8_t *max_value)
 {
-    float w = fmax(0.f, fmin(xmax0, xmax1) - fmax(xmin0, xmin1) + 1.0);
-    float h = fmax(0.f, fmin(ymax0, ymax1) - fmax(ymin0, ymin1) + 1.0);
-    float i = w * h;
-    float u = (xmax0 - xmin0 + 1.0) * (ymax0 - ymin0 + 1.0) + (xmax1 - xmin1 + 1.0) * (ymax1 - ymin1 + 1.0) - i;
-    return u <= 0.f ? 0.f : (i / u);
+    // for a handful of classes the inline loop beats the kernel call
+    if (NUM_CLASSES > 0 && NUM_CLASSES < 16)
+    {
+        int8_t best = row[0];
+        int best_index = 0;
+        for (int k = 1; k < NUM_CLASSES; ++k)
+        {
+            if (row[k] > best)
+            {
+                best = row[k];
+                best_index = k;
+            }
+        }
+        *max_value = best;
+        return best_index;
+    }
+    return kernels->argmax(row, num_classes, max_value);
 }
 
-static int nms(int validCount, std::vector<float> &outputLocations, std::vector<int> classIds, std::vector<int> &order,
-               int filterId, float threshold)
+template <int NUM_CLASSES, int NUM_ANCHORS>
+static int decode_head_int8(DecodeJob *job)
 {
-    for (int i = 0; i < validCount; ++i)
+    const YoloHead *head = &job->model->heads[job->head];
+    const int num_classes = NUM_CLASSES > 0 ? NUM_CLASSES : job->model->num_classes;
+    const int num_anchors = NUM_ANCHORS > 0 ? NUM_ANCHORS : head->num_anchors;
+    const int prop_box_size = 5 + num_classes;
+    // the instantiations are never picked with an allow-list
+    const int *classes = NUM_CLASSES > 0 ? NULL : job->classes;
+    const int row_len = classes != NULL ? job->num_selected : num_classes;
+    const int8_t *input = (const int8_t *)job->input;
+    const DecodeLut *lut = job->lut;
+    int validCount = 0;
+    int grid_w = head->grid_w;
+    int grid_len = head->grid_h * grid_w;
+    // rows [row_begin, row_end) of every plane
+    int band_begin = job->row_begin * grid_w;
+    int band_len = (job->row_end - job->row_begin) * grid_w;
+    float stride = (float)head->stride;
+    int8_t thres_i8 = qnt_f32_to_affine(job->threshold, lut->zp, lut->scale);
+    // centred on 0 so they are indexed by the int8 value itself
+    const float *dequant = lut->dequant + 128;
+    const float *xy = lut->xy + 128;
+    const float *wh = lut->wh + 128;
+    int *cells = job->cells;
+    int8_t *class_rows = job->class_rows;
+    const DecodeKernels *kernels = job->kernels;
+    NmsEngine *candidates = job->candidates;
+    for (int a = 0; a < num_anchors; a++)
     {
-        if (order[i] == -1 || classIds[i] != filterId)
+        const int8_t *anchor_base = input + (prop_box_size * a) * grid_len;
+        float anchor_w = (float)head->anchors[a * 2];
+        float anchor_h = (float)head->anchors[a * 2 + 1];
+        int anchor_count = validCount;
+
+        // Pass 1: one contiguous scan of the objectness plane
+        int n = kernels->threshold_compress(anchor_base + 4 * grid_len + band_begin, band_len, thres_i8, cells);
+        for (int i = 0; band_begin != 0 && i < n; i++)
         {
-            continue;
+            cells[i] += band_begin;
         }
-        int n = order[i];
-        for (int j = i + 1; j < validCount; ++j)
+
+        // Pass 2: per batch of candidate cells, gather the class planes one
+        // after the other (increasing addresses) into contiguous rows, then
+        // take the argmax of each row
+        for (int batch = 0; batch < n; batch += DECODE_GATHER_CELLS)
         {
-            int m = order[j];
-            if (m == -1 || classIds[i] != filterId)
+            int batch_n = n - batch < DECODE_GATHER_CELLS ? n - batch : DECODE_GATHER_CELLS;
+            const int *batch_cells = cells + batch;
+            for (int k = 0; k < row_len; ++k)
             {
-                continue;
+                const int8_t *class_plane = anchor_base + (5 + (classes != NULL ? classes[k] : k)) * grid_len;
+                for (int i = 0; i < batch_n; i++)
+                {
+                    class_rows[i * row_len + k] = class_plane[batch_cells[i]];
+                }
             }
-            float xmin0 = outputLocations[n * 4 + 0];
-            float ymin0 = outputLocations[n * 4 + 1];
-            float xmax0 = outputLocations[n * 4 + 0] + outputLocations[n * 4 + 2];
-            float ymax0 = outputLocations[n * 4 + 1] + outputLocations[n * 4 + 3];
 
-            float xmin1 = outputLocations[m * 4 + 0];
-            float ymin1 = outputLocations[m * 4 + 1];
-            float xmax1 = outputLocations[m * 4 + 0] + outputLocations[m * 4 + 2];
-            float ymax1 = outputLocations[m * 4 + 1] + outputLocations[m * 4 + 3];
+            for (int i = 0; i < batch_n; i++)
+            {
+                int8_t class_max;
+                int class_arg = class_argmax<NUM_CLASSES>(class_rows + i * row_len, row_len, kernels, &class_max);
+                if (class_max <= (classes != NULL ? job->class_thresholds_i8[class_arg] : thres_i8))
+                {
+                    continue;
+                }
+                class_arg = classes != NULL ? classes[class_arg] : class_arg;
+                int cell = batch_cells[i];
+                const int8_t *in_ptr = anchor_base + cell;
+                int row = cell / grid_w;
+                int col = cell - row * grid_w;
+                float box_x = (xy[in_ptr[0]] + col) * stride;
+                float box_y = (xy[in_ptr[grid_len]] + row) * stride;
+                float box_w = wh[in_ptr[2 * grid_len]] * anchor_w;
+                float box_h = wh[in_ptr[3 * grid_len]] * anchor_h;
+                box_x -= (box_w / 2.0);
+                box_y -= (box_h / 2.0);
+
+                float obj_prob = dequant[class_max] * dequant[in_ptr[4 * grid_len]];
+                candidates->add(box_x, box_y, box_w, box_h, obj_prob, class_arg);
+                validCount++;
+            }
+        }
+        job->added[a] = validCount - anchor_count;
+    }
+    return validCount;
+}
 
-            float iou = CalculateOverlap(xmin0, ymin0, xmax0, ymax0, xmin1, ymin1, xmax1, ymax1);
+// Int8 heads in the NPU's NC1HWC2 layout, decoded where the NPU wrote them
+// instead of after the runtime's conversion to NCHW. A channel's values are
+// c2 bytes apart: the objectness of the band is gathered into a contiguous
+// plane for threshold_compress, and the class scores of a cell, runs of up
+// to c2 contiguous bytes in one channel block each, are copied into a row
+// for the argmax. The runs are the same for every cell of an anchor, so
+// their offsets are worked out once per anchor.
+template <int NUM_CLASSES, int NUM_ANCHORS>
+static int decode_head_int8_nc1hwc2(DecodeJob *job)
+{
+    const YoloHead *head = &job->model->heads[job->head];
+    const int num_classes = NUM_CLASSES > 0 ? NUM_CLASSES : job->model->num_classes;
+    const int num_anchors = NUM_ANCHORS > 0 ? NUM_ANCHORS : head->num_anchors;
+    const int prop_box_size = 5 + num_classes;
+    const int *classes = NUM_CLASSES > 0 ? NULL : job->classes;
+    const int row_len = classes != NULL ? job->num_selected : num_classes;
+    const int8_t *input = (const int8_t *)job->input;
+    const DecodeLut *lut = job->lut;
+    const int c2 = head->c2;
+    int validCount = 0;
+    int grid_w = head->grid_w;
+    size_t block_len = (size_t)head->grid_h * grid_w * c2;
+    int band_begin = job->row_begin * grid_w;
+    int band_end = job->row_end * grid_w;
+    float stride = (float)head->stride;
+    int8_t thres_i8 = qnt_f32_to_affine(job->threshold, lut->zp, lut->scale);
+    const float *dequant = lut->dequant + 128;
+    const float *xy = lut->xy + 128;
+    const float *wh = lut->wh + 128;
+    int *cells = job->cells;
+    int8_t *class_row = job->class_rows;
+    int8_t *plane = job->plane;
+    const DecodeKernels *kernels = job->kernels;
+    NmsEngine *candidates = job->candidates;
+    // offset from a cell's base of class k (allow-list) or of run k, its
+    // first class and length
+    size_t run_offset[YOLO_MAX_CLASSES];
+    int run_class[YOLO_MAX_CLASSES];
+    int run_len[YOLO_MAX_CLASSES];
+    for (int a = 0; a < num_anchors; a++)
+    {
+        int base = prop_box_size * a;
+        // channel c of cell `cell` is at box[c][cell * c2] for the 5 box channels
+        const int8_t *box[5];
+        for (int c = 0; c < 5; c++)
+        {
+            box[c] = input + yolo_head_index(head, base + c, 0);
+        }
+        float anchor_w = (float)head->anchors[a * 2];
+        float anchor_h = (float)head->anchors[a * 2 + 1];
+        int anchor_count = validCount;
 
-            if (iou > threshold)
+        int num_runs = 0;
+        if (classes == NULL)
+        {
+            for (int k = 0, c = base + 5; k < num_classes; num_runs++)
+            {
+                int lane = c % c2;
+                int len = c2 - lane < num_classes - k ? c2 - lane : num_classes - k;
+                run_offset[num_runs] = (c / c2) * block_len + lane;
+                run_class[num_runs] = k;
+                run_len[num_runs] = len;
+                k += len;
+                c += len;
+            }
+        }
+        else
+        {
+            for (int k = 0; k < row_len; k++)
             {
-                order[j] = -1;
+                int c = base + 5 + classes[k];
+                run_offset[k] = (c / c2) * block_len + c % c2;
             }
         }
+
+        // Pass 1: gather the objectness channel, then one contiguous scan
+        const int8_t *objectness = box[4] + (size_t)band_begin * c2;
+        int band_len = band_end - band_begin;
+        for (int i = 0; i < band_len; i++)
+        {
+            plane[i] = objectness[(size_t)i * c2];
+        }
+        int n = kernels->threshold_compress(plane, band_len, thres_i8, cells);
+
+        for (int i = 0; i < n; i++)
+        {
+            int cell = cells[i] + band_begin;
+            const int8_t *cell_base = input + (size_t)cell * c2;
+            if (classes == NULL)
+            {
+                for (int r = 0; r < num_runs; r++)
+                {
+                    memcpy(class_row + run_class[r], cell_base + run_offset[r], run_len[r]);
+                }
+            }
+            else
+            {
+                for (int k = 0; k < row_len; k++)
+                {
+                    class_row[k] = cell_base[run_offset[k]];
+                }
+            }
+            int8_t class_max;
+            int class_arg = class_argmax<NUM_CLASSES>(class_row, row_len, kernels, &class_max);
+            if (class_max <= (classes != NULL ? job->class_thresholds_i8[class_arg] : thres_i8))
+            {
+                continue;
+            }
+            class_arg = classes != NULL ? classes[class_arg] : class_arg;
+            size_t offset = (size_t)cell * c2;
+            int row = cell / grid_w;
+            int col = cell - row * grid_w;
+            float box_x = (xy[box[0][offset]] + col) * stride;
+            float box_y = (xy[box[1][offset]] + row) * stride;
+            float box_w = wh[box[2][offset]] * anchor_w;
+            float box_h = wh[box[3][offset]] * anchor_h;
+            box_x -= (box_w / 2.0);
+            box_y -= (box_h / 2.0);
+
+            float obj_prob = dequant[class_max] * dequant[box[4][offset]];
+            candidates->add(box_x, box_y, box_w, box_h, obj_prob, class_arg);
+            validCount++;
+        }
+        job->added[a] = validCount - anchor_count;
     }
-    return 0;
+    return validCount;
 }
 
-static int quick_sort_indice_inverse(std::vector<float> &input, int left, int right, std::vector<int> &indices)
+static inline float to_f32(float value) { return value; }
+static inline float to_f32(uint16_t value) { return yolo_fp16_to_f32(value); }
+
+// Float heads (fp16 stored as uint16_t): same two passes, on plain values
+template <typename T, int NUM_CLASSES, int NUM_ANCHORS>
+static int decode_head_float(DecodeJob *job)
 {
-    float key;
-    int key_index;
-    int low = left;
-    int high = right;
-    if (left < right)
-    {
-        key_index = indices[left];
-        key = input[left];
-        while (low < high)
+    const YoloHead *head = &job->model->heads[job->head];
+    const int num_classes = NUM_CLASSES > 0 ? NUM_CLASSES : job->model->num_classes;
+    const int num_anchors = NUM_ANCHORS > 0 ? NUM_ANCHORS : head->num_anchors;
+    const int prop_box_size = 5 + num_classes;
+    const int *classes = NUM_CLASSES > 0 ? NULL : job->classes;
+    const int row_len = classes != NULL ? job->num_selected : num_classes;
+    const T *input = (const T *)job->input;
+    float threshold = job->threshold;
+    int validCount = 0;
+    int grid_w = head->grid_w;
+    int grid_len = head->grid_h * grid_w;
+    int band_begin = job->row_begin * grid_w;
+    int band_end = job->row_end * grid_w;
+    float stride = (float)head->stride;
+    int *cells = job->cells;
+    float *class_rows = job->class_rows_f32;
+    NmsEngine *candidates = job->candidates;
+    for (int a = 0; a < num_anchors; a++)
+    {
+        const T *anchor_base = input + (prop_box_size * a) * grid_len;
+        float anchor_w = (float)head->anchors[a * 2];
+        float anchor_h = (float)head->anchors[a * 2 + 1];
+        int anchor_count = validCount;
+
+        const T *conf_plane = anchor_base + 4 * grid_len;
+        int n = 0;
+        for (int cell = band_begin; cell < band_end; cell++)
+        {
+            if (to_f32(conf_plane[cell]) >= threshold)
+            {
+                cells[n++] = cell;
+            }
+        }
+
+        for (int batch = 0; batch < n; batch += DECODE_GATHER_CELLS)
         {
-            while (low < high && input[high] <= key)
+            int batch_n = n - batch < DECODE_GATHER_CELLS ? n - batch : DECODE_GATHER_CELLS;
+            const int *batch_cells = cells + batch;
+            for (int k = 0; k < row_len; ++k)
             {
-                high--;
+                const T *class_plane = anchor_base + (5 + (classes != NULL ? classes[k] : k)) * grid_len;
+                for (int i = 0; i < batch_n; i++)
+                {
+                    class_rows[i * row_len + k] = to_f32(class_plane[batch_cells[i]]);
+                }
             }
-            input[low] = input[high];
-            indices[low] = indices[high];
-            while (low < high && input[low] >= key)
+
+            for (int i = 0; i < batch_n; i++)
             {
-                low++;
+                const float *row_scores = class_rows + i * row_len;
+                float class_max = row_scores[0];
+                int class_arg = 0;
+                for (int k = 1; k < row_len; ++k)
+                {
+                    if (row_scores[k] > class_max)
+                    {
+                        class_max = row_scores[k];
+                        class_arg = k;
+                    }
+                }
+                if (class_max <= (classes != NULL ? job->class_thresholds[class_arg] : threshold))
+                {
+                    continue;
+                }
+                class_arg = classes != NULL ? classes[class_arg] : class_arg;
+                int cell = batch_cells[i];
+                const T *in_ptr = anchor_base + cell;
+                int row = cell / grid_w;
+                int col = cell - row * grid_w;
+                float box_x = (to_f32(in_ptr[0]) * 2.0f - 0.5f + col) * stride;
+                float box_y = (to_f32(in_ptr[grid_len]) * 2.0f - 0.5f + row) * stride;
+                float box_w = to_f32(in_ptr[2 * grid_len]) * 2.0f;
+                float box_h = to_f32(in_ptr[3 * grid_len]) * 2.0f;
+                box_w = box_w * box_w * anchor_w;
+                box_h = box_h * box_h * anchor_h;
+                box_x -= (box_w / 2.0f);
+                box_y -= (box_h / 2.0f);
+
+                float obj_prob = class_max * to_f32(in_ptr[4 * grid_len]);
+                candidates->add(box_x, box_y, box_w, box_h, obj_prob, class_arg);
+                validCount++;
             }
-            input[high] = input[low];
-            indices[high] = indices[low];
         }
-        input[low] = key;
-        indices[low] = key_index;
-        quick_sort_indice_inverse(input, left, low - 1, indices);
-        quick_sort_indice_inverse(input, low + 1, right, indices);
+        job->added[a] = validCount - anchor_count;
     }
-    return low;
+    return validCount;
 }
 
-static float sigmoid(float x) { return 1.0 / (1.0 + expf(-x)); }
+typedef struct _DecoderEntry
+{
+    YoloTensorType type;
+    YoloTensorLayout layout;
+    int num_classes;
+    int num_anchors;
+    DecodeHeadFn decode;
+} DecoderEntry;
+
+// Compile-time instantiations: the COCO model in each element type and the
+// small custom models we deploy. Anything else takes the runtime-sized path.
+static const DecoderEntry DECODERS[] = {
+    {YOLO_TENSOR_INT8, YOLO_LAYOUT_NCHW, 80, 3, decode_head_int8<80, 3>},
+    {YOLO_TENSOR_INT8, YOLO_LAYOUT_NCHW, 1, 3, decode_head_int8<1, 3>},
+    {YOLO_TENSOR_INT8, YOLO_LAYOUT_NCHW, 2, 3, decode_head_int8<2, 3>},
+    {YOLO_TENSOR_INT8, YOLO_LAYOUT_NCHW, 3, 3, decode_head_int8<3, 3>},
+    {YOLO_TENSOR_INT8, YOLO_LAYOUT_NC1HWC2, 80, 3, decode_head_int8_nc1hwc2<80, 3>},
+    {YOLO_TENSOR_FP16, YOLO_LAYOUT_NCHW, 80, 3, decode_head_float<uint16_t, 80, 3>},
+    {YOLO_TENSOR_FP32, YOLO_LAYOUT_NCHW, 80, 3, decode_head_float<float, 80, 3>},
+};
+
+// An allow-list changes the row length, so it takes the runtime-sized path
+static DecodeHeadFn pick_decoder(const YoloHead *head, int num_classes, bool specialized)
+{
+    for (size_t i = 0; specialized && i < sizeof(DECODERS) / sizeof(DECODERS[0]); i++)
+    {
+        if (DECODERS[i].type == head->type && DECODERS[i].layout == head->layout &&
+            DECODERS[i].num_classes == num_classes && DECODERS[i].num_anchors == head->num_anchors)
+        {
+            return DECODERS[i].decode;
+        }
+    }
+    if (head->layout == YOLO_LAYOUT_NC1HWC2)
+    {
+        return decode_head_int8_nc1hwc2<0, 0>;
+    }
+    switch (head->type)
+    {
+    case YOLO_TENSOR_FP16:
+        return decode_head_float<uint16_t, 0, 0>;
+    case YOLO_TENSOR_FP32:
+        return decode_head_float<float, 0, 0>;
+    default:
+        return decode_head_int8<0, 0>;
+    }
+}
 
-static float unsigmoid(float y) { return -1.0 * logf((1.0 / y) - 1.0); }
+PostProcessWorkspace::PostProcessWorkspace()
+    : nms_mode(NMS_CLASS_AWARE), kernels(decode_kernels_best()), specialized(true),
+      parallel_min_cells(DECODE_PARALLEL_MIN_CELLS), scratch_(1), pool_(NULL),
+      parallel_(false), has_class_thresholds_(false), num_selected_(0), num_active_(0), prepared_threshold_(0),
+      thresholds_dirty_(true), obj_threshold_(0)
+{
+    memset(keep, 0, sizeof(keep));
+    memset(decoders, 0, sizeof(decoders));
+    memset(&model_, 0, sizeof(model_));
+    for (int i = 0; i < YOLO_MAX_HEADS; i++)
+    {
+        model_.heads[i].scale = 1.0f;
+        decode_lut_init(&luts[i], 0, 1.0f);
+    }
+}
 
-inline static int32_t __clip(float val, float min, float max)
+PostProcessWorkspace::~PostProcessWorkspace() { delete pool_; }
+
+void PostProcessWorkspace::configure(const YoloModel &model)
 {
-    float f = val <= min ? min : (val >= max ? max : val);
-    return f;
+    model_ = model;
+    num_active_ = 0;
+    while (num_active_ < num_selected_ && classes_[num_active_] < model_.num_classes)
+    {
+        num_active_++;
+    }
+    thresholds_dirty_ = true;
+    size_t max_candidates = 0;
+    size_t max_cells = 0;
+    size_t total_cells = 0;
+    bool float_heads = false;
+    bool nc1hwc2_heads = false;
+    for (int i = 0; i < model_.num_heads; i++)
+    {
+        const YoloHead *head = &model_.heads[i];
+        size_t grid_len = (size_t)head->grid_h * head->grid_w;
+        max_candidates += head->num_anchors * grid_len;
+        max_cells = grid_len > max_cells ? grid_len : max_cells;
+        total_cells += grid_len;
+        float_heads = float_heads || head->type != YOLO_TENSOR_INT8;
+        nc1hwc2_heads = nc1hwc2_heads || head->layout == YOLO_LAYOUT_NC1HWC2;
+        if (luts[i].zp != head->zp || luts[i].scale != head->scale)
+        {
+            decode_lut_init(&luts[i], head->zp, head->scale);
+        }
+        decoders[i] = pick_decoder(head, model_.num_classes, specialized && num_selected_ == 0);
+    }
+    // NmsEngine and the vectors only ever grow
+    candidates.reserve(max_candidates, model_.num_classes, OBJ_NUMB_MAX_SIZE);
+    size_t max_rows = (size_t)DECODE_GATHER_CELLS * model_.num_classes;
+    scratch_.resize(pool_ != NULL ? pool_->threads() : 1);
+    for (size_t t = 0; t < scratch_.size(); t++)
+    {
+        DecodeScratch *scratch = &scratch_[t];
+        if (scratch->cells.size() < max_cells)
+        {
+            scratch->cells.resize(max_cells);
+        }
+        if (scratch->class_rows.size() < max_rows)
+        {
+            scratch->class_rows.resize(max_rows);
+        }
+        if (float_heads && scratch->class_rows_f32.size() < max_rows)
+        {
+            scratch->class_rows_f32.resize(max_rows);
+        }
+        if (nc1hwc2_heads && scratch->plane.size() < max_cells)
+        {
+            scratch->plane.resize(max_cells);
+        }
+    }
+    plan_tasks();
+    parallel_ = pool_ != NULL && tasks_.size() > 1 && total_cells >= (size_t)parallel_min_cells;
 }
 
-static int8_t qnt_f32_to_affine(float f32, int32_t zp, float scale)
+// Cuts every head in bands of whole rows of about DECODE_TASK_CELLS cells x
+// anchors; the tasks of a head are consecutive and top to bottom
+void PostProcessWorkspace::plan_tasks()
 {
-    float dst_val = (f32 / scale) + zp;
-    int8_t res = (int8_t)__clip(dst_val, -128, 127);
-    return res;
+    tasks_.clear();
+    for (int h = 0; h < model_.num_heads; h++)
+    {
+        const YoloHead *head = &model_.heads[h];
+        int band_rows = DECODE_TASK_CELLS / (head->num_anchors * head->grid_w);
+        band_rows = band_rows > 0 ? band_rows : 1;
+        for (int row = 0; row < head->grid_h; row += band_rows)
+        {
+            DecodeJob job;
+            init_job(&job, h, 0);
+            job.row_begin = row;
+            job.row_end = row + band_rows < head->grid_h ? row + band_rows : head->grid_h;
+            tasks_.push_back(job);
+        }
+    }
+    if (task_candidates_.size() < tasks_.size())
+    {
+        task_candidates_.resize(tasks_.size());
+    }
+    for (size_t t = 0; t < tasks_.size(); t++)
+    {
+        const YoloHead *head = &model_.heads[tasks_[t].head];
+        size_t band_cells = (size_t)(tasks_[t].row_end - tasks_[t].row_begin) * head->grid_w;
+        task_candidates_[t].reserve(head->num_anchors * band_cells, 0, 0);
+        tasks_[t].candidates = &task_candidates_[t];
+    }
 }
 
-static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+void PostProcessWorkspace::init_job(DecodeJob *job, int head, int thread)
+{
+    memset(job, 0, sizeof(DecodeJob));
+    job->model = &model_;
+    job->head = head;
+    job->row_begin = 0;
+    job->row_end = model_.heads[head].grid_h;
+    job->lut = &luts[head];
+    if (num_selected_ > 0)
+    {
+        job->classes = classes_;
+        job->num_selected = num_active_;
+        job->class_thresholds = class_thres_;
+        job->class_thresholds_i8 = class_thres_i8_[head];
+    }
+    job->kernels = kernels;
+    job->cells = scratch_[thread].cells.data();
+    job->class_rows = scratch_[thread].class_rows.data();
+    job->class_rows_f32 = scratch_[thread].class_rows_f32.data();
+    job->plane = scratch_[thread].plane.data();
+    job->candidates = &candidates;
+}
 
-static int process(int8_t *input, int *anchor, int grid_h, int grid_w, int height, int width, int stride,
-                   std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId, float threshold,
-                   int32_t zp, float scale)
+void PostProcessWorkspace::reserve(int model_in_h, int model_in_w)
 {
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
-    int8_t thres_i8 = qnt_f32_to_affine(threshold, zp, scale);
-    for (int a = 0; a < 3; a++)
+    YoloModel model;
+    yolo_model_default(&model, model_in_w, model_in_h);
+    for (int i = 0; i < model.num_heads; i++)
+    {
+        model.heads[i].zp = model_.heads[i].zp;
+        model.heads[i].scale = model_.heads[i].scale;
+    }
+    // YoloModel is all 4-byte fields, no padding to compare
+    if (memcmp(&model, &model_, sizeof(model)) != 0)
     {
-        for (int i = 0; i < grid_h; i++)
+        configure(model);
+    }
+}
+
+void PostProcessWorkspace::set_quant(int index, int32_t zp, float scale)
+{
+    if (index >= 0 && index < YOLO_MAX_HEADS)
+    {
+        model_.heads[index].zp = zp;
+        model_.heads[index].scale = scale;
+        if (luts[index].zp != zp || luts[index].scale != scale)
         {
-            for (int j = 0; j < grid_w; j++)
-            {
-                int8_t box_confidence = input[(PROP_BOX_SIZE * a + 4) * grid_len + i * grid_w + j];
-                if (box_confidence >= thres_i8)
-                {
-                    int offset = (PROP_BOX_SIZE * a) * grid_len + i * grid_w + j;
-                    int8_t *in_ptr = input + offset;
-                    float box_x = (deqnt_affine_to_f32(*in_ptr, zp, scale)) * 2.0 - 0.5;
-                    float box_y = (deqnt_affine_to_f32(in_ptr[grid_len], zp, scale)) * 2.0 - 0.5;
-                    float box_w = (deqnt_affine_to_f32(in_ptr[2 * grid_len], zp, scale)) * 2.0;
-                    float box_h = (deqnt_affine_to_f32(in_ptr[3 * grid_len], zp, scale)) * 2.0;
-                    box_x = (box_x + j) * (float)stride;
-                    box_y = (box_y + i) * (float)stride;
-                    box_w = box_w * box_w * (float)anchor[a * 2];
-                    box_h = box_h * box_h * (float)anchor[a * 2 + 1];
-                    box_x -= (box_w / 2.0);
-                    box_y -= (box_h / 2.0);
-
-                    int8_t maxClassProbs = in_ptr[5 * grid_len];
-                    int maxClassId = 0;
-                    for (int k = 1; k < OBJ_CLASS_NUM; ++k)
-                    {
-                        int8_t prob = in_ptr[(5 + k) * grid_len];
-                        if (prob > maxClassProbs)
-                        {
-                            maxClassId = k;
-                            maxClassProbs = prob;
-                        }
-                    }
-                    if (maxClassProbs > thres_i8)
-                    {
-                        objProbs.push_back((deqnt_affine_to_f32(maxClassProbs, zp, scale)) * (deqnt_affine_to_f32(box_confidence, zp, scale)));
-                        classId.push_back(maxClassId);
-                        validCount++;
-                        boxes.push_back(box_x);
-                        boxes.push_back(box_y);
-                        boxes.push_back(box_w);
-                        boxes.push_back(box_h);
-                    }
-                }
-            }
+            decode_lut_init(&luts[index], zp, scale);
+            thresholds_dirty_ = true;
         }
     }
-    return validCount;
 }
 
-int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w, float conf_threshold,
-                 float nms_threshold, float scale_w, float scale_h, std::vector<int32_t> &qnt_zps,
-                 std::vector<float> &qnt_scales, detect_result_group_t *group)
+void PostProcessWorkspace::set_decode_threads(int n_threads)
+{
+    delete pool_;
+    pool_ = n_threads > 1 ? new DecodePool(n_threads) : NULL;
+    if (model_.num_heads > 0)
+    {
+        configure(model_);
+    }
+}
+
+int PostProcessWorkspace::set_classes(const int *classes, const float *thresholds, int count)
 {
-    static int init = -1;
-    if (init == -1)
+    for (int i = 0; i < count; i++)
     {
-        int ret = 0;
-        ret = loadLabelName(LABEL_NALE_TXT_PATH, labels);
-        if (ret < 0)
+        if (classes[i] < 0 || classes[i] >= YOLO_MAX_CLASSES)
         {
             return -1;
         }
+    }
+    // sorted, so that planes are read at increasing addresses and ties go to
+    // the lowest class id as without a list; duplicates keep the first entry
+    num_selected_ = 0;
+    has_class_thresholds_ = thresholds != NULL;
+    for (int i = 0; i < count; i++)
+    {
+        int pos = 0;
+        while (pos < num_selected_ && classes_[pos] < classes[i])
+        {
+            pos++;
+        }
+        if (pos < num_selected_ && classes_[pos] == classes[i])
+        {
+            continue;
+        }
+        memmove(&classes_[pos + 1], &classes_[pos], (num_selected_ - pos) * sizeof(int));
+        memmove(&class_thresholds_[pos + 1], &class_thresholds_[pos], (num_selected_ - pos) * sizeof(float));
+        classes_[pos] = classes[i];
+        class_thresholds_[pos] = thresholds != NULL ? thresholds[i] : 0;
+        num_selected_++;
+    }
+    if (model_.num_heads > 0)
+    {
+        configure(model_);
+    }
+    return 0;
+}
 
-        init = 0;
+// Quantizes the allow-list thresholds once per threshold and quantization
+// rather than once per job
+void PostProcessWorkspace::prepare_thresholds(float threshold)
+{
+    if (!thresholds_dirty_ && threshold == prepared_threshold_)
+    {
+        return;
     }
-    memset(group, 0, sizeof(detect_result_group_t));
+    obj_threshold_ = threshold;
+    for (int k = 0; k < num_active_; k++)
+    {
+        class_thres_[k] = has_class_thresholds_ ? class_thresholds_[k] : threshold;
+        if (has_class_thresholds_ && (k == 0 || class_thres_[k] < obj_threshold_))
+        {
+            obj_threshold_ = class_thres_[k];
+        }
+    }
+    for (int h = 0; h < model_.num_heads; h++)
+    {
+        for (int k = 0; k < num_active_; k++)
+        {
+            class_thres_i8_[h][k] = qnt_f32_to_affine(class_thres_[k], luts[h].zp, luts[h].scale);
+        }
+    }
+    prepared_threshold_ = threshold;
+    thresholds_dirty_ = false;
+}
 
-    std::vector<float> filterBoxes;
-    std::vector<float> objProbs;
-    std::vector<int> classId;
-
-    // stride 8
-    int stride0 = 8;
-    int grid_h0 = model_in_h / stride0;
-    int grid_w0 = model_in_w / stride0;
-    int validCount0 = 0;
-    validCount0 = process(input0, (int *)anchor0, grid_h0, grid_w0, model_in_h, model_in_w, stride0, filterBoxes, objProbs,
-                          classId, conf_threshold, qnt_zps[0], qnt_scales[0]);
-
-    // stride 16
-    int stride1 = 16;
-    int grid_h1 = model_in_h / stride1;
-    int grid_w1 = model_in_w / stride1;
-    int validCount1 = 0;
-    validCount1 = process(input1, (int *)anchor1, grid_h1, grid_w1, model_in_h, model_in_w, stride1, filterBoxes, objProbs,
-                          classId, conf_threshold, qnt_zps[1], qnt_scales[1]);
-
-    // stride 32
-    int stride2 = 32;
-    int grid_h2 = model_in_h / stride2;
-    int grid_w2 = model_in_w / stride2;
-    int validCount2 = 0;
-    validCount2 = process(input2, (int *)anchor2, grid_h2, grid_w2, model_in_h, model_in_w, stride2, filterBoxes, objProbs,
-                          classId, conf_threshold, qnt_zps[2], qnt_scales[2]);
-
-    int validCount = validCount0 + validCount1 + validCount2;
-    // no object detect
-    if (validCount <= 0)
+int PostProcessWorkspace::decode_head(const void *input, int head, float threshold)
+{
+    prepare_thresholds(threshold);
+    if (num_selected_ > 0 && num_active_ == 0)
+    {
+        return 0;
+    }
+    DecodeJob job;
+    init_job(&job, head, 0);
+    job.input = input;
+    job.threshold = obj_threshold_;
+    return decoders[head](&job);
+}
+
+void PostProcessWorkspace::run_task(int task, int thread, void *ctx)
+{
+    PostProcessWorkspace *workspace = (PostProcessWorkspace *)ctx;
+    DecodeJob *job = &workspace->tasks_[task];
+    // the scratch belongs to the thread, not to the task
+    DecodeScratch *scratch = &workspace->scratch_[thread];
+    job->cells = scratch->cells.data();
+    job->class_rows = scratch->class_rows.data();
+    job->class_rows_f32 = scratch->class_rows_f32.data();
+    job->plane = scratch->plane.data();
+    job->candidates->clear();
+    workspace->decoders[job->head](job);
+}
+
+int PostProcessWorkspace::decode(void *const *outputs, float threshold)
+{
+    candidates.clear();
+    prepare_thresholds(threshold);
+    if (num_selected_ > 0 && num_active_ == 0)
     {
         return 0;
     }
+    if (!parallel_)
+    {
+        int count = 0;
+        for (int h = 0; h < model_.num_heads; h++)
+        {
+            count += decode_head(outputs[h], h, threshold);
+        }
+        return count;
+    }
+
+    for (size_t t = 0; t < tasks_.size(); t++)
+    {
+        tasks_[t].input = outputs[tasks_[t].head];
+        tasks_[t].threshold = obj_threshold_;
+        tasks_[t].kernels = kernels;
+    }
+    pool_->run((int)tasks_.size(), run_task, this);
 
-    std::vector<int> indexArray;
-    for (int i = 0; i < validCount; ++i)
+    // Merge in the serial order (head, anchor, then row) so NMS sees the
+    // candidates exactly as a serial decode would have added them
+    for (size_t first = 0; first < tasks_.size();)
     {
-        indexArray.push_back(i);
+        size_t last = first;
+        while (last < tasks_.size() && tasks_[last].head == tasks_[first].head)
+        {
+            last++;
+        }
+        int num_anchors = model_.heads[tasks_[first].head].num_anchors;
+        for (int a = 0; a < num_anchors; a++)
+        {
+            for (size_t t = first; t < last; t++)
+            {
+                size_t begin = 0;
+                for (int k = 0; k < a; k++)
+                {
+                    begin += tasks_[t].added[k];
+                }
+                candidates.append(task_candidates_[t], begin, begin + tasks_[t].added[a]);
+            }
+        }
+        first = last;
     }
+    return (int)candidates.size();
+}
 
-    quick_sort_indice_inverse(objProbs, 0, validCount - 1, indexArray);
+int decode_head(const void *input, int head, float threshold, PostProcessWorkspace *workspace)
+{
+    return workspace->decode_head(input, head, threshold);
+}
 
-    std::set<int> class_set(std::begin(classId), std::end(classId));
+static int load_labels()
+{
+    // Inference workers may get here concurrently; a static local is initialised once
+    // RKNN_LABELS: label file of a custom model, one name per line
+    static const char *labels_path = getenv("RKNN_LABELS");
+    static int init = loadLabelName(labels_path != NULL ? labels_path : LABEL_NALE_TXT_PATH, labels);
+    return init;
+}
 
-    for (auto c : class_set)
+const char *post_process_label(int class_id)
+{
+    if (load_labels() < 0 || class_id < 0 || class_id >= YOLO_MAX_CLASSES)
     {
-        nms(validCount, filterBoxes, classId, indexArray, c, nms_threshold);
+        return NULL;
     }
+    return labels[class_id];
+}
+
+int post_process(void *const *outputs, float conf_threshold, float nms_threshold, float scale_w, float scale_h,
+                 PostProcessWorkspace *workspace, detect_result_group_t *group)
+{
+    if (load_labels() < 0)
+    {
+        return -1;
+    }
+    memset(group, 0, sizeof(detect_result_group_t));
+
+    const YoloModel &model = workspace->model();
+    NmsEngine &candidates = workspace->candidates;
+    int validCount = workspace->decode(outputs, conf_threshold);
+    // no object detect
+    if (validCount <= 0)
+    {
+        return 0;
+    }
+
+    int keepCount = candidates.run(nms_threshold, workspace->nms_mode, OBJ_NUMB_MAX_SIZE, workspace->keep);
 
     int last_count = 0;
     group->count = 0;
     /* box valid detect target */
-    for (int i = 0; i < validCount; ++i)
+    for (int i = 0; i < keepCount; ++i)
     {
-        if (indexArray[i] == -1 || last_count >= OBJ_NUMB_MAX_SIZE)
+        int n = workspace->keep[i];
+
+        float x1 = candidates.x1(n);
+        float y1 = candidates.y1(n);
+        float x2 = candidates.x2(n);
+        float y2 = candidates.y2(n);
+        int id = candidates.class_id(n);
+        float obj_conf = candidates.score(n);
+
+        group->results[last_count].box.left = (int)(clamp(x1, 0, model.input_w) / scale_w);
+        group->results[last_count].box.top = (int)(clamp(y1, 0, model.input_h) / scale_h);
+        group->results[last_count].box.right = (int)(clamp(x2, 0, model.input_w) / scale_w);
+        group->results[last_count].box.bottom = (int)(clamp(y2, 0, model.input_h) / scale_h);
+        group->results[last_count].prop = obj_conf;
+        group->results[last_count].class_id = id;
+        char *label = id < YOLO_MAX_CLASSES ? labels[id] : NULL;
+        if (label != NULL)
         {
-            continue;
+            // long labels from RKNN_LABELS are cut, never left unterminated
+            snprintf(group->results[last_count].name, OBJ_NAME_MAX_SIZE, "%s", label);
+        }
+        else
+        {
+            snprintf(group->results[last_count].name, OBJ_NAME_MAX_SIZE, "class%d", id);
         }
-        int n = indexArray[i];
-
-        float x1 = filterBoxes[n * 4 + 0];
-        float y1 = filterBoxes[n * 4 + 1];
-        float x2 = x1 + filterBoxes[n * 4 + 2];
-        float y2 = y1 + filterBoxes[n * 4 + 3];
-        int id = classId[n];
-        float obj_conf = objProbs[i];
-
-        group->results[last_count].box.left = (int)(clamp(x1, 0, model_in_w) / scale_w);
-        group->results[last_count].box.top = (int)(clamp(y1, 0, model_in_h) / scale_h);
-        group->results[last_count].box.right = (int)(clamp(x2, 0, model_in_w) / scale_w);
-        group->results[last_count].box.bottom = (int)(clamp(y2, 0, model_in_h) / scale_h);
-        group->results[last_count].prop = obj_conf;
-        char *label = labels[id];
-        strncpy(group->results[last_count].name, label, OBJ_NAME_MAX_SIZE);
         last_count++;
     }
     group->count = last_count;
@@ -357,9 +906,32 @@ int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h,
     return 0;
 }
 
+int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w, float conf_threshold,
+                 float nms_threshold, float scale_w, float scale_h, PostProcessWorkspace *workspace,
+                 detect_result_group_t *group)
+{
+    // The workspace is sized once, so nothing below allocates
+    workspace->reserve(model_in_h, model_in_w);
+    void *outputs[POST_PROCESS_OUTPUTS] = {input0, input1, input2};
+    return post_process(outputs, conf_threshold, nms_threshold, scale_w, scale_h, workspace, group);
+}
+
+int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w, float conf_threshold,
+                 float nms_threshold, float scale_w, float scale_h, std::vector<int32_t> &qnt_zps,
+                 std::vector<float> &qnt_scales, detect_result_group_t *group)
+{
+    static thread_local PostProcessWorkspace workspace;
+    for (size_t i = 0; i < qnt_zps.size() && i < qnt_scales.size(); i++)
+    {
+        workspace.set_quant(i, qnt_zps[i], qnt_scales[i]);
+    }
+    return post_process(input0, input1, input2, model_in_h, model_in_w, conf_threshold, nms_threshold, scale_w,
+                        scale_h, &workspace, group);
+}
+
 void deinitPostProcess()
 {
-    for (int i = 0; i < OBJ_CLASS_NUM; i++)
+    for (int i = 0; i < YOLO_MAX_CLASSES; i++)
     {
         if (labels[i] != nullptr)
         {
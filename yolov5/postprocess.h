@@ -1,11 +1,18 @@
 #ifndef _RKNN_YOLOV5_DEMO_POSTPROCESS_H_
 #define _RKNN_YOLOV5_DEMO_POSTPROCESS_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
+#include "decode_kernels.h"
+#include "decode_pool.h"
+#include "nms.h"
+#include "yolo_model.h"
+
 #define OBJ_NAME_MAX_SIZE 16
 #define OBJ_NUMB_MAX_SIZE 64
+// the default (COCO) model; others are described by a YoloModel
 #define OBJ_CLASS_NUM 80
 #define NMS_THRESH 0.45
 #define BOX_THRESH 0.25
@@ -22,6 +29,7 @@ typedef struct _BOX_RECT
 typedef struct __detect_result_t
 {
     char name[OBJ_NAME_MAX_SIZE];
+    int class_id;
     BOX_RECT box;
     float prop;
 } detect_result_t;
@@ -33,10 +41,197 @@ typedef struct _detect_result_group_t
     detect_result_t results[OBJ_NUMB_MAX_SIZE];
 } detect_result_group_t;
 
+// heads of the default model
+#define POST_PROCESS_OUTPUTS 3
+
+// What decode_head() derives from one int8 value of an output tensor, for
+// each of the 256 values under the tensor's zp/scale. Indexed by q + 128.
+typedef struct _DecodeLut
+{
+    int32_t zp;
+    float scale;
+    float dequant[256]; // (q - zp) * scale; the score is dequant[class] * dequant[obj]
+    float xy[256];      // dequant * 2 - 0.5: box centre offset in the cell
+    float wh[256];      // (dequant * 2)^2: box size in anchors
+} DecodeLut;
+
+void decode_lut_init(DecodeLut *lut, int32_t zp, float scale);
+
+// Grid cells (summed over heads) below which post_process() decodes on the
+// calling thread even with a pool: waking threads would cost more
+#define DECODE_PARALLEL_MIN_CELLS 4096
+// Cells x anchors of one parallel task; larger heads are cut in row bands
+#define DECODE_TASK_CELLS 2400
+
+// A piece of decoding work: every anchor of one head over grid rows
+// [row_begin, row_end), with the scratch it may use and where its
+// candidates go
+typedef struct _DecodeJob
+{
+    const void *input;
+    const YoloModel *model;
+    int head;
+    int row_begin;
+    int row_end;
+    float threshold; // objectness, and class score when there is no allow-list
+    // Allow-list: only these class planes are read, ascending; NULL reads all
+    // num_classes. Each has its own score threshold, quantized with `lut`
+    // for int8 heads.
+    const int *classes;
+    int num_selected;
+    const float *class_thresholds;
+    const int8_t *class_thresholds_i8;
+    const DecodeLut *lut;
+    const DecodeKernels *kernels;
+    int *cells;            // grid_w * rows entries
+    int8_t *class_rows;    // DECODE_GATHER_CELLS rows of num_classes (or num_selected), int8 heads
+    int8_t *plane;         // grid_w * rows entries, one channel gathered from NC1HWC2 heads
+    float *class_rows_f32; // same for fp16/fp32 heads
+    NmsEngine *candidates;
+    int added[YOLO_MAX_ANCHORS]; // out: candidates added per anchor, in anchor order
+} DecodeJob;
+
+// Decoder of one head, specialised for an element type and possibly for a
+// class and anchor count
+typedef int (*DecodeHeadFn)(DecodeJob *job);
+
+// Per-thread scratch of the decoder
+typedef struct _DecodeScratch
+{
+    std::vector<int> cells;            // cells passing the objectness threshold
+    std::vector<int8_t> class_rows;    // class scores of a batch of cells, one row per cell
+    std::vector<float> class_rows_f32; // same for fp16/fp32 heads
+    std::vector<int8_t> plane;         // objectness of NC1HWC2 heads, made contiguous
+} DecodeScratch;
+
+// Scratch memory of post_process(), kept across frames so that decoding a
+// frame makes no heap allocation once the first frame has sized it. Not
+// thread safe: use one per stream or per inference thread.
+class PostProcessWorkspace
+{
+public:
+    PostProcessWorkspace();
+    ~PostProcessWorkspace();
+
+    // Sets the model the outputs come from, picks a decoder for each head and
+    // sizes the buffers for the worst case (one candidate per anchor and grid
+    // cell). Allocates only when they grow.
+    void configure(const YoloModel &model);
+
+    // configure() with the default 80-class YOLOv5 at model_in_w x
+    // model_in_h, keeping the quantization already set. Nothing happens if
+    // that is already the model.
+    void reserve(int model_in_h, int model_in_w);
+
+    // Quantization of output `index`, usually from rknn_tensor_attr zp/scale.
+    // Rebuilds luts[index] when it changes.
+    void set_quant(int index, int32_t zp, float scale);
+
+    // Decodes with `n_threads` threads (the caller included) from now on:
+    // heads, and row bands of the large ones, are spread over a persistent
+    // pool, each task into its own candidate buffer, and the buffers are
+    // merged in order before NMS, so results are the same as serial. Models
+    // under parallel_min_cells stay serial. 1 turns the pool off.
+    void set_decode_threads(int n_threads);
+
+    // Decodes only `classes` from now on, e.g. 0,1,2,3,5,7 for person,
+    // bicycle, car, motorbike, bus and truck in COCO: the other class planes
+    // are never read and the other classes never become candidates. A cell
+    // takes the best of the listed classes. thresholds[i], if not NULL,
+    // replaces the conf_threshold of post_process() for classes[i], and the
+    // objectness scan then uses the lowest of them. Classes the model does
+    // not have are ignored. count 0 decodes every class again. Returns -1 if
+    // a class is out of range.
+    int set_classes(const int *classes, const float *thresholds, int count);
+    int num_selected() const { return num_selected_; }
+
+    // Decodes every head into `candidates` (cleared first), in parallel when
+    // enabled, and returns how many were added
+    int decode(void *const *outputs, float threshold);
+
+    // Decodes one head into `candidates`, on the calling thread
+    int decode_head(const void *input, int head, float threshold);
+
+    const YoloModel &model() const { return model_; }
+    bool parallel() const { return parallel_; }
+
+    NmsEngine candidates;
+    NmsMode nms_mode; // class-aware by default
+    int keep[OBJ_NUMB_MAX_SIZE];
+    const DecodeKernels *kernels;   // decode_kernels_best() by default
+    DecodeLut luts[YOLO_MAX_HEADS];
+    // Use the compile-time instantiations when a head matches one (default);
+    // false forces the runtime-sized decoder. Takes effect at configure().
+    bool specialized;
+    // Grid cells (summed over heads) from which a pool decodes in parallel,
+    // DECODE_PARALLEL_MIN_CELLS by default; 0 lets tests run small models
+    // through the pool. Takes effect at configure().
+    int parallel_min_cells;
+    DecodeHeadFn decoders[YOLO_MAX_HEADS];
+
+private:
+    PostProcessWorkspace(const PostProcessWorkspace &);
+    PostProcessWorkspace &operator=(const PostProcessWorkspace &);
+
+    void plan_tasks();
+    void init_job(DecodeJob *job, int head, int thread);
+    void prepare_thresholds(float threshold);
+    static void run_task(int task, int thread, void *ctx);
+
+    YoloModel model_;
+    std::vector<DecodeScratch> scratch_; // one per pool thread
+    DecodePool *pool_;
+    bool parallel_;
+    std::vector<DecodeJob> tasks_;           // input and threshold filled per frame
+    std::vector<NmsEngine> task_candidates_; // one per task, merged in task order
+
+    // Allow-list as set, sorted by class id; the first num_active_ are
+    // classes of the current model
+    int classes_[YOLO_MAX_CLASSES];
+    float class_thresholds_[YOLO_MAX_CLASSES];
+    bool has_class_thresholds_;
+    int num_selected_;
+    int num_active_;
+    // Thresholds of the allow-list for the last conf_threshold, quantized per
+    // head; rebuilt when the threshold, quantization or list changes
+    float prepared_threshold_;
+    bool thresholds_dirty_;
+    float obj_threshold_;
+    float class_thres_[YOLO_MAX_CLASSES];
+    int8_t class_thres_i8_[YOLO_MAX_HEADS][YOLO_MAX_CLASSES];
+};
+
+// Decodes head `head` of workspace->model() into workspace->candidates and
+// returns how many were added. The objectness plane is scanned first to list
+// the candidate cells; box and class channels are then read plane by plane
+// for those cells only, instead of jumping across all planes for every
+// passing cell. Int8 heads use workspace->kernels for the scan and the class
+// argmax, and convert values through workspace->luts[head]. Honours the
+// allow-list of set_classes(). Int8 heads in the NPU's NC1HWC2 layout are
+// decoded in place, with the same results as after conversion to NCHW; the
+// strided objectness reads make that decode slower than the NCHW one, the
+// gain is the conversion it saves.
+// Always serial.
+int decode_head(const void *input, int head, float threshold, PostProcessWorkspace *workspace);
+
+// Outputs of workspace->model(), one pointer per head
+int post_process(void *const *outputs, float conf_threshold, float nms_threshold, float scale_w, float scale_h,
+                 PostProcessWorkspace *workspace, detect_result_group_t *group);
+
+// The default 80-class YOLOv5 model at model_in_w x model_in_h
+int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w,
+                 float conf_threshold, float nms_threshold, float scale_w, float scale_h,
+                 PostProcessWorkspace *workspace, detect_result_group_t *group);
+
+// Same as above with the quantization passed per call and a per-thread workspace
 int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w,
                  float conf_threshold, float nms_threshold, float scale_w, float scale_h,
                  std::vector<int32_t> &qnt_zps, std::vector<float> &qnt_scales,
                  detect_result_group_t *group);
 
+// Label of a class from the label file post_process() uses, NULL when the
+// file has no line for it or cannot be read
+const char *post_process_label(int class_id);
+
 void deinitPostProcess();
 #endif //_RKNN_YOLOV5_DEMO_POSTPROCESS_H_
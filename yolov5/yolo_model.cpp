@@ -0,0 +1,224 @@
+#include "yolo_model.h"
+
+#include <string.h>
+
+// YOLOv5 anchors of the P3..P6 heads, by stride
+static const int DEFAULT_STRIDES[] = {8, 16, 32, 64};
+static const int DEFAULT_ANCHORS[][6] = {
+    {10, 13, 16, 30, 33, 23}, {30, 61, 62, 45, 59, 119}, {116, 90, 156, 198, 373, 326}, {436, 615, 739, 380, 925, 792}};
+
+static void set_default_anchors(YoloHead *head)
+{
+    // Unknown strides take the closest larger head's anchors
+    int d = 0;
+    while (d < 3 && DEFAULT_STRIDES[d] < head->stride)
+    {
+        d++;
+    }
+    for (int a = 0; a < head->num_anchors * 2; a++)
+    {
+        head->anchors[a] = DEFAULT_ANCHORS[d][a % 6];
+    }
+}
+
+void yolo_model_default(YoloModel *model, int input_w, int input_h)
+{
+    memset(model, 0, sizeof(YoloModel));
+    model->input_w = input_w;
+    model->input_h = input_h;
+    model->num_classes = 80;
+    model->num_heads = 3;
+    for (int i = 0; i < model->num_heads; i++)
+    {
+        YoloHead *head = &model->heads[i];
+        head->stride = DEFAULT_STRIDES[i];
+        head->grid_h = input_h / head->stride;
+        head->grid_w = input_w / head->stride;
+        head->num_anchors = 3;
+        head->type = YOLO_TENSOR_INT8;
+        head->scale = 1.0f;
+        set_default_anchors(head);
+    }
+}
+
+int yolo_model_from_shapes(YoloModel *model, int input_w, int input_h, int num_heads, const int *channels,
+                           const int *grid_h, const int *grid_w, const YoloTensorType *types, int num_anchors)
+{
+    if (num_heads <= 0 || num_heads > YOLO_MAX_HEADS || num_anchors <= 0 || num_anchors > YOLO_MAX_ANCHORS)
+    {
+        return -1;
+    }
+    memset(model, 0, sizeof(YoloModel));
+    model->input_w = input_w;
+    model->input_h = input_h;
+    model->num_heads = num_heads;
+    model->num_classes = channels[0] / num_anchors - 5;
+    if (model->num_classes <= 0 || model->num_classes > YOLO_MAX_CLASSES)
+    {
+        return -1;
+    }
+    for (int i = 0; i < num_heads; i++)
+    {
+        YoloHead *head = &model->heads[i];
+        if (channels[i] != num_anchors * (5 + model->num_classes) || grid_h[i] <= 0 || grid_w[i] <= 0)
+        {
+            return -1;
+        }
+        head->grid_h = grid_h[i];
+        head->grid_w = grid_w[i];
+        head->stride = input_w / grid_w[i];
+        head->num_anchors = num_anchors;
+        head->type = types[i];
+        head->scale = 1.0f;
+        set_default_anchors(head);
+    }
+    return 0;
+}
+
+int yolo_model_set_anchors(YoloModel *model, const int *anchors, int count)
+{
+    int expected = 0;
+    for (int i = 0; i < model->num_heads; i++)
+    {
+        expected += model->heads[i].num_anchors * 2;
+    }
+    if (count != expected)
+    {
+        return -1;
+    }
+    for (int i = 0; i < model->num_heads; i++)
+    {
+        YoloHead *head = &model->heads[i];
+        memcpy(head->anchors, anchors, head->num_anchors * 2 * sizeof(int));
+        anchors += head->num_anchors * 2;
+    }
+    return 0;
+}
+
+size_t yolo_tensor_elem_size(YoloTensorType type)
+{
+    switch (type)
+    {
+    case YOLO_TENSOR_FP16:
+        return 2;
+    case YOLO_TENSOR_FP32:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+size_t yolo_head_size(const YoloModel *model, int index)
+{
+    const YoloHead *head = &model->heads[index];
+    size_t channels = head->num_anchors * (5 + model->num_classes);
+    if (head->layout == YOLO_LAYOUT_NC1HWC2)
+    {
+        channels = (channels + head->c2 - 1) / head->c2 * head->c2;
+    }
+    return channels * head->grid_h * head->grid_w * yolo_tensor_elem_size(head->type);
+}
+
+static const char *TYPE_NAMES[] = {"int8", "fp16", "fp32"};
+static const char *LAYOUT_NAMES[] = {"nchw", "nc1hwc2"};
+
+int yolo_model_write(FILE *fp, const YoloModel *model)
+{
+    fprintf(fp, "yolo %d %d %d %d\n", model->input_w, model->input_h, model->num_classes, model->num_heads);
+    for (int i = 0; i < model->num_heads; i++)
+    {
+        const YoloHead *head = &model->heads[i];
+        fprintf(fp, "head %d %d %d %d %s %s %d %d %.9g", head->grid_h, head->grid_w, head->stride, head->num_anchors,
+                TYPE_NAMES[head->type], LAYOUT_NAMES[head->layout], head->c2, head->zp, head->scale);
+        for (int a = 0; a < head->num_anchors * 2; a++)
+        {
+            fprintf(fp, " %d", head->anchors[a]);
+        }
+        fprintf(fp, "\n");
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+static int find_name(const char *name, const char *const *names, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int yolo_model_read(FILE *fp, YoloModel *model)
+{
+    memset(model, 0, sizeof(YoloModel));
+    if (fscanf(fp, " yolo %d %d %d %d", &model->input_w, &model->input_h, &model->num_classes, &model->num_heads) != 4 ||
+        model->num_classes <= 0 || model->num_classes > YOLO_MAX_CLASSES || model->num_heads <= 0 ||
+        model->num_heads > YOLO_MAX_HEADS)
+    {
+        return -1;
+    }
+    for (int i = 0; i < model->num_heads; i++)
+    {
+        YoloHead *head = &model->heads[i];
+        char type[8], layout[8];
+        if (fscanf(fp, " head %d %d %d %d %7s %7s %d %d %f", &head->grid_h, &head->grid_w, &head->stride,
+                   &head->num_anchors, type, layout, &head->c2, &head->zp, &head->scale) != 9 ||
+            head->grid_h <= 0 || head->grid_w <= 0 || head->num_anchors <= 0 || head->num_anchors > YOLO_MAX_ANCHORS)
+        {
+            return -1;
+        }
+        int t = find_name(type, TYPE_NAMES, 3);
+        int l = find_name(layout, LAYOUT_NAMES, 2);
+        if (t < 0 || l < 0 || (l == YOLO_LAYOUT_NC1HWC2 && (t != YOLO_TENSOR_INT8 || head->c2 <= 0)))
+        {
+            return -1;
+        }
+        head->type = (YoloTensorType)t;
+        head->layout = (YoloTensorLayout)l;
+        for (int a = 0; a < head->num_anchors * 2; a++)
+        {
+            if (fscanf(fp, "%d", &head->anchors[a]) != 1)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+float yolo_fp16_to_f32(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13); // inf / nan
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0)
+    {
+        bits = sign;
+    }
+    else
+    {
+        // subnormal half: normalise into a float exponent
+        exponent = 113;
+        while ((mantissa & 0x400) == 0)
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
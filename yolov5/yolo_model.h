@@ -0,0 +1,100 @@
+#ifndef _RKNN_YOLOV5_DEMO_YOLO_MODEL_H_
+#define _RKNN_YOLOV5_DEMO_YOLO_MODEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Geometry of a YOLO detection model, so post-processing is not tied to the
+// 640x640 80-class COCO model. Filled from the output shapes the runtime
+// reports (rknn_tensor_attr dims in gst-test); no rknn dependency here so the
+// decoder also builds on a host.
+
+#define YOLO_MAX_HEADS 4
+#define YOLO_MAX_ANCHORS 3
+#define YOLO_MAX_CLASSES 256
+
+typedef enum _YoloTensorType
+{
+    YOLO_TENSOR_INT8, // affine quantized with zp/scale
+    YOLO_TENSOR_FP16,
+    YOLO_TENSOR_FP32,
+} YoloTensorType;
+
+typedef enum _YoloTensorLayout
+{
+    YOLO_LAYOUT_NCHW,
+    // The NPU's native layout, int8 heads only: channels in blocks of c2,
+    // [channels / c2][grid_h][grid_w][c2], the last block zero padded
+    YOLO_LAYOUT_NC1HWC2,
+} YoloTensorLayout;
+
+// One output head, laid out [num_anchors * (5 + num_classes)][grid_h][grid_w]
+// unless `layout` says otherwise
+typedef struct _YoloHead
+{
+    int grid_h;
+    int grid_w;
+    int stride; // input pixels per grid cell
+    int num_anchors;
+    int anchors[YOLO_MAX_ANCHORS * 2]; // w, h pairs in input pixels
+    YoloTensorType type;
+    int32_t zp; // int8 only
+    float scale;
+    YoloTensorLayout layout; // NCHW unless set after yolo_model_from_shapes()
+    int c2;                  // NC1HWC2 only
+} YoloHead;
+
+typedef struct _YoloModel
+{
+    int input_w;
+    int input_h;
+    int num_classes;
+    int num_heads;
+    YoloHead heads[YOLO_MAX_HEADS];
+} YoloModel;
+
+// The 80-class YOLOv5 with int8 outputs on the stride 8, 16 and 32 grids
+void yolo_model_default(YoloModel *model, int input_w, int input_h);
+
+// Derives the model from its output shapes: head i has channels[i] planes of
+// grid_h[i] x grid_w[i], channels = num_anchors * (5 + classes). Heads get
+// the YOLOv5 anchors of their stride. Quantization is left at zp 0 / scale 1.
+// Returns -1 if the shapes are not a YOLO head layout.
+int yolo_model_from_shapes(YoloModel *model, int input_w, int input_h, int num_heads, const int *channels,
+                           const int *grid_h, const int *grid_w, const YoloTensorType *types, int num_anchors);
+
+// Replaces the anchors of every head from a flat list of w, h pairs, heads
+// in order (e.g. the anchors: block of a custom model's yaml). Returns -1 if
+// the count does not match.
+int yolo_model_set_anchors(YoloModel *model, const int *anchors, int count);
+
+size_t yolo_tensor_elem_size(YoloTensorType type);
+
+// Bytes of head `index`'s output tensor, padding of NC1HWC2 blocks included
+size_t yolo_head_size(const YoloModel *model, int index);
+
+// Text description of a model, written next to dumped outputs so they can
+// be decoded off the board:
+//   yolo <input_w> <input_h> <num_classes> <num_heads>
+//   head <grid_h> <grid_w> <stride> <num_anchors> int8|fp16|fp32 nchw|nc1hwc2 <c2> <zp> <scale> <anchors...>
+// yolo_model_read() returns -1 on anything else.
+int yolo_model_write(FILE *fp, const YoloModel *model);
+int yolo_model_read(FILE *fp, YoloModel *model);
+
+// Element index of `channel` at grid cell `cell` (row * grid_w + col) in
+// the head's layout
+static inline size_t yolo_head_index(const YoloHead *head, int channel, int cell)
+{
+    size_t grid_len = (size_t)head->grid_h * head->grid_w;
+    if (head->layout == YOLO_LAYOUT_NC1HWC2)
+    {
+        return ((channel / head->c2) * grid_len + cell) * head->c2 + channel % head->c2;
+    }
+    return channel * grid_len + cell;
+}
+
+// IEEE half stored as uint16_t, for hosts without a native fp16 type
+float yolo_fp16_to_f32(uint16_t h);
+
+#endif //_RKNN_YOLOV5_DEMO_YOLO_MODEL_H_